@@ -27,20 +27,26 @@ dd if=loader.bin of=$DISK1_NAME bs=512 conv=notrunc seek=1
 # 写kernel区，定位到磁盘第100个块
 dd if=kernel.elf of=$DISK1_NAME bs=512 conv=notrunc seek=100
 
+# 写initrd镜像，定位到磁盘第1000个块，与boot_info.h中的SYS_INITRD_SECTOR一致
+dd if=initrd.tar of=$DISK1_NAME bs=512 conv=notrunc seek=1000
+
 # 写应用程序init，临时使用
 # dd if=init.elf of=$DISK1_NAME bs=512 conv=notrunc seek=5000
 # dd if=shell.elf of=$DISK1_NAME bs=512 conv=notrunc seek=5000
 
-# 写应用程序，使用系统的挂载命令
-export DISK2_NAME=disk2.img
-export TARGET_PATH=mp
-rm -rf $TARGET_PATH
-mkdir $TARGET_PATH
-sudo mount -o offset=$[128*512],rw $DISK2_NAME $TARGET_PATH
-# sudo cp -v init.elf $TARGET_PATH/init
-# sudo cp -v shell.elf $TARGET_PATH
-# sudo cp -v loop.elf $TARGET_PATH/loop
-# sudo cp -v snake.elf $TARGET_PATH/snake
-sudo cp -v *.elf $TARGET_PATH
-
-sudo umount $TARGET_PATH
+# 应用程序已在initrd中，启动后位于/bin下，不再需要复制到磁盘2
+# 仍需复制时设置COPY_APPS_TO_DISK2=1，使用系统的挂载命令，需要sudo
+if [ "$COPY_APPS_TO_DISK2" = "1" ]; then
+    export DISK2_NAME=disk2.img
+    export TARGET_PATH=mp
+    rm -rf $TARGET_PATH
+    mkdir $TARGET_PATH
+    sudo mount -o offset=$[128*512],rw $DISK2_NAME $TARGET_PATH
+    # sudo cp -v init.elf $TARGET_PATH/init
+    # sudo cp -v shell.elf $TARGET_PATH
+    # sudo cp -v loop.elf $TARGET_PATH/loop
+    # sudo cp -v snake.elf $TARGET_PATH/snake
+    sudo cp -v *.elf $TARGET_PATH
+
+    sudo umount $TARGET_PATH
+fi
@@ -17,6 +17,9 @@ dd if=loader.bin of=$DISK1_NAME bs=512 conv=notrunc seek=1
 # 写kernel区，定位到磁盘第100个块
 dd if=kernel.elf of=$DISK1_NAME bs=512 conv=notrunc seek=100
 
+# 写initrd镜像，定位到磁盘第1000个块，与boot_info.h中的SYS_INITRD_SECTOR一致
+dd if=initrd.tar of=$DISK1_NAME bs=512 conv=notrunc seek=1000
+
 # 写应用程序init，临时使用
 # dd if=init.elf of=$DISK1_NAME bs=512 conv=notrunc seek=5000
 # dd if=shell.elf of=$DISK1_NAME bs=512 conv=notrunc seek=5000
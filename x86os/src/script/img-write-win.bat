@@ -18,6 +18,9 @@ dd if=loader.bin of=%DISK1_NAME% bs=512 conv=notrunc seek=1
 
 dd if=kernel.elf of=%DISK1_NAME% bs=512 conv=notrunc seek=100
 
+@REM 写initrd镜像，与boot_info.h中的SYS_INITRD_SECTOR一致
+dd if=initrd.tar of=%DISK1_NAME% bs=512 conv=notrunc seek=1000
+
 @REM dd if=init.elf of=%DISK1_NAME% bs=512 conv=notrunc seek=5000
 @dd if=shell.elf of=%DISK1_NAME% bs=512 conv=notrunc seek=5000
 
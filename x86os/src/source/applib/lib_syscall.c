@@ -152,6 +152,14 @@ int fstat(int file, struct stat *st) {
 /**
  * 判断文件描述符与tty关联
  */
+int stat(const char * path, struct stat *st) {
+    syscall_args_t args;
+    args.id = SYS_stat;
+    args.arg0 = (int)path;
+    args.arg1 = (int)st;
+    return sys_call(&args);
+}
+
 int isatty(int file) {
     syscall_args_t args;
     args.id = SYS_isatty;
@@ -183,6 +191,98 @@ int ioctl(int fd, int cmd, int arg0, int arg1) {
     return sys_call(&args);
 }
 
+/**
+ * 等待多个文件上的事件，timeout为毫秒数，小于0时一直等待
+ */
+int poll(struct pollfd * fds, int nfds, int timeout) {
+    syscall_args_t args;
+    args.id = SYS_poll;
+    args.arg0 = (int)fds;
+    args.arg1 = nfds;
+    args.arg2 = timeout;
+    return sys_call(&args);
+}
+
+/**
+ * 基于poll实现select，调用门最多只能传4个参数
+ * 只支持读和写两类事件，exceptfds总是被清空
+ */
+int select(int n, fd_set * readfds, fd_set * writefds, fd_set * exceptfds, struct timeval * timeout) {
+    if ((n < 0) || (n > FD_SETSIZE)) {
+        return -1;
+    }
+
+    // 将集合转换为pollfd数组
+    struct pollfd fds[FD_SETSIZE];
+    int nfds = 0;
+    for (int fd = 0; fd < n; fd++) {
+        short events = 0;
+        if (readfds && FD_ISSET(fd, readfds)) {
+            events |= POLLIN;
+        }
+        if (writefds && FD_ISSET(fd, writefds)) {
+            events |= POLLOUT;
+        }
+        if (events) {
+            fds[nfds].fd = fd;
+            fds[nfds].events = events;
+            nfds++;
+        }
+    }
+
+    int ms = -1;
+    if (timeout) {
+        ms = timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
+    }
+
+    int err = poll(fds, nfds, ms);
+    if (err < 0) {
+        return err;
+    }
+
+    // 按结果重建集合，返回就绪的位数
+    if (readfds) {
+        FD_ZERO(readfds);
+    }
+    if (writefds) {
+        FD_ZERO(writefds);
+    }
+    if (exceptfds) {
+        FD_ZERO(exceptfds);
+    }
+
+    int cnt = 0;
+    for (int i = 0; i < nfds; i++) {
+        struct pollfd * pfd = fds + i;
+        if (pfd->revents & POLLNVAL) {
+            return -1;
+        }
+        if (readfds && (pfd->revents & (POLLIN | POLLHUP | POLLERR))) {
+            FD_SET(pfd->fd, readfds);
+            cnt++;
+        }
+        if (writefds && (pfd->revents & (POLLOUT | POLLERR))) {
+            FD_SET(pfd->fd, writefds);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/**
+ * 读取终端的行规程设置
+ */
+int tcgetattr(int fd, struct termios * tio) {
+    return ioctl(fd, TTY_CMD_TCGETS, (int)tio, 0);
+}
+
+/**
+ * 修改终端的行规程设置，action为TCSANOW、TCSADRAIN或TCSAFLUSH
+ */
+int tcsetattr(int fd, int action, const struct termios * tio) {
+    return ioctl(fd, TTY_CMD_TCSETS, (int)tio, action);
+}
+
 DIR * opendir(const char * name) {
     DIR * dir = (DIR *)malloc(sizeof(DIR));
     if (dir == (DIR *)0) {
@@ -230,3 +330,112 @@ int unlink(const char *path) {
     args.arg0 = (int)path;
     return sys_call(&args);
 }
+
+int mkdir(const char * path, mode_t mode) {
+    syscall_args_t args;
+    args.id = SYS_mkdir;
+    args.arg0 = (int)path;
+    return sys_call(&args);
+}
+
+int rmdir(const char * path) {
+    syscall_args_t args;
+    args.id = SYS_rmdir;
+    args.arg0 = (int)path;
+    return sys_call(&args);
+}
+
+int chdir(const char * path) {
+    syscall_args_t args;
+    args.id = SYS_chdir;
+    args.arg0 = (int)path;
+    return sys_call(&args);
+}
+
+char * getcwd(char * buf, size_t size) {
+    syscall_args_t args;
+    args.id = SYS_getcwd;
+    args.arg0 = (int)buf;
+    args.arg1 = (int)size;
+    int err = sys_call(&args);
+    return (err < 0) ? (char *)0 : buf;
+}
+
+int readv(int file, const struct iovec * iov, int iovcnt) {
+    syscall_args_t args;
+    args.id = SYS_readv;
+    args.arg0 = file;
+    args.arg1 = (int)iov;
+    args.arg2 = iovcnt;
+    return sys_call(&args);
+}
+
+int writev(int file, const struct iovec * iov, int iovcnt) {
+    syscall_args_t args;
+    args.id = SYS_writev;
+    args.arg0 = file;
+    args.arg1 = (int)iov;
+    args.arg2 = iovcnt;
+    return sys_call(&args);
+}
+
+ssize_t pread(int file, void * buf, size_t count, off_t offset) {
+    syscall_args_t args;
+    args.id = SYS_pread;
+    args.arg0 = file;
+    args.arg1 = (int)buf;
+    args.arg2 = (int)count;
+    args.arg3 = (int)offset;
+    return sys_call(&args);
+}
+
+ssize_t pwrite(int file, const void * buf, size_t count, off_t offset) {
+    syscall_args_t args;
+    args.id = SYS_pwrite;
+    args.arg0 = file;
+    args.arg1 = (int)buf;
+    args.arg2 = (int)count;
+    args.arg3 = (int)offset;
+    return sys_call(&args);
+}
+
+int sendfile(int out, int in, off_t * offset, int count) {
+    syscall_args_t args;
+    args.id = SYS_sendfile;
+    args.arg0 = out;
+    args.arg1 = in;
+    args.arg2 = (int)offset;
+    args.arg3 = count;
+    return sys_call(&args);
+}
+
+int fsync(int file) {
+    syscall_args_t args;
+    args.id = SYS_fsync;
+    args.arg0 = file;
+    return sys_call(&args);
+}
+
+int fdatasync(int file) {
+    syscall_args_t args;
+    args.id = SYS_fdatasync;
+    args.arg0 = file;
+    return sys_call(&args);
+}
+
+void sync(void) {
+    syscall_args_t args;
+    args.id = SYS_sync;
+    sys_call(&args);
+}
+
+/**
+ * 读取内核日志缓存，返回写入buf的字节数
+ */
+int dmesg(char * buf, int size) {
+    syscall_args_t args;
+    args.id = SYS_dmesg;
+    args.arg0 = (int)buf;
+    args.arg1 = size;
+    return sys_call(&args);
+}
@@ -32,9 +32,14 @@ int close(int file);
 int lseek(int file, int ptr, int dir);
 int isatty(int file);
 int fstat(int file, struct stat *st);
+int stat(const char * path, struct stat *st);
 void * sbrk(ptrdiff_t incr);
 int dup (int file);
 int ioctl(int fd, int cmd, int arg0, int arg1);
+int poll(struct pollfd * fds, int nfds, int timeout);
+int select(int n, fd_set * readfds, fd_set * writefds, fd_set * exceptfds, struct timeval * timeout);
+int tcgetattr(int fd, struct termios * tio);
+int tcsetattr(int fd, int action, const struct termios * tio);
 
 struct dirent {
    int index;         // 在目录中的偏移
@@ -45,15 +50,39 @@ struct dirent {
 
 typedef struct _DIR {
     int index;               // 当前遍历的索引
+    int fs;                  // 所在的文件系统，由内核填写
+    int start;               // 目录的起始位置，如FAT中目录的起始簇，由内核填写
     struct dirent dirent;    // 目录文件中的目录项
 } DIR;
 
 
+/**
+ * 分散/聚集读写的一段缓存
+ */
+struct iovec {
+    void * iov_base;        // 缓存起始地址
+    int iov_len;            // 缓存大小
+};
+
+int readv(int file, const struct iovec * iov, int iovcnt);
+int writev(int file, const struct iovec * iov, int iovcnt);
+ssize_t pread(int file, void * buf, size_t count, off_t offset);
+ssize_t pwrite(int file, const void * buf, size_t count, off_t offset);
+
 DIR * opendir(const char * name);   // name: 需要打开的目录的路径
 struct dirent* readdir(DIR* dir);
 int closedir(DIR *dir);
 
 
 int unlink(const char *pathname);
+int mkdir(const char * path, mode_t mode);
+int rmdir(const char * path);
+int chdir(const char * path);
+char * getcwd(char * buf, size_t size);
+int sendfile(int out, int in, off_t * offset, int count);
+int fsync(int file);
+int fdatasync(int file);
+void sync(void);
+int dmesg(char * buf, int size);
 
 #endif //LIB_SYSCALL_H
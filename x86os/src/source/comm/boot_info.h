@@ -16,9 +16,17 @@ typedef struct _boot_info_t {
         uint32_t size;
     }ram_region_cfg[BOOT_RAM_REGION_MAX];
     int ram_region_count;
+
+    // loader读入内存的initrd镜像，没有时大小为0
+    uint32_t initrd_start;
+    uint32_t initrd_size;
 }boot_info_t;
 
 #define SECTOR_SIZE		512			// 磁盘扇区大小
 #define SYS_KERNEL_LOAD_ADDR		(1024*1024)		// 内核加载的起始地址
 
+#define SYS_INITRD_SECTOR			1000			// initrd镜像在磁盘1上的起始扇区，在内核之后
+#define SYS_INITRD_LOAD_ADDR		(2*1024*1024)	// initrd加载的起始地址，在内核elf的临时存放区之后
+#define SYS_INITRD_MAX_SIZE			(2*1024*1024)	// initrd的最大字节数
+
 #endif // BOOT_INFO_H
@@ -0,0 +1,70 @@
+
+#ifndef OS_TAR_H
+#define OS_TAR_H
+
+#include "types.h"
+
+// initrd镜像使用ustar格式：每个文件为一个512字节的头，后跟按512字节补齐的数据，以全0块结束
+#define TAR_BLOCK_SIZE      512
+#define TAR_MAGIC           "ustar"         // 头中magic字段的前5个字节
+
+#define TAR_TYPE_NORMAL     '0'             // 普通文件，旧格式中也可能为'\0'
+#define TAR_TYPE_DIR        '5'             // 目录
+
+#pragma pack(1)
+
+/**
+ * ustar文件头，数值字段均为以空格或'\0'结尾的八进制字符串
+ */
+typedef struct _tar_header_t {
+    char name[100];             // 文件名
+    char mode[8];               // 访问权限
+    char uid[8];
+    char gid[8];
+    char size[12];              // 文件大小
+    char mtime[12];             // 修改时间，自1970年起的秒数
+    char chksum[8];
+    char typeflag;              // 文件类型
+    char linkname[100];
+    char magic[6];              // "ustar"
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];           // 文件名过长时的前缀部分
+    char pad[12];
+} tar_header_t;
+
+#pragma pack()
+
+/**
+ * @brief 将头中的八进制字段转换为数值
+ */
+static inline uint32_t tar_octal (const char * str, int size) {
+    uint32_t value = 0;
+    int i = 0;
+
+    // 有的工具用空格而非0补齐开头
+    while ((i < size) && (str[i] == ' ')) {
+        i++;
+    }
+    for (; (i < size) && (str[i] >= '0') && (str[i] <= '7'); i++) {
+        value = (value << 3) + (str[i] - '0');
+    }
+    return value;
+}
+
+/**
+ * @brief 检查是否为有效的ustar文件头，结束处的全0块不是
+ */
+static inline int tar_header_valid (const tar_header_t * hdr) {
+    for (int i = 0; i < sizeof(TAR_MAGIC) - 1; i++) {
+        if (hdr->magic[i] != TAR_MAGIC[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif // OS_TAR_H
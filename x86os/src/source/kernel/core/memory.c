@@ -2,6 +2,7 @@
 #include "tools/klib.h"
 #include "tools/log.h"
 #include "core/memory.h"
+#include "core/task.h"
 #include "tools/klib.h"
 #include "cpu/mmu.h"
 #include "dev/console.h"
@@ -392,6 +393,21 @@ uint32_t memory_alloc_page (void) {
     return addr_alloc_page(&paddr_alloc, 1);
 }
 
+/**
+ * @brief 分配连续的多页内存
+ * 用于内核中较大的缓存，如FAT表缓存。内核空间一一映射，所以物理连续即虚拟连续
+ */
+uint32_t memory_alloc_pages (int page_count) {
+    return addr_alloc_page(&paddr_alloc, page_count);
+}
+
+/**
+ * @brief 释放由memory_alloc_pages分配的多页内存
+ */
+void memory_free_pages (uint32_t addr, int page_count) {
+    addr_free_page(&paddr_alloc, addr, page_count);
+}
+
 /**
  * @brief 释放一页内存
  */
@@ -441,6 +457,14 @@ void memory_init (boot_info_t * boot_info) {
     // 到这里，mem_free应该比EBDA地址要小
     ASSERT(mem_free < (uint8_t *)MEM_EBDA_START);
 
+    // loader读入的initrd一直保留，由initramfs直接使用其中的数据，不能再分配出去
+    if (boot_info->initrd_size) {
+        uint32_t start = down2(boot_info->initrd_start, MEM_PAGE_SIZE);
+        uint32_t end = up2(boot_info->initrd_start + boot_info->initrd_size, MEM_PAGE_SIZE);
+        bitmap_set_bit(&paddr_alloc.bitmap, (start - MEM_EXT_START) / MEM_PAGE_SIZE, (end - start) / MEM_PAGE_SIZE, 1);
+        log_printf("initrd: 0x%x, size: 0x%x", boot_info->initrd_start, boot_info->initrd_size);
+    }
+
     // 创建内核页表并切换过去
     create_kernel_table();
 
@@ -40,6 +40,21 @@ static const syscall_handler_t sys_table[] = {
 	[SYS_readdir]  = (syscall_handler_t)sys_readdir,
 	[SYS_closedir] = (syscall_handler_t)sys_closedir,
 	[SYS_unlink]   = (syscall_handler_t)sys_unlink,
+	[SYS_mkdir]    = (syscall_handler_t)sys_mkdir,
+	[SYS_rmdir]    = (syscall_handler_t)sys_rmdir,
+	[SYS_chdir]    = (syscall_handler_t)sys_chdir,
+	[SYS_getcwd]   = (syscall_handler_t)sys_getcwd,
+	[SYS_fsync]    = (syscall_handler_t)sys_fsync,
+	[SYS_fdatasync] = (syscall_handler_t)sys_fdatasync,
+	[SYS_sync]     = (syscall_handler_t)sys_sync,
+	[SYS_sendfile] = (syscall_handler_t)sys_sendfile,
+	[SYS_readv]    = (syscall_handler_t)sys_readv,
+	[SYS_writev]   = (syscall_handler_t)sys_writev,
+	[SYS_pread]    = (syscall_handler_t)sys_pread,
+	[SYS_pwrite]   = (syscall_handler_t)sys_pwrite,
+	[SYS_stat]     = (syscall_handler_t)sys_stat,
+	[SYS_poll]     = (syscall_handler_t)sys_poll,
+	[SYS_dmesg]    = (syscall_handler_t)sys_dmesg,
 };
 
 /**
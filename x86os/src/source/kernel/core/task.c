@@ -134,6 +134,7 @@ int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32
     kernel_strncpy(task->name, name, TASK_NAME_SIZE);
     task->state = TASK_CREATED;
     task->sleep_ticks = 0;
+    task->wait_list = (list_t *)0;
     task->time_slice = TASK_TIME_SLICE_DEFAULT;
     task->slice_ticks = task->time_slice;
     task->parent = (task_t *)0;
@@ -145,6 +146,7 @@ int task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32
 
     // 文件相关
     kernel_memset(task->file_table, 0, sizeof(task->file_table));
+    kernel_strncpy(task->cwd, "/", TASK_CWD_SIZE);
 
     // 插入就绪队列中和所有的任务队列中
     irq_state_t state = irq_enter_protection();
@@ -448,6 +450,12 @@ void task_time_tick (void) {
         if (--task->sleep_ticks == 0) {
             // 延时时间到达，从睡眠队列中移除，送至就绪队列
             task_set_wakeup(task);
+
+            // 限时等待超时，同时从等待队列中移除
+            if (task->wait_list) {
+                list_remove(task->wait_list, &task->wait_node);
+                task->wait_list = (list_t *)0;
+            }
             task_set_ready(task);
         }
         curr = next;
@@ -547,8 +555,9 @@ int sys_fork (void) {
         goto fork_failed;
     }
 
-    // 拷贝打开的文件
+    // 拷贝打开的文件，并继承工作目录
     copy_opened_files(child_task);
+    kernel_strncpy(child_task->cwd, parent_task->cwd, TASK_CWD_SIZE);
 
     // 从父进程的栈中取部分状态，然后写入tss。
     // 注意检查esp, eip等是否在用户空间范围内，不然会造成page_fault
@@ -605,30 +614,26 @@ static int load_phdr(int file, Elf32_Phdr * phdr, uint32_t page_dir) {
         return -1;
     }
 
-    // 调整当前的读写位置
-    if (sys_lseek(file, phdr->p_offset, 0) < 0) {
-        log_printf("read file failed");
-        return -1;
-    }
-
     // 为段分配所有的内存空间.后续操作如果失败，将在上层释放
     // 简单起见，设置成可写模式，也许可考虑根据phdr->flags设置成只读
     // 因为没有找到该值的详细定义，所以没有加上
     uint32_t vaddr = phdr->p_vaddr;
+    uint32_t offset = phdr->p_offset;
     uint32_t size = phdr->p_filesz;
     while (size > 0) {
         int curr_size = (size > MEM_PAGE_SIZE) ? MEM_PAGE_SIZE : size;
 
         uint32_t paddr = memory_get_paddr(page_dir, vaddr);
 
-        // 注意，这里用的页表仍然是当前的
-        if (sys_read(file, (char *)paddr, curr_size) <  curr_size) {
+        // 注意，这里用的页表仍然是当前的。直接在段内的偏移处读，不必先定位
+        if (sys_pread(file, (char *)paddr, curr_size, offset) <  curr_size) {
             log_printf("read file failed");
             return -1;
         }
 
         size -= curr_size;
         vaddr += curr_size;
+        offset += curr_size;
     }
 
     // bss区考虑由crt0和cstart自行清0，这样更简单一些
@@ -685,13 +690,8 @@ static uint32_t load_elf_file (task_t * task, const char * name, uint32_t page_d
     // 然后从中加载程序头，将内容拷贝到相应的位置
     uint32_t e_phoff = elf_hdr.e_phoff;
     for (int i = 0; i < elf_hdr.e_phnum; i++, e_phoff += elf_hdr.e_phentsize) {
-        if (sys_lseek(file, e_phoff, 0) < 0) {
-            log_printf("read file failed");
-            goto load_failed;
-        }
-
         // 读取程序头后解析，这里不用读取到新进程的页表中，因为只是临时使用下
-        cnt = sys_read(file, (char *)&elf_phdr, sizeof(Elf32_Phdr));
+        cnt = sys_pread(file, (char *)&elf_phdr, sizeof(Elf32_Phdr), e_phoff);
         if (cnt < sizeof(Elf32_Phdr)) {
             log_printf("read file failed");
             goto load_failed;
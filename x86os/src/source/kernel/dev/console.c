@@ -4,10 +4,183 @@
 #include "comm/cpu_instr.h"
 #include "dev/tty.h"
 #include "cpu/irq.h"
+#include "tools/log.h"
 
 #define CONSOLE_NR          8           // 控制台的数量
 
 static console_t console_buf[CONSOLE_NR];
+static int curr_console = 0;            // 当前显示的控制台，只有它会写显存
+static int vram_top = 0;                // 屏幕首行在显存中的行号，即CRTC显示起始地址所在的行
+
+/**
+ * @brief 取屏幕上第row行在影子缓存中的起始位置
+ */
+static inline disp_char_t * row_buf (console_t * console, int row) {
+    int index = console->top + row;
+    if (index >= console->display_rows) {
+        index -= console->display_rows;
+    }
+    return console->shadow + index * console->display_cols;
+}
+
+/**
+ * @brief 标记从start到end的行需要刷新到显存
+ */
+static inline void mark_dirty (console_t * console, int start, int end) {
+    for (int row = start; row <= end; row++) {
+        console->dirty_rows |= 1 << row;
+    }
+}
+
+/**
+ * @brief 历史缓存中的位置回绕，缓存大小为2的幂
+ */
+static inline int hist_pos (int pos) {
+    return pos & (CONSOLE_HISTORY_SIZE - 1);
+}
+
+/**
+ * @brief 将一行编码后存入历史缓存，空间不足时丢弃最老的行
+ * 内存管理初始化之前无法分配缓存，此时移出的行不保存
+ */
+static void history_push (console_t * console, disp_char_t * row) {
+    if (console->history == 0) {
+        console->history = (uint8_t *)memory_alloc_pages(CONSOLE_HISTORY_PAGES);
+        if (console->history == 0) {
+            return;
+        }
+    }
+
+    // 去掉行尾的空白，背景为黑色的空格与未写过的位置看起来一样
+    int end = console->display_cols;
+    while ((end > 0) && (row[end - 1].c == ' ') && (row[end - 1].background == COLOR_Black)) {
+        end--;
+    }
+
+    // 属性相同的连续字符编为一段：属性、个数、各字符
+    uint8_t line[CONSOLE_COL_MAX * 3];
+    int len = 0;
+    for (int col = 0; col < end; ) {
+        uint8_t attr = row[col].v >> 8;
+        int start = col;
+        while ((col < end) && ((row[col].v >> 8) == attr)) {
+            col++;
+        }
+
+        line[len++] = attr;
+        line[len++] = col - start;
+        for (int i = start; i < col; i++) {
+            line[len++] = row[i].c;
+        }
+    }
+
+    // 在console_write中调用，已持有控制台的锁，键盘任务翻看历史时也先取得该锁
+    while ((console->hist_lines >= CONSOLE_HISTORY_LINES) || (console->hist_used + len + 2 > CONSOLE_HISTORY_SIZE)) {
+        int old_len = console->history[console->hist_head] + 2;
+        console->hist_head = hist_pos(console->hist_head + old_len);
+        console->hist_used -= old_len;
+        console->hist_lines--;
+    }
+
+    console->history[console->hist_tail] = len;
+    for (int i = 0; i < len; i++) {
+        console->history[hist_pos(console->hist_tail + 1 + i)] = line[i];
+    }
+    console->history[hist_pos(console->hist_tail + 1 + len)] = len;
+    console->hist_tail = hist_pos(console->hist_tail + len + 2);
+    console->hist_used += len + 2;
+    console->hist_lines++;
+
+    if (console->view_lines > console->hist_lines) {
+        console->view_lines = console->hist_lines;
+    }
+}
+
+/**
+ * @brief 解码历史缓存中pos处的一行到dest，返回下一行的位置
+ */
+static int history_decode (console_t * console, int pos, disp_char_t * dest) {
+    int len = console->history[pos];
+    int col = 0;
+
+    pos = hist_pos(pos + 1);
+    for (int i = 0; i < len; ) {
+        uint16_t attr = console->history[pos] << 8;
+        int cnt = console->history[hist_pos(pos + 1)];
+        pos = hist_pos(pos + 2);
+        for (int j = 0; j < cnt; j++) {
+            dest[col++].v = attr | console->history[pos];
+            pos = hist_pos(pos + 1);
+        }
+        i += cnt + 2;
+    }
+
+    // 行尾去掉的部分补上空白
+    disp_char_t blank;
+    blank.v = 0;
+    blank.c = ' ';
+    blank.foreground = COLOR_White;
+    blank.background = COLOR_Black;
+    while (col < console->display_cols) {
+        dest[col++].v = blank.v;
+    }
+
+    return hist_pos(pos + 1);
+}
+
+/**
+ * @brief 设置CRTC的显示起始地址，以字符为单位
+ */
+static void set_display_start (uint16_t pos) {
+	outb(0x3D4, 0xC);		// 向端口0x3D4写入0xC，表示下一步在往0x3D5端口写数据时写的是高8位位置数据，即16位地址的高8位
+	outb(0x3D5, (uint8_t) ((pos >> 8) & 0xFF));  // 向0x3D5端口写数据一次只能写一个字节，由于pos是16位地址，故需要写两次
+	outb(0x3D4, 0xD);		// 向端口0x3D4写入0xD，表示下一步在往0x3D5端口写数据时写的是16位地址的低8位
+	outb(0x3D5, (uint8_t) (pos & 0xFF));
+}
+
+/**
+ * @brief 将有变化的行从影子缓存刷新到显存
+ * 只有当前显示的控制台才写显存，其它控制台的变化一直记录着，切换过来时再重绘。
+ * 上滚通过将显示起始地址下移完成，显存中已有的行不用复制；显存用完时才回到开头重绘整屏。
+ * 刷新过程中可能被键盘任务切换控制台，切换涉及两个控制台，各自的锁不够，所以关中断进行
+ */
+static void flush_display (console_t * console) {
+    irq_state_t state = irq_enter_protection();
+    if (console - console_buf != curr_console) {
+        irq_leave_protection(state);
+        return;
+    }
+
+    int scroll = console->scroll_lines;
+    console->scroll_lines = 0;
+    if (scroll) {
+        vram_top += scroll;
+        if (vram_top + console->display_rows > CONSOLE_VRAM_ROWS) {
+            vram_top = 0;
+            mark_dirty(console, 0, console->display_rows - 1);
+        }
+    }
+
+    // 正在翻看历史时有新的输出，回到当前屏幕
+    if (console->view_lines) {
+        console->view_lines = 0;
+        mark_dirty(console, 0, console->display_rows - 1);
+    }
+
+    for (int row = 0; row < console->display_rows; row++) {
+        if (console->dirty_rows & (1 << row)) {
+            kernel_memcpy(console->disp_base + (vram_top + row) * console->display_cols,
+                    row_buf(console, row), console->display_cols * sizeof(disp_char_t));
+        }
+    }
+    console->dirty_rows = 0;
+
+    // 内容写好后再移动显示位置
+    if (scroll) {
+        set_display_start(vram_top * console->display_cols);
+    }
+    irq_leave_protection(state);
+}
 
 /**
  * @brief 读取当前光标的位置
@@ -28,10 +201,14 @@ static int read_cursor_pos (void) {
  * @brief 更新鼠标的位置
  */
 static void update_cursor_pos (console_t * console) {
-	uint16_t pos = (console - console_buf) * (console->display_cols * console->display_rows);
-    pos += console->cursor_row * console->display_cols + console->cursor_col;
-
+    // 隐藏的控制台不能移动光标，切换过来时再更新
     irq_state_t state = irq_enter_protection();
+	uint16_t pos = (vram_top + console->cursor_row) * console->display_cols + console->cursor_col;
+    if (console - console_buf != curr_console) {
+        irq_leave_protection(state);
+        return;
+    }
+
 	outb(0x3D4, 0x0F);		// 写低地址
 	outb(0x3D5, (uint8_t) (pos & 0xFF));
 	outb(0x3D4, 0x0E);		// 写高地址
@@ -56,53 +233,122 @@ void console_set_cursor(int idx, int visiable) {
 }
 
 
-void console_select(int idx) {
+int console_select(int idx) {
     console_t * console = console_buf + idx;
     if (console->disp_base == 0) {   // 判断待切换的console是否完成初始化，即是否打开
         // 可能没有初始化，先初始化一下
-        console_init(idx);
+        if (console_init(idx) < 0) {
+            return -1;
+        }
     }
 
-    // 计算console显存的起始位置
-	uint16_t pos = idx * console->display_cols * console->display_rows;
-
-	outb(0x3D4, 0xC);		// 向端口0x3D4写入0xC，表示下一步在往0x3D5端口写数据时写的是高8位位置数据，即16位地址的高8位
-	outb(0x3D5, (uint8_t) ((pos >> 8) & 0xFF));  // 向0x3D5端口写数据一次只能写一个字节，由于pos是16位地址，故需要写两次
-	outb(0x3D4, 0xD);		// 向端口0x3D4写入0xD，表示下一步在往0x3D5端口写数据时写的是16位地址的低8位
-	outb(0x3D5, (uint8_t) (pos & 0xFF));
+    // 显存中是之前控制台的内容，从显存开头重绘整屏
+    irq_state_t state = irq_enter_protection();
+    curr_console = idx;
+    vram_top = 0;
+    console->scroll_lines = 0;
+    console->view_lines = 0;
+    mark_dirty(console, 0, console->display_rows - 1);
+    flush_display(console);
+    set_display_start(0);
+    irq_leave_protection(state);
 
     // 每个屏幕光标位置不一样，更新光标到当前屏幕的光标位置
     update_cursor_pos(console);
+    return 0;
 }
 
 
 
 
 /**
- * @brief 擦除从start到end的行
+ * @brief 显示往上翻看view_lines行后的屏幕：前面的行来自历史，其余的为影子缓存的前几行
  */
-static void erase_rows (console_t * console, int start, int end) {
-    volatile disp_char_t * disp_start = console->disp_base + console->display_cols * start;
-    volatile disp_char_t * disp_end = console->disp_base + console->display_cols * (end + 1);
+static void show_history (console_t * console) {
+    // 从最新的一行往回找到屏幕首行
+    int pos = console->hist_tail;
+    for (int i = 0; i < console->view_lines; i++) {
+        pos = hist_pos(pos - console->history[hist_pos(pos - 1)] - 2);
+    }
 
-    while (disp_start < disp_end) {
-        disp_start->c = ' ';
-        disp_start->foreground = console->foreground;
-        disp_start->background = console->background;
+    for (int row = 0; row < console->display_rows; row++) {
+        disp_char_t * dest = console->disp_base + (vram_top + row) * console->display_cols;
+        if (row < console->view_lines) {
+            pos = history_decode(console, pos, dest);
+        } else {
+            kernel_memcpy(dest, row_buf(console, row - console->view_lines), console->display_cols * sizeof(disp_char_t));
+        }
+    }
+}
+
+/**
+ * @brief 当前控制台的回滚历史上翻或下翻一页，由键盘任务调用
+ * 持有控制台的锁，与该控制台的输出及历史的写入互斥。切换控制台也由键盘任务完成，翻看期间不会发生
+ */
+void console_page_history (int idx, int up) {
+    console_t * console = console_buf + idx;
 
-        disp_start++;
+    mutex_lock(&console->mutex);
+    if ((idx != curr_console) || (console->history == 0)) {
+        goto page_end;
+    }
+
+    int view = console->view_lines + (up ? 1 : -1) * (console->display_rows - 1);
+    if (view < 0) {
+        view = 0;
+    } else if (view > console->hist_lines) {
+        view = console->hist_lines;
+    }
+    if (view == console->view_lines) {
+        goto page_end;
+    }
+
+    // 先刷新待处理的上滚和变化，正在翻看时会回到当前屏幕，再在显存的当前位置画出历史
+    flush_display(console);
+    console->view_lines = view;
+    if (view) {
+        show_history(console);
+    }
+page_end:
+    mutex_unlock(&console->mutex);
+}
+
+/**
+ * @brief 擦除从start到end的行
+ */
+static void erase_rows (console_t * console, int start, int end) {
+    disp_char_t blank;
+    blank.v = 0;
+    blank.c = ' ';
+    blank.foreground = console->foreground;
+    blank.background = console->background;
+
+    for (int row = start; row <= end; row++) {
+        disp_char_t * p = row_buf(console, row);
+        for (int col = 0; col < console->display_cols; col++) {
+            p[col].v = blank.v;
+        }
     }
+    mark_dirty(console, start, end);
 }
 
 /**
  * 整体屏幕上移若干行
+ * 只移动环形缓存的首行，原来的首行变成末行再擦除，不复制数据。
+ * 显存中的内容随显示起始地址一起上移，待刷新的行号也随之上移。
+ * 这几项要一起修改，以免键盘任务切换控制台时看到不一致的状态
  */
 static void scroll_up(console_t * console, int lines) {
-    // 整体上移
-    disp_char_t * dest = console->disp_base;
-    disp_char_t * src = console->disp_base + console->display_cols * lines;
-    uint32_t size = (console->display_rows - lines) * console->display_cols * sizeof(disp_char_t);
-    kernel_memcpy(dest, src, size);
+    // 移出屏幕的行存入历史
+    for (int row = 0; row < lines; row++) {
+        history_push(console, row_buf(console, row));
+    }
+
+    irq_state_t state = irq_enter_protection();
+    console->top = (console->top + lines) % console->display_rows;
+    console->dirty_rows >>= lines;
+    console->scroll_lines += lines;
+    irq_leave_protection(state);
 
     // 擦除最后一行
     erase_rows(console, console->display_rows - lines, console->display_rows - 1);
@@ -147,12 +393,11 @@ static void move_forward (console_t * console, int n) {
  */
 static void show_char(console_t * console, char c) {
     // 每显示一个字符，都进行计算，效率有点低。不过这样直观简单
-    int offset = console->cursor_col + console->cursor_row * console->display_cols;
-
-    disp_char_t * p = console->disp_base + offset;
+    disp_char_t * p = row_buf(console, console->cursor_row) + console->cursor_col;
     p->c = c;
     p->foreground = console->foreground;
     p->background = console->background;
+    console->dirty_rows |= 1 << console->cursor_row;
     move_forward(console, 1);
 }
 
@@ -180,15 +425,7 @@ static int move_backword (console_t * console, int n) {
 }
 
 static void clear_display (console_t * console) {
-    int size = console->display_cols * console->display_rows;
-
-    disp_char_t * start = console->disp_base;
-    for (int i = 0; i < size; i++, start++) {
-        // 为便于理解，以下分开三步写一个字符，速度慢一些
-        start->c = ' ';
-        start->background = console->background;
-        start->foreground = console->foreground;
-    }
+    erase_rows(console, 0, console->display_rows - 1);
 }
 
 /**
@@ -228,16 +465,37 @@ void restore_cursor(console_t * console) {
 int console_init (int idx) {
     console_t *console = console_buf + idx;
 
+    // 重复打开时沿用已分配的影子缓存
+    if (console->shadow == 0) {
+        console->shadow = (disp_char_t *)memory_alloc_pages(CONSOLE_SHADOW_PAGES);
+        if (console->shadow == 0) {
+            log_printf("console %d: alloc shadow buffer failed.", idx);
+            return -1;
+        }
+    }
+
     console->display_cols = CONSOLE_COL_MAX;
     console->display_rows = CONSOLE_ROW_MAX;
-    console->disp_base = (disp_char_t *) CONSOLE_DISP_ADDR + idx * console->display_cols * console->display_rows;
+    console->disp_base = (disp_char_t *) CONSOLE_DISP_ADDR;
 
     console->foreground = COLOR_White;
     console->background = COLOR_Black;
+    console->top = 0;
+    console->dirty_rows = 0;
+    console->scroll_lines = 0;
+    console->view_lines = 0;
     if (idx == 0) {
-        int cursor_pos = read_cursor_pos();
+        // 保留启动过程中已显示的内容。光标位置相对于显存开头，屏幕首行位于显存的第vram_top行
+        int cursor_pos = read_cursor_pos() - vram_top * console->display_cols;
+        if (cursor_pos < 0) {
+            cursor_pos = 0;
+        }
         console->cursor_row = cursor_pos / console->display_cols;
         console->cursor_col = cursor_pos % console->display_cols;
+        if (console->cursor_row >= console->display_rows) {
+            console->cursor_row = console->display_rows - 1;
+        }
+        kernel_memcpy(console->shadow, console->disp_base + vram_top * console->display_cols, console->display_rows * console->display_cols * sizeof(disp_char_t));
     } else {
         console->cursor_row = 0;
         console->cursor_col = 0;
@@ -385,15 +643,17 @@ static void move_right (console_t * console, int n) {
 }
 
 /**
- * 移动光标
+ * 移动光标，限制在屏幕范围之内，以免写到影子缓存之外
  */
 static void move_cursor(console_t * console) {
 	if (console->curr_param_index >= 1) {
-		console->cursor_row = console->esc_param[0];
+		int row = console->esc_param[0];
+		console->cursor_row = (row < console->display_rows) ? row : console->display_rows - 1;
 	}
 
 	if (console->curr_param_index >= 2) {
-		console->cursor_col = console->esc_param[1];
+		int col = console->esc_param[1];
+		console->cursor_col = (col < console->display_cols) ? col : console->display_cols - 1;
 	}
 }
 
@@ -464,31 +724,34 @@ int console_write (tty_t * tty) {
 
     int len = 0;
     do {
-        char c;
-
-        // 取字节数据
-        int err = tty_fifo_get(&tty->ofifo, &c);
-        if (err < 0) {
+        // 成块取出数据
+        char buf[TTY_WRITE_CHUNK];
+        int cnt = tty_fifo_get_n(&tty->ofifo, buf, sizeof(buf));
+        if (cnt <= 0) {
             break;
         }
-        sem_notify(&tty->osem);
 
-        // 显示出来
-        switch (console->write_state) {
-            case CONSOLE_WRITE_NORMAL: {
-                write_normal(console, c);
-                break;
+        // 逐个显示出来
+        for (int i = 0; i < cnt; i++) {
+            char c = buf[i];
+            switch (console->write_state) {
+                case CONSOLE_WRITE_NORMAL: {
+                    write_normal(console, c);
+                    break;
+                }
+                case CONSOLE_WRITE_ESC:
+                    write_esc(console, c);
+                    break;
+                case CONSOLE_WRITE_SQUARE:
+                    write_esc_square(console, c);
+                    break;
             }
-            case CONSOLE_WRITE_ESC:
-                write_esc(console, c);
-                break;
-            case CONSOLE_WRITE_SQUARE:
-                write_esc_square(console, c);
-                break;
         }
-        len++;
+        len += cnt;
     }while (1);
 
+    // 整批写完后一次性刷新到显存
+    flush_display(console);
     mutex_unlock(&console->mutex);
 
     update_cursor_pos(console);
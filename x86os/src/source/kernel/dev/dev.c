@@ -3,16 +3,21 @@
 #include "dev/tty.h"
 #include "tools/klib.h"
 #include "dev/disk.h"
+#include "core/task.h"
+#include "os_cfg.h"
+#include "fs/file.h"
 
 #define DEV_TABLE_SIZE          128     // 支持的设备数量
 
 extern dev_desc_t dev_tty_desc;
 extern dev_desc_t dev_disk_desc;
+extern dev_desc_t dev_serial_desc;
 
 // 设备描述表，即设备管理注册表
 static dev_desc_t * dev_desc_tbl[] = {
     &dev_tty_desc,
     &dev_disk_desc,
+    &dev_serial_desc,
 };
 
 
@@ -20,6 +25,9 @@ static dev_desc_t * dev_desc_tbl[] = {
 // 设备表: 数组下标即是设备id
 static device_t dev_tbl[DEV_TABLE_SIZE];
 
+// poll的等待队列：任意设备有事件时唤醒所有等待者，由它们各自重新检查
+static list_t poll_wait_list;
+
 
 
 static int is_devid_bad (int dev_id) {
@@ -133,4 +141,64 @@ void dev_close (int dev_id) {
         kernel_memset(dev, 0, sizeof(device_t));
     }
     irq_leave_protection(state);
-}
\ No newline at end of file
+}
+/**
+ * @brief 检查设备上已就绪的事件
+ */
+int dev_poll (int dev_id, int events) {
+    if (is_devid_bad(dev_id)) {
+        return POLLNVAL;
+    }
+
+    device_t * dev = dev_tbl + dev_id;
+    if (dev->desc->poll == 0) {
+        return events & (POLLIN | POLLOUT);
+    }
+    return dev->desc->poll(dev, events);
+}
+
+/**
+ * @brief 设备有新的事件，唤醒所有poll等待者
+ * 可在中断中调用
+ */
+void dev_poll_wakeup (void) {
+    irq_state_t state = irq_enter_protection();
+
+    list_node_t * node;
+    while ((node = list_remove_first(&poll_wait_list)) != (list_node_t *)0) {
+        task_t * task = list_node_parent(node, task_t, wait_node);
+        if (task->wait_list) {
+            // 限时等待的任务还在睡眠队列中
+            task->wait_list = (list_t *)0;
+            task_set_wakeup(task);
+        }
+        task_set_ready(task);
+    }
+
+    irq_leave_protection(state);
+}
+
+/**
+ * @brief 等待任意设备的事件，ms<0时一直等待，超时返回-1
+ * 调用者应在中断保护下检查事件并调用，以免检查之后、等待之前的事件丢失
+ */
+int dev_poll_wait (int ms) {
+    if (ms == 0) {
+        return -1;
+    }
+
+    irq_state_t state = irq_enter_protection();
+
+    task_t * curr = task_current();
+    task_set_block(curr);
+    list_insert_last(&poll_wait_list, &curr->wait_node);
+    if (ms >= 0) {
+        curr->wait_list = &poll_wait_list;
+        task_set_sleep(curr, (ms + (OS_TICK_MS - 1)) / OS_TICK_MS);
+    }
+    task_dispatch();
+
+    int err = ((ms >= 0) && (curr->sleep_ticks == 0)) ? -1 : 0;
+    irq_leave_protection(state);
+    return err;
+}
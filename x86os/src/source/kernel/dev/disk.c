@@ -175,7 +175,7 @@ static int detect_part_info(disk_t * disk) {
             part_info->disk = (disk_t *)0;
         } else {
             // 在主分区中找到，复制信息
-            kernel_sprintf(part_info->name, "%s%d", disk->name, i + 1);
+            kernel_snprintf(part_info->name, sizeof(part_info->name), "%s%d", disk->name, i + 1);
             part_info->start_sector = item->relative_sectors;
             part_info->total_sector = item->total_sectors;
             part_info->disk = disk;
@@ -213,7 +213,7 @@ static int identify_disk (disk_t * disk) {
     // 分区0保存了整个磁盘的信息
     partinfo_t * part = disk->partinfo + 0;
     part->disk = disk;
-    kernel_sprintf(part->name, "%s%d", disk->name, 0);  // sda0
+    kernel_snprintf(part->name, sizeof(part->name), "%s%d", disk->name, 0);  // sda0
     part->start_sector = 0;
     part->total_sector = disk->sector_count;
     part->type = FS_INVALID;
@@ -245,7 +245,7 @@ void disk_init (void) {
         disk_t * disk = disk_buf + i;
 
         // 先初始化各字段
-        kernel_sprintf(disk->name, "sd%c", i + 'a');  // sda, sdb, sdc, ...
+        kernel_snprintf(disk->name, sizeof(disk->name), "sd%c", i + 'a');  // sda, sdb, sdc, ...
         // i = 0 为primary master drive, i != 0 为primary slave drive
         disk->drive = (i == 0) ? DISK_DISK_MASTER : DISK_DISK_SLAVE;  
         disk->port_base = IOBASE_PRIMARY;  // primary bus 上的主从设备基地址一致 0x1F0
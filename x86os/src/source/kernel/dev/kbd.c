@@ -5,8 +5,13 @@
 #include "tools/log.h"
 #include "tools/klib.h"
 #include "dev/tty.h"
+#include "ipc/sem.h"
+#include "core/task.h"
 
 static kbd_state_t kbd_state;	// 键盘状态
+static kbd_ring_t kbd_ring;     // 待处理的扫描码
+static sem_t kbd_sem;           // 缓存由空变为非空时通知键盘任务
+static task_t kbd_task;         // 扫描码处理任务
 
 /**
  * 键盘映射表，分3类
@@ -118,6 +123,7 @@ uint8_t kbd_read(void) {
 
 /**
  * 更新键盘上状态指示灯
+ * 键盘的应答由中断读走后放入缓存，解码时忽略，这里不再等待
  */
 static void update_led_status (void) {
     int data = 0;
@@ -125,7 +131,6 @@ static void update_led_status (void) {
     data = (kbd_state.caps_lock ? 1 : 0) << 0;
     kbd_write(KBD_PORT_DATA, KBD_CMD_RW_LED);
     kbd_write(KBD_PORT_DATA, data);
-    kbd_read();
 }
 
 static void do_fx_key (int key) {
@@ -135,6 +140,15 @@ static void do_fx_key (int key) {
     }
 }
 
+/**
+ * @brief Shift+PgUp/PgDn翻看当前控制台的回滚历史
+ */
+static void do_page_key (int key, int is_make) {
+    if (is_make && (kbd_state.lshift_press || kbd_state.rshift_press)) {
+        tty_page_history(key == KEY_PAGE_UP);
+    }
+}
+
 /**
  * 处理单字符的标准键
  */
@@ -174,6 +188,10 @@ static void do_normal_key (uint8_t raw_code) {
     case KEY_F8:
         do_fx_key(key);   // TTY设备的切换
         break;
+    case KEY_PAGE_UP:       // qemu下可能收不到E0，小键盘上的翻页键也同样处理
+    case KEY_PAGE_DOWN:
+        do_page_key(key, is_make);
+        break;
     case KEY_F9:
     case KEY_F10:
     case KEY_F11:
@@ -223,37 +241,30 @@ static void do_e0_key (uint8_t raw_code) {
         case KEY_ALT:
             kbd_state.ralt_press = is_make;  // 仅设置标志位
             break;
+        case KEY_PAGE_UP:
+        case KEY_PAGE_DOWN:
+            do_page_key(key, is_make);
+            break;
     }
 }
 
 /**
- * @brief 按键中断处理程序
+ * @brief 解码一个扫描码，在键盘任务中运行
  */
-void do_handler_kbd(exception_frame_t *frame) {
+static void do_scan_code (uint8_t raw_code) {
     static enum {
     	NORMAL,				// 普通，无e0或e1
 		BEGIN_E0,			// 收到e0字符
 		BEGIN_E1,			// 收到e1字符
     }recv_state = NORMAL;
 
-	// 检查是否有数据，无数据则退出
-	uint8_t status = inb(KBD_PORT_STAT);
-	if (!(status & KBD_STAT_RECV_READY)) {
-        pic_send_eoi(IRQ1_KEYBOARD);
-		return;
-	}
-
-	// 读取键值
-    uint8_t raw_code = inb(KBD_PORT_DATA);
-
-	// 读取完成之后，就可以发EOI，方便后续继续响应键盘中断
-	// 否则,键值的处理过程可能略长，将导致中断响应延迟
-    pic_send_eoi(IRQ1_KEYBOARD);
-
     // 实测qemu下收不到E0和E1，估计是没有发出去
     // 方向键、HOME/END等键码和小键盘上发出来的完全一样。不清楚原因
     // 也许是键盘布局的问题？所以，这里就忽略小键盘？
-	if (raw_code == KEY_E0) {
+	if ((raw_code == KBD_REPLY_ACK) || (raw_code == KBD_REPLY_RESEND)) {
+		// 设置指示灯时键盘的应答，不是按键
+		return;
+	} else if (raw_code == KEY_E0) {
 		// E0字符
 		recv_state = BEGIN_E0;
 	} else if (raw_code == KEY_E1) {
@@ -275,6 +286,59 @@ void do_handler_kbd(exception_frame_t *frame) {
 	}
 }
 
+/**
+ * @brief 键盘任务：取出中断收到的扫描码，解码后送往当前tty
+ */
+static void kbd_task_entry (void) {
+    uint32_t dropped = 0;
+
+    for (;;) {
+        sem_wait(&kbd_sem);
+
+        // 处理期间中断可能继续放入，一直取到缓存为空
+        while (kbd_ring.read != kbd_ring.write) {
+            uint8_t raw_code = kbd_ring.buf[kbd_ring.read & (KBD_RING_SIZE - 1)];
+            kbd_ring.read++;
+            do_scan_code(raw_code);
+        }
+
+        if (kbd_ring.dropped != dropped) {
+            log_level_printf(LOG_WARN, "kbd: %d scan codes dropped", kbd_ring.dropped - dropped);
+            dropped = kbd_ring.dropped;
+        }
+    }
+}
+
+/**
+ * @brief 按键中断处理程序，只读出扫描码放入缓存，其余工作由键盘任务完成
+ */
+void do_handler_kbd(exception_frame_t *frame) {
+	// 检查是否有数据，无数据则退出
+	uint8_t status = inb(KBD_PORT_STAT);
+	if (!(status & KBD_STAT_RECV_READY)) {
+        pic_send_eoi(IRQ1_KEYBOARD);
+		return;
+	}
+
+	// 读取键值后即可发EOI，方便后续继续响应键盘中断
+    uint8_t raw_code = inb(KBD_PORT_DATA);
+    pic_send_eoi(IRQ1_KEYBOARD);
+
+    // 缓存满时丢弃。先写数据再移动写指针，键盘任务看到写指针变化时数据已就绪
+    uint32_t write = kbd_ring.write;
+    if (write - kbd_ring.read >= KBD_RING_SIZE) {
+        kbd_ring.dropped++;
+        return;
+    }
+    kbd_ring.buf[write & (KBD_RING_SIZE - 1)] = raw_code;
+    kbd_ring.write = write + 1;
+
+    // 只在由空变为非空时通知，键盘任务会一直处理到缓存为空
+    if (write == kbd_ring.read) {
+        sem_notify(&kbd_sem);
+    }
+}
+
 /**
  * 键盘硬件初始化
  */
@@ -282,6 +346,7 @@ void kbd_init(void) {
     static int inited = 0;
 
     if (!inited) {
+        sem_init(&kbd_sem, 0);
         update_led_status();
 
         irq_install(IRQ1_KEYBOARD, (irq_handler_t)exception_handler_kbd);
@@ -290,3 +355,13 @@ void kbd_init(void) {
         inited = 1;
     }
 }
+
+/**
+ * @brief 创建键盘任务，需在任务管理器初始化后调用
+ * 此前收到的扫描码保留在缓存中，任务运行后再处理
+ */
+void kbd_task_init (void) {
+    int err = task_init(&kbd_task, "kbd", TASK_FLAG_SYSTEM, (uint32_t)kbd_task_entry, 0);
+    ASSERT(err == 0);
+    task_start(&kbd_task);
+}
@@ -0,0 +1,201 @@
+
+// 16550串口tty：收发均由中断驱动，行规程由tty完成
+
+#include "dev/serial.h"
+#include "dev/dev.h"
+#include "dev/tty.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include "comm/cpu_instr.h"
+#include "cpu/irq.h"
+#include "cpu/cpu.h"
+
+static serial_t serial_ports[SERIAL_NR];
+static const uint16_t serial_port_addr[SERIAL_NR] = {SERIAL_COM1_PORT};
+
+
+
+// static int  serial_probe   (uint16_t port);
+// static void serial_tx_fill (serial_t * serial);
+// static int  serial_output  (tty_t * tty);
+
+int  serial_open  (device_t * dev);
+void serial_close (device_t * dev);
+
+// 读写等与控制台tty相同，由tty实现
+int  tty_read    (device_t * dev, int addr, char * buf, int size);
+int  tty_write   (device_t * dev, int addr, char * buf, int size);
+int  tty_control (device_t * dev, int cmd, int arg0, int arg1);
+int  tty_poll    (device_t * dev, int events);
+
+
+
+// 设备描述表: 描述一个设备所具备的特性
+dev_desc_t dev_serial_desc = {
+	.name    = "ttyS",
+	.major   = DEV_SERIAL,
+	.open    = serial_open,
+	.read    = tty_read,
+	.write   = tty_write,
+	.control = tty_control,
+	.close   = serial_close,
+	.poll    = tty_poll,
+};
+
+
+
+/**
+ * @brief 检测串口是否存在，存在时完成初始化
+ * 在回环模式下发送一个字节，能收回来说明串口存在
+ */
+static int serial_probe (uint16_t port) {
+	outb(port + SERIAL_REG_IER, 0x00);					// 先关闭所有中断
+	outb(port + SERIAL_REG_LCR, SERIAL_LCR_DLAB);		// 设置波特率除数
+	outb(port + SERIAL_REG_DATA, (SERIAL_CLOCK / SERIAL_BAUD) & 0xFF);
+	outb(port + SERIAL_REG_IER, (SERIAL_CLOCK / SERIAL_BAUD) >> 8);
+	outb(port + SERIAL_REG_LCR, SERIAL_LCR_8N1);
+	outb(port + SERIAL_REG_FCR, SERIAL_FCR_ENABLE);
+
+	outb(port + SERIAL_REG_MCR, SERIAL_MCR_LOOPBACK);
+	outb(port + SERIAL_REG_DATA, 0xAE);
+	if (inb(port + SERIAL_REG_DATA) != 0xAE) {
+		return -1;
+	}
+
+	// 恢复正常模式，开启收发中断
+	outb(port + SERIAL_REG_MCR, SERIAL_MCR_NORMAL);
+	outb(port + SERIAL_REG_IER, SERIAL_IER_RX | SERIAL_IER_TX);
+	return 0;
+}
+
+/**
+ * @brief 发送FIFO已空时，从发送缓存中取出一批写入FIFO
+ * 需在中断保护下调用
+ */
+static void serial_tx_fill (serial_t * serial) {
+	if (!(inb(serial->port + SERIAL_REG_LSR) & SERIAL_LSR_THRE)) {
+		return;
+	}
+
+	char buf[SERIAL_FIFO_SIZE];
+	int cnt = tty_fifo_get_n(&serial->tty.ofifo, buf, sizeof(buf));
+	for (int i = 0; i < cnt; i++) {
+		outb(serial->port + SERIAL_REG_DATA, buf[i]);
+	}
+
+	// 写入了数据，FIFO发送完后会再次产生中断；否则停下来，等有数据时再启动
+	serial->tx_busy = cnt > 0;
+
+	// 腾出了空间，唤醒等待的写者
+	if (cnt && serial->tx_wait) {
+		serial->tx_wait = 0;
+		sem_notify(&serial->tx_sem);
+	}
+}
+
+/**
+ * @brief tty的输出回调：启动发送，发送缓存满时等待发送中断腾出空间
+ * 开中断之前（启动早期）无法等待，此时直接查询发送
+ */
+static int serial_output (tty_t * tty) {
+	serial_t * serial = (serial_t *)tty;
+
+	irq_state_t state = irq_enter_protection();
+	if (!serial->tx_busy) {
+		serial_tx_fill(serial);
+	}
+
+	while (tty->ofifo.count >= tty->ofifo.size) {
+		if (state & EFLAGS_IF) {
+			serial->tx_wait = 1;
+			sem_wait(&serial->tx_sem);
+		} else {
+			serial_tx_fill(serial);
+		}
+	}
+	irq_leave_protection(state);
+	return 0;
+}
+
+/**
+ * @brief 打开串口，第一次打开时检测并初始化
+ */
+int serial_open (device_t * dev) {
+	int idx = dev->minor;
+	if ((idx < 0) || (idx >= SERIAL_NR)) {
+		log_printf("open serial failed. incorrect serial num = %d", idx);
+		return -1;
+	}
+
+	serial_t * serial = serial_ports + idx;
+	if (!serial->inited) {
+		serial->port = serial_port_addr[idx];
+		if (serial_probe(serial->port) < 0) {
+			return -1;
+		}
+
+		if (serial->obuf == (char *)0) {
+			serial->obuf = (char *)memory_alloc_pages(SERIAL_OBUF_PAGES);
+			if (serial->obuf == (char *)0) {
+				log_printf("serial %d: alloc output buffer failed.", idx);
+				return -1;
+			}
+		}
+
+		tty_setup(&serial->tty);
+		tty_fifo_init(&serial->tty.ofifo, serial->obuf, SERIAL_OBUF_SIZE);
+		serial->tty.output = serial_output;
+		serial->tx_busy = serial->tx_wait = 0;
+		sem_init(&serial->tx_sem, 0);
+		serial->inited = 1;
+
+		irq_install(IRQ4_COM1, (irq_handler_t)exception_handler_serial);
+		irq_enable(IRQ4_COM1);
+	}
+
+	dev->data = &serial->tty;
+	return 0;
+}
+
+/**
+ * @brief 关闭串口，保持硬件的设置，以便再次打开
+ */
+void serial_close (device_t * dev) {
+}
+
+/**
+ * @brief 串口中断处理，一次处理完所有待处理的中断
+ */
+void do_handler_serial (exception_frame_t * frame) {
+	// 先发EOI，收到数据时会唤醒读者，可能切换任务
+	pic_send_eoi(IRQ4_COM1);
+
+	for (int i = 0; i < SERIAL_NR; i++) {
+		serial_t * serial = serial_ports + i;
+		if (!serial->inited) {
+			continue;
+		}
+
+		uint8_t iir;
+		while (!((iir = inb(serial->port + SERIAL_REG_IIR)) & SERIAL_IIR_NONE)) {
+			switch (iir & SERIAL_IIR_MASK) {
+			case SERIAL_IIR_RX:
+			case SERIAL_IIR_TIMEOUT:
+				// 取空接收FIFO
+				while (inb(serial->port + SERIAL_REG_LSR) & SERIAL_LSR_DR) {
+					tty_receive(&serial->tty, inb(serial->port + SERIAL_REG_DATA));
+				}
+				break;
+			case SERIAL_IIR_TX:
+				serial_tx_fill(serial);
+				break;
+			case SERIAL_IIR_LINE:
+				inb(serial->port + SERIAL_REG_LSR);
+				break;
+			default:
+				inb(serial->port + SERIAL_REG_MSR);
+				break;
+			}
+		}
+	}
+}
@@ -37,6 +37,13 @@ static void init_pit (void) {
     irq_enable(IRQ0_TIMER);
 }
 
+/**
+ * 获取系统启动后的tick数量
+ */
+uint32_t time_get_tick (void) {
+    return sys_tick;
+}
+
 /**
  * 定时器初始化
  */
@@ -1,12 +1,14 @@
 
-// 目前只考虑处理cooked模式的处理
+// 行规程：规范模式下按行编辑、整行返回，非规范模式按VMIN/VTIME返回
 
 #include "dev/tty.h"
 #include "dev/console.h"
 #include "dev/kbd.h"
 #include "dev/dev.h"
 #include "tools/log.h"
+#include "tools/klib.h"
 #include "cpu/irq.h"
+#include "fs/file.h"
 
 static tty_t tty_devs[TTY_NR];
 
@@ -18,19 +20,29 @@ static int curr_tty = 0;
 void tty_fifo_init (tty_fifo_t * fifo, char * buf, int size);
 int  tty_fifo_get  (tty_fifo_t * fifo, char * c);
 int  tty_fifo_put  (tty_fifo_t * fifo, char c);
+int  tty_fifo_get_n (tty_fifo_t * fifo, char * buf, int size);
+int  tty_fifo_put_n (tty_fifo_t * fifo, const char * buf, int size);
 
 // static inline tty_t * get_tty (device_t * dev);
+// static int  tty_output (tty_t * tty, const char * buf, int size);
+// static int  tty_get_char (tty_t * tty, int ms, char * ch);
+// static int  read_canon (tty_t * tty, char * buf, int size);
+// static int  read_raw (tty_t * tty, char * buf, int size);
 
 int  tty_open    (device_t * dev);
 int  tty_read    (device_t * dev, int addr, char * buf, int size);
 int  tty_write   (device_t * dev, int addr, char * buf, int size);
 int  tty_control (device_t * dev, int cmd, int arg0, int arg1);
 void tty_close   (device_t * dev);
+int  tty_poll    (device_t * dev, int events);
 
 
 
 void tty_in     (char ch);
+void tty_receive (tty_t * tty, char ch);
+void tty_setup  (tty_t * tty);
 void tty_select (int tty);
+void tty_page_history (int up);
 
 
 
@@ -44,6 +56,7 @@ dev_desc_t dev_tty_desc = {
 	.write   = tty_write,
 	.control = tty_control,
 	.close   = tty_close,
+	.poll    = tty_poll,
 };
 
 
@@ -95,17 +108,99 @@ int tty_fifo_put (tty_fifo_t * fifo, char c) {
 	return 0;
 }
 
+/**
+ * @brief 取出最多size字节数据，返回实际取出的数量
+ * 环形缓存中的数据最多分两段复制，整个过程只进出一次中断保护
+ */
+int tty_fifo_get_n (tty_fifo_t * fifo, char * buf, int size) {
+	irq_state_t state = irq_enter_protection();
+
+	int cnt = (size < fifo->count) ? size : fifo->count;
+	for (int left = cnt; left > 0; ) {
+		int seg = fifo->size - fifo->read;
+		if (seg > left) {
+			seg = left;
+		}
+
+		kernel_memcpy(buf, fifo->buf + fifo->read, seg);
+		buf += seg;
+		left -= seg;
+		fifo->read += seg;
+		if (fifo->read >= fifo->size) {
+			fifo->read = 0;
+		}
+	}
+	fifo->count -= cnt;
+
+	irq_leave_protection(state);
+	return cnt;
+}
+
+/**
+ * @brief 写入最多size字节数据，返回实际写入的数量，空间不足时只写入一部分
+ */
+int tty_fifo_put_n (tty_fifo_t * fifo, const char * buf, int size) {
+	irq_state_t state = irq_enter_protection();
+
+	int free = fifo->size - fifo->count;
+	int cnt = (size < free) ? size : free;
+	for (int left = cnt; left > 0; ) {
+		int seg = fifo->size - fifo->write;
+		if (seg > left) {
+			seg = left;
+		}
+
+		kernel_memcpy(fifo->buf + fifo->write, (void *)buf, seg);
+		buf += seg;
+		left -= seg;
+		fifo->write += seg;
+		if (fifo->write >= fifo->size) {
+			fifo->write = 0;
+		}
+	}
+	fifo->count += cnt;
+
+	irq_leave_protection(state);
+	return cnt;
+}
+
 /**
  * @brief 判断tty是否有效
+ * 打开时将tty结构记录在设备的data中，控制台和串口等不同的tty设备共用以下读写接口
  */
 static inline tty_t * get_tty (device_t * dev) {
-	int tty = dev->minor;
-	if ((tty < 0) || (tty >= TTY_NR) || (!dev->open_count)) {
-		log_printf("tty is not opened. tty = %d", tty);
+	tty_t * tty = (tty_t *)dev->data;
+	if ((tty == (tty_t *)0) || (!dev->open_count)) {
+		log_printf("tty is not opened. tty = %d", dev->minor);
 		return (tty_t *)0;
 	}
 
-	return tty_devs + tty;
+	return tty;
+}
+
+/**
+ * @brief 初始化tty的缓存及行规程，输出方式由具体的设备设置
+ */
+void tty_setup (tty_t * tty) {
+	tty_fifo_init(&tty->ofifo, tty->obuf, TTY_OBUF_SIZE);
+
+	tty_fifo_init(&tty->ififo, tty->ibuf, TTY_IBUF_SIZE);
+	sem_init(&tty->isem, 0);
+
+	// 默认为规范模式并回显
+	kernel_memset(&tty->termios, 0, sizeof(tty->termios));
+	tty->termios.c_iflag = ICRNL;
+	tty->termios.c_oflag = OPOST | ONLCR;
+	tty->termios.c_lflag = ICANON | ECHO | ECHOE;
+	tty->termios.c_cc[VEOF] = 0x04;
+	tty->termios.c_cc[VERASE] = ASCII_DEL;
+	tty->termios.c_cc[VKILL] = 0x15;
+	tty->termios.c_cc[VMIN] = 1;
+	tty->termios.c_cc[VTIME] = 0;
+	tty->line_len = tty->line_read = tty->line_done = 0;
+
+	tty->output = (int (*)(tty_t *))0;
+	tty->console_idx = -1;
 }
 
 /**
@@ -119,24 +214,53 @@ int tty_open (device_t * dev) {
 	}
 
 	tty_t * tty = tty_devs + idx;
-
-	tty_fifo_init(&tty->ofifo, tty->obuf, TTY_OBUF_SIZE);
-	sem_init(&tty->osem, TTY_OBUF_SIZE);
-
-	tty_fifo_init(&tty->ififo, tty->ibuf, TTY_IBUF_SIZE);
-	sem_init(&tty->isem, 0);
-
-	tty->iflags = TTY_INLCR | TTY_IECHO;
-	tty->oflags = TTY_OCRLF;
-
+	tty_setup(tty);
+	tty->output = console_write;
 	tty->console_idx = idx;
+	dev->data = tty;
 
 	kbd_init();
-	console_init(idx);
+	if (console_init(idx) < 0) {
+		return -1;
+	}
 	return 0;
 }
 
 
+/**
+ * @brief 输出数据，写入和回显共用
+ * 按块处理：先将一段数据转换到临时缓存中(\n按配置展开成\r\n)，再整块放入输出队列。
+ * 队列满时先让设备取走已有的内容，否则全部放入后只通知设备一次
+ */
+static int tty_output (tty_t * tty, const char * buf, int size) {
+	int crlf = (tty->termios.c_oflag & (OPOST | ONLCR)) == (OPOST | ONLCR);
+	char chunk[TTY_WRITE_CHUNK];
+	int len = 0;
+
+	while (len < size) {
+		// 转换一块，留出展开\n时多出的一个字节
+		int cnt = 0;
+		while ((len < size) && (cnt < TTY_WRITE_CHUNK - 1)) {
+			char c = buf[len++];
+			if ((c == '\n') && crlf) {
+				chunk[cnt++] = '\r';
+			}
+			chunk[cnt++] = c;
+		}
+
+		// 放入输出队列，放不下时先输出腾出空间。控制台直接显示，串口等待发送中断取走
+		for (int offset = 0; offset < cnt; ) {
+			offset += tty_fifo_put_n(&tty->ofifo, chunk + offset, cnt - offset);
+			if (offset < cnt) {
+				tty->output(tty);
+			}
+		}
+	}
+
+	tty->output(tty);
+	return len;
+}
+
 /**
  * @brief 向tty写入数据
  */
@@ -148,35 +272,147 @@ int tty_write (device_t * dev, int addr, char * buf, int size) {
 	tty_t * tty = get_tty(dev);
 	if (!tty) return -1;
 
+	return tty_output(tty, buf, size);
+}
+
+/**
+ * @brief 取一个输入字符，ms<0时一直等待，否则最多等待ms毫秒，超时返回-1
+ */
+static int tty_get_char (tty_t * tty, int ms, char * ch) {
+	if (ms < 0) {
+		sem_wait(&tty->isem);
+	} else if (sem_wait_timeout(&tty->isem, ms) < 0) {
+		return -1;
+	}
+
+	tty_fifo_get(&tty->ififo, ch);
+	if ((*ch == '\r') && (tty->termios.c_iflag & ICRNL)) {
+		*ch = '\n';
+	}
+	return 0;
+}
+
+/**
+ * @brief 规范模式读取：在内核中编辑一行，行结束后再交给读取者
+ * 读取者的缓存放不下时，剩余部分留到下次读取
+ */
+static int read_canon (tty_t * tty, char * buf, int size) {
+	struct termios * tio = &tty->termios;
+
+	while (!tty->line_done) {
+		// 处理已到达的所有字符，回显内容攒起来一次输出
+		char echo[TTY_WRITE_CHUNK];
+		int echo_len = 0;
+
+		do {
+			char ch;
+			tty_get_char(tty, -1, &ch);
+
+			if ((ch == tio->c_cc[VERASE]) || (ch == tio->c_cc[VKILL])) {
+				// 删除前一字符或整行
+				int cnt = (ch == tio->c_cc[VERASE]) ? 1 : tty->line_len;
+				if (cnt > tty->line_len) {
+					cnt = tty->line_len;
+				}
+				tty->line_len -= cnt;
+				if ((tio->c_lflag & (ECHO | ECHOE)) == (ECHO | ECHOE)) {
+					for (int i = 0; i < cnt; i++) {
+						if (echo_len > TTY_WRITE_CHUNK - 3) {
+							tty_output(tty, echo, echo_len);
+							echo_len = 0;
+						}
+						echo[echo_len++] = '\b';
+						echo[echo_len++] = ' ';
+						echo[echo_len++] = '\b';
+					}
+				}
+			} else if (ch == tio->c_cc[VEOF]) {
+				// 文件结束：结束当前行，行首时读到0字节
+				tty->line_done = 1;
+			} else if (ch == '\n') {
+				if (tty->line_len < TTY_LINE_SIZE) {
+					tty->line[tty->line_len++] = ch;
+				}
+				tty->line_done = 1;
+				if (tio->c_lflag & ECHO) {
+					echo[echo_len++] = ch;
+				}
+			} else if (tty->line_len < TTY_LINE_SIZE - 1) {
+				// 留出换行符的位置，行满之后的字符丢弃
+				tty->line[tty->line_len++] = ch;
+				if (tio->c_lflag & ECHO) {
+					echo[echo_len++] = ch;
+				}
+			}
+		} while (!tty->line_done && sem_count(&tty->isem) && (echo_len <= TTY_WRITE_CHUNK - 3));
+
+		if (echo_len) {
+			tty_output(tty, echo, echo_len);
+		}
+	}
+
+	// 整行交给读取者
+	int cnt = tty->line_len - tty->line_read;
+	if (cnt > size) {
+		cnt = size;
+	}
+	kernel_memcpy(buf, tty->line + tty->line_read, cnt);
+	tty->line_read += cnt;
+	if (tty->line_read >= tty->line_len) {
+		tty->line_len = tty->line_read = tty->line_done = 0;
+	}
+	return cnt;
+}
+
+/**
+ * @brief 非规范模式读取，按VMIN和VTIME决定何时返回
+ * VMIN=0,VTIME=0: 只取已有的数据，不等待
+ * VMIN>0,VTIME=0: 等到至少VMIN个字节
+ * VMIN=0,VTIME>0: 最多等待VTIME，有数据即返回
+ * VMIN>0,VTIME>0: 收到第一个字节后，字节间隔超过VTIME或满VMIN个字节时返回
+ */
+static int read_raw (tty_t * tty, char * buf, int size) {
+	int vmin = tty->termios.c_cc[VMIN];
+	int ms = tty->termios.c_cc[VTIME] * 100;
+	int min = (vmin < size) ? vmin : size;
 	int len = 0;
 
-	// 先将所有数据写入缓存中
-	while (size) {
-		char c = *buf++;
+	char echo[TTY_WRITE_CHUNK];
+	int echo_len = 0;
 
-		// 如果遇到\n，根据配置决定是否转换成\r\n
-		if (c == '\n' && (tty->oflags & TTY_OCRLF)) {
-			sem_wait(&tty->osem);
-			int err = tty_fifo_put(&tty->ofifo, '\r');
-			if (err < 0) {
-				break;
+	while (len < size) {
+		int wait = 0;
+		if (sem_count(&tty->isem) == 0) {
+			if (len >= min) {
+				// 已满足条件，只有VMIN=0且还未收到数据时才限时等待
+				if ((len > 0) || (ms == 0)) {
+					break;
+				}
+				wait = ms;
+			} else {
+				// 第一个字节无限等待，之后按字节间隔限时
+				wait = ((len > 0) && ms) ? ms : -1;
 			}
 		}
 
-		// 写入当前字符
-		sem_wait(&tty->osem);
-		int err = tty_fifo_put(&tty->ofifo, c);
-		if (err < 0) {
+		char ch;
+		if (tty_get_char(tty, wait, &ch) < 0) {
 			break;
 		}
+		buf[len++] = ch;
 
-		len++;
-		size--;
-
-		// 启动输出, 这里是直接由console直接输出，无需中断
-		console_write(tty);
+		if (tty->termios.c_lflag & ECHO) {
+			echo[echo_len++] = ch;
+			if (echo_len >= sizeof(echo)) {
+				tty_output(tty, echo, echo_len);
+				echo_len = 0;
+			}
+		}
 	}
 
+	if (echo_len) {
+		tty_output(tty, echo, echo_len);
+	}
 	return len;
 }
 
@@ -189,50 +425,12 @@ int tty_read (device_t * dev, int addr, char * buf, int size) {
 	}
 
 	tty_t * tty = get_tty(dev);
-	char * pbuf = buf;
-	int len = 0;
-
-	// 不断读取，直到遇到文件结束符或者行结束符
-	while (len < size) {
-		// 等待可用的数据
-		sem_wait(&tty->isem);
-
-		// 取出数据
-		char ch;
-		tty_fifo_get(&tty->ififo, &ch);
-		switch (ch) {
-			case ASCII_DEL:
-				if (len == 0) {
-					continue;
-				}
-				len--;
-				pbuf--;
-				break;
-			case '\n':
-				if ((tty->iflags & TTY_INLCR) && (len < size - 1)) {	// \n变成\r\n
-					*pbuf++ = '\r';
-					len++;
-				}
-				*pbuf++ = '\n';
-				len++;
-				break;
-			default:
-				*pbuf++ = ch;
-				len++;
-				break;
-		}
-
-		if (tty->iflags & TTY_IECHO) {
-		    tty_write(dev, 0, &ch, 1);
-		}
+	if (!tty) return -1;
 
-		// 遇到一行结束，也直接跳出
-		if ((ch == '\r') || (ch == '\n')) {
-			break;
-		}
+	if (tty->termios.c_lflag & ICANON) {
+		return read_canon(tty, buf, size);
 	}
-
-	return len;
+	return read_raw(tty, buf, size);
 }
 
 /**
@@ -241,27 +439,81 @@ int tty_read (device_t * dev, int addr, char * buf, int size) {
 int tty_control (device_t * dev, int cmd, int arg0, int arg1) {
 	tty_t * tty = get_tty(dev);
 
+	if (!tty) return -1;
+
 	switch (cmd) {
-	case TTY_CMD_ECHO:
-		if (arg0) {
-			tty->iflags |= TTY_IECHO;
-			console_set_cursor(tty->console_idx, 1);
-		} else {
-			tty->iflags &= ~TTY_IECHO;
-			console_set_cursor(tty->console_idx, 0);
-		}
+	case TTY_CMD_TCGETS:
+		kernel_memcpy((void *)arg0, &tty->termios, sizeof(struct termios));
 		break;
-	case TTY_CMD_IN_COUNT:
-		if (arg0) {
-			*(int *)arg0 = sem_count(&tty->isem);
+	case TTY_CMD_TCSETS: {
+		struct termios * tio = (struct termios *)arg0;
+
+		// 关闭回显时同时隐藏控制台的光标
+		if ((tty->console_idx >= 0) && ((tio->c_lflag ^ tty->termios.c_lflag) & ECHO)) {
+			console_set_cursor(tty->console_idx, (tio->c_lflag & ECHO) ? 1 : 0);
+		}
+
+		// 切换模式时，编辑到一半的行不再有意义
+		if ((tio->c_lflag ^ tty->termios.c_lflag) & ICANON) {
+			tty->line_len = tty->line_read = tty->line_done = 0;
+		}
+		kernel_memcpy(&tty->termios, tio, sizeof(struct termios));
+
+		// 丢弃未读的输入
+		if (arg1 == TCSAFLUSH) {
+			char ch;
+			while (sem_wait_timeout(&tty->isem, 0) == 0) {
+				tty_fifo_get(&tty->ififo, &ch);
+			}
+			tty->line_len = tty->line_read = tty->line_done = 0;
 		}
 		break;
+	}
 	default:
-		break;
+		return -1;
 	}
 	return 0;
 }
 
+/**
+ * @brief 检查tty上已就绪的事件
+ * 规范模式下要有完整的一行才可读，非规范模式下有数据即可读；输出总是可写
+ */
+int tty_poll (device_t * dev, int events) {
+	tty_t * tty = get_tty(dev);
+	if (!tty) return POLLNVAL;
+
+	int revents = events & POLLOUT;
+	if (!(events & POLLIN)) {
+		return revents;
+	}
+
+	irq_state_t state = irq_enter_protection();
+	tty_fifo_t * fifo = &tty->ififo;
+	struct termios * tio = &tty->termios;
+	if (!(tio->c_lflag & ICANON)) {
+		if (fifo->count) {
+			revents |= POLLIN;
+		}
+	} else if (tty->line_done) {
+		revents |= POLLIN;
+	} else {
+		// 在未处理的输入中查找行结束符
+		for (int i = 0, pos = fifo->read; i < fifo->count; i++) {
+			char c = fifo->buf[pos];
+			if ((c == '\n') || (c == tio->c_cc[VEOF]) || ((c == '\r') && (tio->c_iflag & ICRNL))) {
+				revents |= POLLIN;
+				break;
+			}
+			if (++pos >= fifo->size) {
+				pos = 0;
+			}
+		}
+	}
+	irq_leave_protection(state);
+	return revents;
+}
+
 /**
  * @brief 关闭tty设备
  */
@@ -270,11 +522,16 @@ void tty_close (device_t * dev) {
 }
 
 /**
- * @brief 输入tty字符
+ * @brief 输入tty字符，键盘输入到当前显示的tty
  */
 void tty_in (char ch) {
-	tty_t * tty = tty_devs + curr_tty;
+	tty_receive(tty_devs + curr_tty, ch);
+}
 
+/**
+ * @brief 向指定的tty输入字符，由键盘任务或串口中断调用
+ */
+void tty_receive (tty_t * tty, char ch) {
 	// 辅助队列要有空闲空间可代写入
 	if (sem_count(&tty->isem) >= TTY_IBUF_SIZE) {
 		return;
@@ -283,6 +540,7 @@ void tty_in (char ch) {
 	// 写入辅助队列，通知数据到达
 	tty_fifo_put(&tty->ififo, ch);
 	sem_notify(&tty->isem);
+	dev_poll_wakeup();
 }
 
 /**
@@ -290,7 +548,16 @@ void tty_in (char ch) {
  */
 void tty_select (int tty) {
 	if (tty != curr_tty) {    // 当前tty不等于要切换的tty时才切换
-		console_select(tty);  // 将当前显示器内容切换为目标tty的内容
-		curr_tty = tty;       // 更新当前tty的标识
+		// 将当前显示器内容切换为目标tty的内容，成功后再更新当前tty的标识
+		if (console_select(tty) == 0) {
+			curr_tty = tty;
+		}
 	}
 }
+
+/**
+ * @brief 当前tty的显示内容往上或往下翻一页回滚历史
+ */
+void tty_page_history (int up) {
+	console_page_history(tty_devs[curr_tty].console_idx, up);
+}
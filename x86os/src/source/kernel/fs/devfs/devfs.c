@@ -10,6 +10,12 @@
 
 // 设备文件系统中支持的设备
 static devfs_type_t devfs_type_list[] = {
+    {
+        // 按名称前缀匹配，须放在tty之前
+        .name = "ttyS",
+        .dev_type = DEV_SERIAL,
+        .file_type = FILE_TTY,
+    },
     {
         .name = "tty",
         .dev_type = DEV_TTY,
@@ -24,10 +30,11 @@ void devfs_unmount (struct _fs_t * fs);
 int  devfs_open    (struct _fs_t * fs, const char * path, file_t * file);
 int  devfs_read    (char * buf, int size, file_t * file);
 int  devfs_write   (char * buf, int size, file_t * file);
-void devfs_close   (file_t * file);
+int  devfs_close   (file_t * file);
 int  devfs_seek    (file_t * file, uint32_t offset, int dir);
 int  devfs_stat    (file_t * file, struct stat *st);
 int  devfs_ioctl   (file_t * file, int cmd, int arg0, int arg1);
+int  devfs_poll    (file_t * file, int events);
 
 
 
@@ -60,7 +67,7 @@ int devfs_open (struct _fs_t * fs, const char * path, file_t * file) {
         int type_name_len = kernel_strlen(type->name);
 
         // 如果存在挂载点路径，则跳过该路径，取下级子目录
-        // 由于这里设备文件系统仅支持tty设备,故这里 type->name 即是 "tty"
+        // 这里设备文件系统仅支持tty设备,故这里 type->name 即是 "ttyS" 或 "tty"
         if (kernel_strncmp(path, type->name, type_name_len) == 0) {
             int minor;
 
@@ -81,7 +88,6 @@ int devfs_open (struct _fs_t * fs, const char * path, file_t * file) {
             file->dev_id = dev_id;
             file->fs = fs;
             file->pos = 0;
-            file->size = 0;
             file->type = type->file_type;
             return 0;
         }
@@ -107,8 +113,9 @@ int devfs_write (char * buf, int size, file_t * file) {
 /**
  * @brief 关闭设备文件
  */
-void devfs_close (file_t * file) {
+int devfs_close (file_t * file) {
     dev_close(file->dev_id);
+    return 0;
 }
 
 /**
@@ -132,6 +139,13 @@ int devfs_ioctl(file_t * file, int cmd, int arg0, int arg1) {
     return dev_control(file->dev_id, cmd, arg0, arg1);
 }
 
+/**
+ * @brief 检查设备上已就绪的事件
+ */
+int devfs_poll (file_t * file, int events) {
+    return dev_poll(file->dev_id, events);
+}
+
 // 设备文件系统
 
 fs_op_t devfs_op = {
@@ -144,6 +158,7 @@ fs_op_t devfs_op = {
     .stat    = devfs_stat,
     .close   = devfs_close,
     .ioctl   = devfs_ioctl,
+    .poll    = devfs_poll,
 };
 
 
@@ -1,6 +1,8 @@
 
 #include "fs/fs.h"
 #include "fs/fatfs/fatfs.h"
+#include "fs/inode.h"
+#include "dev/time.h"
 #include "dev/dev.h"
 #include "core/memory.h"
 #include "tools/log.h"
@@ -17,8 +19,19 @@ int       cluster_get_next   (fat_t * fat, cluster_t curr);
 int       cluster_set_next   (fat_t * fat, cluster_t curr, cluster_t next);
 void      cluster_free_chain (fat_t * fat, cluster_t start);
 cluster_t cluster_alloc_free (fat_t * fat, int cnt);
+int       fat_tbl_flush      (fat_t * fat);
 
 // static void to_sfn(char* dest, const char* src);
+// static char to_upper (char c);
+// static int  name_len (const char * name);
+// static int  name_equal (const char * str, const char * name);
+// static int  name_is_sfn (const char * name);
+// static int  name_is_valid (const char * name);
+// static int  name_item_cnt (const char * name);
+// static uint8_t sfn_checksum (const uint8_t * sfn);
+// static void lfn_init (lfnitem_t * lfn, const char * name, int len, int ord, int cnt, uint8_t chksum);
+// static void lfn_collect (lfn_state_t * lfn, diritem_t * item);
+// static const char * lfn_get_name (lfn_state_t * lfn, diritem_t * item);
 
 int         diritem_name_match (diritem_t * item, const char * path);
 int         diritem_init       (diritem_t * item, uint8_t attr,const char * name);
@@ -26,39 +39,82 @@ void        diritem_get_name   (diritem_t * item, char * dest);
 file_type_t diritem_get_type   (diritem_t * item);
 
 
-// static diritem_t * read_dir_entry  (fat_t * fat, int index);
-// static int         write_dir_entry (fat_t * fat, diritem_t * item, int index);
-// static int         expand_file     (file_t * file, int inc_bytes);
-// static int         move_file_pos   (file_t* file, fat_t * fat, uint32_t move_bytes, int expand);
-// static void read_from_diritem (fat_t * fat, file_t * file, diritem_t * item, int index);
+// static int         diritem_is_lfn       (diritem_t * item);
+// static cluster_t   diritem_get_cluster  (fat_t * fat, diritem_t * item);
+// static void        diritem_set_cluster  (diritem_t * item, cluster_t cluster);
+// static int         cluster_first_sector (fat_t * fat, cluster_t cluster);
+// static fat_dentry_t * dcache_lookup  (fat_t * fat, cluster_t dir, const char * name);
+// static void        dcache_insert     (fat_t * fat, cluster_t dir, const char * name, int index, diritem_t * item);
+// static void        dcache_update     (fat_t * fat, cluster_t dir, int index, diritem_t * item);
+// static void        dcache_drop_negative (fat_t * fat, cluster_t dir);
+// static int         dir_entry_sector (fat_t * fat, cluster_t dir, int index);
+// static diritem_t * read_dir_entry   (fat_t * fat, cluster_t dir, int index);
+// static int         write_dir_entry  (fat_t * fat, cluster_t dir, diritem_t * item, int index);
+// static int         dir_find         (fat_t * fat, cluster_t dir, const char * name, diritem_t * item, int * index, int * free_index);
+// static int         dir_expand       (fat_t * fat, cluster_t dir);
+// static int         dir_make_sfn     (fat_t * fat, cluster_t dir, const char * name, char * sfn_name);
+// static int         dir_add_entry    (fat_t * fat, cluster_t dir, const char * name, diritem_t * item, int index);
+// static int         dir_remove_entry (fat_t * fat, cluster_t dir, diritem_t * item, int index);
+// static const char * path_walk       (fat_t * fat, const char * path, cluster_t * p_dir);
+// static void        file_chain_end  (fat_t * fat, inode_t * inode);
+// static cluster_t   expand_file     (fat_t * fat, inode_t * inode, int cluster_cnt);
+// static int         cluster_run_len (fat_t * fat, cluster_t start, int max, cluster_t * last);
+// static void        move_file_pos   (file_t* file, fat_t * fat, cluster_t last, uint32_t move_bytes);
+// static int         file_sector_run (fat_t * fat, file_t * file, uint32_t nbytes, cluster_t * last);
+// static uint8_t *   io_buf_alloc    (fat_t * fat);
+// static void        io_buf_free     (fat_t * fat, uint8_t * buf);
+// static int         inode_map_append (inode_t * inode, uint32_t index, cluster_t cluster);
+// static int         inode_map_build  (fat_t * fat, inode_t * inode);
+// static cluster_t   file_cluster_at  (fat_t * fat, inode_t * inode, uint32_t index);
+// static void        file_locate     (fat_t * fat, file_t * file);
+// static int         delay_reserve   (fat_t * fat, inode_t * inode, uint32_t len);
+// static int         delay_flush     (fat_t * fat, inode_t * inode, int all);
+// static int         delay_write     (fat_t * fat, file_t * file, const char * buf, uint32_t nbytes);
+// static int         inode_flush     (fat_t * fat, inode_t * inode);
+// static int  open_inode (fat_t * fat, file_t * file, diritem_t * item, cluster_t dir, int index);
+// static uint32_t fat_time_to_unix (uint16_t date, uint16_t time);
+// static uint32_t dir_byte_size (fat_t * fat, cluster_t start);
+// static void stat_fill (fat_t * fat, struct stat * st, cluster_t dir, int index, file_type_t type, uint32_t size);
 
 int  fatfs_mount   (struct _fs_t * fs, int dev_major, int dev_minor);
 void fatfs_unmount (struct _fs_t * fs);
 int  fatfs_open  (struct _fs_t * fs, const char * path, file_t * file);
+int  fatfs_truncate (file_t * file);
 int  fatfs_read  (char * buf, int size, file_t * file);
 int  fatfs_write (char * buf, int size, file_t * file);
-void fatfs_close (file_t * file);
+int  fatfs_close (file_t * file);
 int  fatfs_seek  (file_t * file, uint32_t offset, int dir);
 int  fatfs_stat  (file_t * file, struct stat *st);
+int  fatfs_path_stat (struct _fs_t * fs, const char * path, struct stat *st);
+int  fatfs_fsync (file_t * file);
+int  fatfs_sync  (struct _fs_t * fs, int age);
 int  fatfs_opendir  (struct _fs_t * fs, const char * name, DIR * dir);
 int  fatfs_readdir  (struct _fs_t * fs, DIR* dir, struct dirent * dirent);
 int  fatfs_closedir (struct _fs_t * fs, DIR *dir);
 int  fatfs_unlink   (struct _fs_t * fs, const char * path);
+int  fatfs_mkdir    (struct _fs_t * fs, const char * path);
+int  fatfs_rmdir    (struct _fs_t * fs, const char * path);
 
 
 fs_op_t fatfs_op = {
     .mount    = fatfs_mount,
     .unmount  = fatfs_unmount,
     .open     = fatfs_open,
+    .truncate = fatfs_truncate,
     .read     = fatfs_read,
     .write    = fatfs_write,
     .seek     = fatfs_seek,
     .stat     = fatfs_stat,
+    .path_stat = fatfs_path_stat,
     .close    = fatfs_close,
+    .fsync    = fatfs_fsync,
+    .sync     = fatfs_sync,
     .opendir  = fatfs_opendir,
     .readdir  = fatfs_readdir,
     .closedir = fatfs_closedir,
     .unlink   = fatfs_unlink,
+    .mkdir    = fatfs_mkdir,
+    .rmdir    = fatfs_rmdir,
 };
 
 
@@ -91,7 +147,39 @@ static int bwrite_secotr (fat_t * fat, int sector) {
  * 检查指定簇是否可用，非占用或坏簇
  */
 int cluster_is_valid (cluster_t cluster) {
-    return (cluster < 0xFFF8) && (cluster >= 0x2);     // 值是否正确
+    return (cluster < FAT_CLUSTER_INVALID) && (cluster >= 0x2);     // 值是否正确
+}
+
+/**
+ * @brief 读取内存FAT表中的表项
+ * FAT32只取低28位；FAT16的保留值(坏簇、结束标记等)转换成FAT32的形式，使上层不用区分
+ */
+static cluster_t fat_tbl_get (fat_t * fat, cluster_t cluster) {
+    if (fat->fat32) {
+        return ((uint32_t *)fat->fat_tbl)[cluster] & FAT32_CLUSTER_MASK;
+    }
+
+    cluster_t next = ((uint16_t *)fat->fat_tbl)[cluster];
+    return (next >= 0xFFF0) ? (next | 0x0FFF0000) : next;
+}
+
+/**
+ * @brief 写内存FAT表中的表项，FAT32保留高4位不变
+ */
+static void fat_tbl_put (fat_t * fat, cluster_t cluster, cluster_t next) {
+    if (fat->fat32) {
+        uint32_t * entry = (uint32_t *)fat->fat_tbl + cluster;
+        *entry = (*entry & ~FAT32_CLUSTER_MASK) | (next & FAT32_CLUSTER_MASK);
+    } else {
+        ((uint16_t *)fat->fat_tbl)[cluster] = (uint16_t)next;
+    }
+}
+
+/**
+ * @brief FAT表项的字节数
+ */
+static int fat_entry_size (fat_t * fat) {
+    return fat->fat32 ? sizeof(uint32_t) : sizeof(uint16_t);
 }
 
 /**
@@ -102,65 +190,123 @@ int cluster_get_next (fat_t * fat, cluster_t curr) {
         return FAT_CLUSTER_INVALID;
     }
 
-    // 取fat表中的扇区号和在扇区中的偏移
-    int offset = curr * sizeof(cluster_t);
-    int sector = offset / fat->bytes_per_sec;
-    int off_sector = offset % fat->bytes_per_sec;
-    if (sector >= fat->tbl_sectors) {
+    if (curr >= fat->cluster_total) {
         log_printf("cluster too big. %d", curr);
         return FAT_CLUSTER_INVALID;
     }
 
-    // 读扇区，然后取其中簇数据
-    int err = bread_sector(fat, fat->tbl_start + sector);
-    if (err < 0) {
-        return FAT_CLUSTER_INVALID;
-    }
-
-    return *(cluster_t*)(fat->fat_buffer + off_sector);
+    // 直接从内存中的FAT表取
+    return fat_tbl_get(fat, curr);
 }
 
 /**
  * @brief 设置簇的下一簇
+ * 只修改内存中的FAT表，并标记所在扇区为脏，由fat_tbl_flush统一回写
  */
 int cluster_set_next (fat_t * fat, cluster_t curr, cluster_t next) {
     if (!cluster_is_valid(curr)) {
         return -1;
     }
 
-    int offset = curr * sizeof(cluster_t);
-    int sector = offset / fat->bytes_per_sec;
-    int off_sector = offset % fat->bytes_per_sec;
-    if (sector >= fat->tbl_sectors) {
+    if (curr >= fat->cluster_total) {
         log_printf("cluster too big. %d", curr);
         return -1;
     }
 
-    // 读缓存
-    int err = bread_sector(fat, fat->tbl_start + sector);
+    // 维护空闲簇位图及计数
+    int was_free = fat_tbl_get(fat, curr) == FAT_CLUSTER_FREE;
+    int is_free = next == FAT_CLUSTER_FREE;
+    if (was_free && !is_free) {
+        bitmap_set_bit(&fat->free_map, curr, 1, 1);
+        fat->free_cnt--;
+    } else if (!was_free && is_free) {
+        bitmap_set_bit(&fat->free_map, curr, 1, 0);
+        fat->free_cnt++;
+
+        // 释放的簇比提示位置靠前，下次优先从这里分配，以保持文件尽量连续
+        if (curr < fat->next_free) {
+            fat->next_free = curr;
+        }
+    }
+
+    // 改next，并记录所在扇区待回写
+    fat_tbl_put(fat, curr, next);
+    bitmap_set_bit(&fat->dirty_map, curr * fat_entry_size(fat) / fat->bytes_per_sec, 1, 1);
+    return 0;
+}
+
+/**
+ * @brief 更新FAT32的FSInfo扇区中的空闲簇数量和下一空闲簇提示
+ */
+static int fsinfo_write (fat_t * fat) {
+    int err = bread_sector(fat, fat->fsinfo_sector);
     if (err < 0) {
         return -1;
     }
 
-    // 改next
-    *(cluster_t*)(fat->fat_buffer + off_sector) = next;
+    fsinfo_t * info = (fsinfo_t *)fat->fat_buffer;
+    if ((info->FSI_LeadSig != FSINFO_LEAD_SIG) || (info->FSI_StrucSig != FSINFO_STRUC_SIG)) {
+        return 0;
+    }
 
-    // 回写到多个表中
-    for (int i = 0; i < fat->tbl_cnt; i++) {
-        err = bwrite_secotr(fat, fat->tbl_start + sector);
-        if (err < 0) {
-            log_printf("write cluster failed.");
-            return -1;
+    info->FSI_Free_Count = fat->free_cnt;
+    info->FSI_Nxt_Free = fat->next_free;
+    return bwrite_secotr(fat, fat->fsinfo_sector);
+}
+
+/**
+ * @brief 将内存中FAT表的脏扇区回写到磁盘上的各个FAT表中
+ * 连续的脏扇区合并为一次写操作，有回写时同时更新FSInfo
+ */
+int fat_tbl_flush (fat_t * fat) {
+    uint32_t sector = 0;
+    int flushed = 0;
+
+    while (sector < fat->tbl_sectors) {
+        if (!bitmap_is_set(&fat->dirty_map, sector)) {
+            sector++;
+            continue;
+        }
+
+        // 找出连续的脏扇区，一次写的扇区数有上限
+        uint32_t end = sector + 1;
+        while ((end < fat->tbl_sectors) && bitmap_is_set(&fat->dirty_map, end)
+                && (end - sector < FAT_RUN_MAX_SECTORS)) {
+            end++;
         }
-        sector += fat->tbl_sectors;
+
+        // 回写到多个表中，不做镜像时只写使用中的表
+        int cnt = end - sector;
+        char * buf = (char *)fat->fat_tbl + sector * fat->bytes_per_sec;
+        for (int i = 0; i < fat->tbl_cnt; i++) {
+            if ((fat->tbl_active >= 0) && (i != fat->tbl_active)) {
+                continue;
+            }
+
+            int err = dev_write(fat->fs->dev_id, fat->tbl_start + i * fat->tbl_sectors + sector, buf, cnt);
+            if (err < cnt) {
+                log_printf("write fat table failed.");
+                return -1;
+            }
+        }
+
+        bitmap_set_bit(&fat->dirty_map, sector, cnt, 0);
+        sector = end;
+        flushed = 1;
+    }
+
+    if (flushed && fat->fsinfo_sector) {
+        return fsinfo_write(fat);
     }
     return 0;
 }
 
 /**
  * @brief 释放cluster链
+ * 释放的可能是目录的簇链，记录的目录位置随之失效
  */
 void cluster_free_chain(fat_t * fat, cluster_t start) {
+    fat->dpos_dir = FAT_CLUSTER_INVALID;
     while (cluster_is_valid(start)) {
         cluster_t next = cluster_get_next(fat, start);
         cluster_set_next(fat, start, FAT_CLUSTER_FREE);
@@ -169,42 +315,63 @@ void cluster_free_chain(fat_t * fat, cluster_t start) {
 }
 
 /**
- * @brief 找一个空闲的cluster
+ * @brief 从next_free开始在空闲位图中查找一个空闲簇，到末尾后回绕
+ */
+static cluster_t cluster_find_free (fat_t * fat) {
+    uint32_t curr = fat->next_free;
+
+    for (uint32_t i = 2; i < fat->cluster_total; i++) {
+        if ((curr < 2) || (curr >= fat->cluster_total)) {
+            curr = 2;
+        }
+
+        if (!bitmap_is_set(&fat->free_map, curr)) {
+            return curr;
+        }
+        curr++;
+    }
+
+    return FAT_CLUSTER_INVALID;
+}
+
+/**
+ * @brief 分配cnt个空闲的cluster，并链接成链
  */
 cluster_t cluster_alloc_free (fat_t * fat, int cnt) {
     cluster_t pre, curr, start;
-    int c_total = fat->tbl_sectors * fat->bytes_per_sec / sizeof(cluster_t);
+
+    // 空间不够，直接失败，不用扫描。为延迟分配预留的簇不能占用
+    if (cnt > fat->free_cnt - fat->resv_cnt) {
+        return FAT_CLUSTER_INVALID;
+    }
 
     pre = start = FAT_CLUSTER_INVALID;
-    for (curr = 2; (curr< c_total) && cnt; curr++) {
-        cluster_t free = cluster_get_next(fat, curr);
-        if (free == FAT_CLUSTER_FREE) {
-            // 记录首个簇
-            if (!cluster_is_valid(start)) {
-                start = curr;
-            } 
-        
-            // 前一簇如果有效，则设置。否则忽略掉
-            if (cluster_is_valid(pre)) {
-                // 找到空表项，设置前一表项的链接
-                int err = cluster_set_next(fat, pre, curr);
-                if (err < 0) {
-                    cluster_free_chain(fat, start);
-                    return FAT_CLUSTER_INVALID;
-                }
-            }
+    while (cnt) {
+        curr = cluster_find_free(fat);
+        if (!cluster_is_valid(curr)) {
+            break;
+        }
+
+        // 先占用，使下一次查找跳过该簇
+        int err = cluster_set_next(fat, curr, FAT_CLUSTER_INVALID);
+        if (err < 0) {
+            break;
+        }
+        fat->next_free = curr + 1;
 
-            pre = curr;
-            cnt--;
+        // 记录首个簇, 否则建立与前一簇的链接
+        if (!cluster_is_valid(start)) {
+            start = curr;
+        } else {
+            cluster_set_next(fat, pre, curr);
         }
+
+        pre = curr;
+        cnt--;
     }
 
-    // 最后的结点
     if (cnt == 0) {
-        int err = cluster_set_next(fat, pre, FAT_CLUSTER_INVALID);
-        if (err == 0) {
-            return start;
-        }
+        return start;
     }
 
     // 失败，空间不够等问题
@@ -214,6 +381,7 @@ cluster_t cluster_alloc_free (fat_t * fat, int cnt) {
 
 /**
  * @brief 转换文件名为diritem中的短文件名，如a.txt 转换成a      txt
+ * 名称以'\0'或路径分隔符'/'结束
  */
 static void to_sfn(char* dest, const char* src) {
     kernel_memset(dest, ' ', SFN_LEN);
@@ -221,7 +389,7 @@ static void to_sfn(char* dest, const char* src) {
     // 不断生成直到遇到分隔符和写完缓存
     char * curr = dest;
     char * end = dest + SFN_LEN;
-    while (*src && (curr < end)) {
+    while (*src && (*src != '/') && (curr < end)) {
         char c = *src++;
 
         switch (c) {
@@ -238,6 +406,218 @@ static void to_sfn(char* dest, const char* src) {
     }
 }
 
+/**
+ * @brief 转换成大写字母
+ */
+static char to_upper (char c) {
+    return ((c >= 'a') && (c <= 'z')) ? (c - 'a' + 'A') : c;
+}
+
+/**
+ * @brief 路径中一级名称的长度，名称以'\0'或'/'结束
+ */
+static int name_len (const char * name) {
+    int len = 0;
+    while (name[len] && (name[len] != '/')) {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief 不区分大小写比较完整的字符串str与路径中的一级名称name
+ */
+static int name_equal (const char * str, const char * name) {
+    while (*str && *name && (*name != '/')) {
+        if (to_upper(*str++) != to_upper(*name++)) {
+            return 0;
+        }
+    }
+    return (*str == '\0') && ((*name == '\0') || (*name == '/'));
+}
+
+/**
+ * @brief 转换为短文件名中使用的字符：合法字符转换成大写，'.'和空格返回0表示忽略，其余替换成'_'
+ */
+static char sfn_char (char c) {
+    if ((c == '.') || (c == ' ')) {
+        return 0;
+    }
+
+    c = to_upper(c);
+    if (((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9'))) {
+        return c;
+    }
+
+    const char * special = "$%'-_@~`!(){}^#&";
+    while (*special) {
+        if (*special++ == c) {
+            return c;
+        }
+    }
+    return '_';
+}
+
+/**
+ * @brief 判断名称能否直接用8.3格式的短文件名表示，小写字母转换成大写后比较，不生成长文件名
+ */
+static int name_is_sfn (const char * name) {
+    int base_len = 0, ext_len = -1;
+
+    for (int i = 0, len = name_len(name); i < len; i++) {
+        char c = name[i];
+        if (c == '.') {
+            // 只允许一个点，且不能在开头
+            if ((ext_len >= 0) || (base_len == 0)) {
+                return 0;
+            }
+            ext_len = 0;
+        } else if (sfn_char(c) != to_upper(c)) {
+            return 0;
+        } else if (ext_len >= 0) {
+            ext_len++;
+        } else {
+            base_len++;
+        }
+    }
+
+    return (base_len >= 1) && (base_len <= 8) && (ext_len != 0) && (ext_len <= 3);
+}
+
+/**
+ * @brief 检查名称能否用于新建文件或目录
+ */
+static int name_is_valid (const char * name) {
+    int len = name_len(name);
+    if ((len == 0) || (len > LFN_MAX_LEN)) {
+        return 0;
+    }
+
+    int all_dots = 1;
+    for (int i = 0; i < len; i++) {
+        char c = name[i];
+        if ((c < 0x20) || (c == '\\') || (c == ':') || (c == '*') || (c == '?')
+                || (c == '"') || (c == '<') || (c == '>') || (c == '|')) {
+            return 0;
+        }
+
+        if (c != '.') {
+            all_dots = 0;
+        }
+    }
+
+    // 不能是.和..
+    return !all_dots;
+}
+
+/**
+ * @brief 新建名称为name的项时所需的目录项数：长文件名项加上短文件名项
+ */
+static int name_item_cnt (const char * name) {
+    if (name_is_sfn(name)) {
+        return 1;
+    }
+    return (name_len(name) + LFN_CHARS_PER_ITEM - 1) / LFN_CHARS_PER_ITEM + 1;
+}
+
+/**
+ * @brief 计算短文件名的校验和，记录在对应的各长文件名项中
+ */
+static uint8_t sfn_checksum (const uint8_t * sfn) {
+    uint8_t sum = 0;
+    for (int i = 0; i < SFN_LEN; i++) {
+        sum = ((sum & 1) ? 0x80 : 0) + (sum >> 1) + sfn[i];
+    }
+    return sum;
+}
+
+/**
+ * @brief 取长文件名项中的第i个字符
+ */
+static uint16_t lfn_get_char (lfnitem_t * lfn, int i) {
+    if (i < 5) {
+        return lfn->LDIR_Name1[i];
+    } else if (i < 11) {
+        return lfn->LDIR_Name2[i - 5];
+    }
+    return lfn->LDIR_Name3[i - 11];
+}
+
+/**
+ * @brief 设置长文件名项中的第i个字符
+ */
+static void lfn_set_char (lfnitem_t * lfn, int i, uint16_t c) {
+    if (i < 5) {
+        lfn->LDIR_Name1[i] = c;
+    } else if (i < 11) {
+        lfn->LDIR_Name2[i - 5] = c;
+    } else {
+        lfn->LDIR_Name3[i - 11] = c;
+    }
+}
+
+/**
+ * @brief 生成长文件名name的第ord项，共cnt项
+ * 名称结束后的第一个字符写0，其余填0xFFFF
+ */
+static void lfn_init (lfnitem_t * lfn, const char * name, int len, int ord, int cnt, uint8_t chksum) {
+    kernel_memset(lfn, 0, sizeof(lfnitem_t));
+    lfn->LDIR_Ord = ord | ((ord == cnt) ? LFN_ORD_LAST : 0);
+    lfn->LDIR_Attr = DIRITEM_ATTR_LONG_NAME;
+    lfn->LDIR_Chksum = chksum;
+
+    int start = (ord - 1) * LFN_CHARS_PER_ITEM;
+    for (int i = 0; i < LFN_CHARS_PER_ITEM; i++) {
+        int pos = start + i;
+        uint16_t c = (pos < len) ? (uint8_t)name[pos] : ((pos == len) ? 0 : 0xFFFF);
+        lfn_set_char(lfn, i, c);
+    }
+}
+
+/**
+ * @brief 遍历目录时收集长文件名项，序号或校验和不连续时丢弃已收集的部分
+ * 只支持ASCII字符，其它字符转换成'?'
+ */
+static void lfn_collect (lfn_state_t * lfn, diritem_t * item) {
+    lfnitem_t * lfn_item = (lfnitem_t *)item;
+    int ord = lfn_item->LDIR_Ord & LFN_ORD_MASK;
+
+    if (lfn_item->LDIR_Ord & LFN_ORD_LAST) {
+        // 物理上的第一项，存放名称的最后一段
+        int end = ord * LFN_CHARS_PER_ITEM;
+        if ((ord == 0) || (end >= LFN_MAX_LEN + LFN_CHARS_PER_ITEM)) {
+            lfn->ord = -1;
+            return;
+        }
+
+        lfn->name[(end > LFN_MAX_LEN) ? LFN_MAX_LEN : end] = '\0';
+        lfn->chksum = lfn_item->LDIR_Chksum;
+    } else if ((lfn->ord < 0) || (ord != lfn->ord - 1) || (lfn_item->LDIR_Chksum != lfn->chksum)) {
+        lfn->ord = -1;
+        return;
+    }
+
+    int start = (ord - 1) * LFN_CHARS_PER_ITEM;
+    for (int i = 0; (i < LFN_CHARS_PER_ITEM) && (start + i < LFN_MAX_LEN); i++) {
+        uint16_t c = lfn_get_char(lfn_item, i);
+        if (c == 0) {
+            lfn->name[start + i] = '\0';
+            break;
+        }
+        lfn->name[start + i] = (c < 0x80) ? (char)c : '?';
+    }
+    lfn->ord = ord;
+}
+
+/**
+ * @brief 遇到短文件名项时，取其前面收集到的长文件名，没有时返回0
+ */
+static const char * lfn_get_name (lfn_state_t * lfn, diritem_t * item) {
+    int valid = (lfn->ord == 1) && (lfn->chksum == sfn_checksum(item->DIR_Name));
+    lfn->ord = -1;
+    return valid ? lfn->name : (const char *)0;
+}
+
 /**
  * @brief 判断item项是否与指定的名称相匹配
  */
@@ -252,8 +632,8 @@ int diritem_name_match (diritem_t * item, const char * path) {
  */
 int diritem_init(diritem_t * item, uint8_t attr,const char * name) {
     to_sfn((char *)item->DIR_Name, name);
-    item->DIR_FstClusHI = (uint16_t )(FAT_CLUSTER_INVALID >> 16);
-    item->DIR_FstClusL0 = (uint16_t )(FAT_CLUSTER_INVALID & 0xFFFF);
+    item->DIR_FstClusHI = 0;                // 空文件不占用簇
+    item->DIR_FstClusL0 = FAT_CLUSTER_FREE;
     item->DIR_FileSize = 0;
     item->DIR_Attr = attr;
     item->DIR_NTRes = 0;
@@ -307,142 +687,777 @@ file_type_t diritem_get_type (diritem_t * item) {
 }
 
 /**
- * @brief 在root目录中读取diritem
+ * @brief 是否为长文件名项
  */
-static diritem_t * read_dir_entry (fat_t * fat, int index) {
-    if ((index < 0) || (index >= fat->root_ent_cnt)) {
-        return (diritem_t *)0;
+static int diritem_is_lfn (diritem_t * item) {
+    return (item->DIR_Attr & 0x3F) == DIRITEM_ATTR_LONG_NAME;
+}
+
+/**
+ * @brief 获取目录项中的起始簇号
+ * FAT16只用低16位，其保留值与FAT表项一样转换成FAT32的形式
+ */
+static cluster_t diritem_get_cluster (fat_t * fat, diritem_t * item) {
+    if (fat->fat32) {
+        return ((item->DIR_FstClusHI << 16) | item->DIR_FstClusL0) & FAT32_CLUSTER_MASK;
     }
 
-    int offset = index * sizeof(diritem_t);
-    int err = bread_sector(fat, fat->root_start + offset / fat->bytes_per_sec);
-    if (err < 0) {
-        return (diritem_t *)0;
+    cluster_t cluster = item->DIR_FstClusL0;
+    return (cluster >= 0xFFF0) ? (cluster | 0x0FFF0000) : cluster;
+}
+
+/**
+ * @brief 设置目录项中的起始簇号，没有分配簇时为0
+ */
+static void diritem_set_cluster (diritem_t * item, cluster_t cluster) {
+    if (!cluster_is_valid(cluster)) {
+        cluster = FAT_CLUSTER_FREE;
     }
-    return (diritem_t *)(fat->fat_buffer + offset % fat->bytes_per_sec);
+    item->DIR_FstClusHI = (uint16_t )(cluster >> 16);
+    item->DIR_FstClusL0 = (uint16_t )(cluster & 0xFFFF);
+}
+
+/**
+ * @brief 获取簇的起始扇区号
+ */
+static int cluster_first_sector (fat_t * fat, cluster_t cluster) {
+    return fat->data_start + (cluster - 2) * fat->sec_per_cluster;  // 从2开始
 }
 
 /**
- * @brief 写dir目录项
+ * @brief 计算目录dir中第index项所在的扇区
+ * dir为FAT_ROOT_CLUSTER时在根目录区中，否则沿子目录的簇链查找。超出目录范围时返回-1
  */
-static int write_dir_entry (fat_t * fat, diritem_t * item, int index) {
-    if ((index < 0) || (index >= fat->root_ent_cnt)) {
+static int dir_entry_sector (fat_t * fat, cluster_t dir, int index) {
+    if (index < 0) {
         return -1;
     }
 
-    int offset = index * sizeof(diritem_t);
-    int sector = fat->root_start + offset / fat->bytes_per_sec;
-    int err = bread_sector(fat, sector);
-    if (err < 0) {
+    uint32_t offset = index * sizeof(diritem_t);
+    if (dir == FAT_ROOT_CLUSTER) {
+        if (index >= fat->root_ent_cnt) {
+            return -1;
+        }
+        return fat->root_start + offset / fat->bytes_per_sec;
+    }
+
+    // 子目录，先找到该项所在的簇。位于上次访问的簇及之后时从那里继续，顺序扫描时只需前进一簇
+    uint32_t cindex = offset / fat->cluster_byte_size;
+    cluster_t cluster = dir;
+    uint32_t i = 0;
+    if ((fat->dpos_dir == dir) && (fat->dpos_index <= cindex)) {
+        cluster = fat->dpos_cluster;
+        i = fat->dpos_index;
+    }
+    for (; (i < cindex) && cluster_is_valid(cluster); i++) {
+        cluster = cluster_get_next(fat, cluster);
+    }
+    if (!cluster_is_valid(cluster)) {
         return -1;
     }
-    kernel_memcpy(fat->fat_buffer + offset % fat->bytes_per_sec, item, sizeof(diritem_t));
-    return bwrite_secotr(fat, sector);
-}
 
+    fat->dpos_dir = dir;
+    fat->dpos_index = cindex;
+    fat->dpos_cluster = cluster;
+
+    offset %= fat->cluster_byte_size;
+    return cluster_first_sector(fat, cluster) + offset / fat->bytes_per_sec;
+}
 
 /**
- * @brief 更改文件大小, 此时当前族号已经到达了最后的簇号
+ * @brief 计算(目录, 名称)在目录项缓存中的位置，名称不区分大小写
  */
-static int expand_file(file_t * file, int inc_bytes) {
-    fat_t * fat = (fat_t *)file->fs->data;
-    
-    int cluster_cnt;
-    if ((file->size == 0) || (file->size % fat->cluster_byte_size == 0)) {
-        // 文件为空，或者刚好达到的簇的末尾
-        cluster_cnt = up2(inc_bytes, fat->cluster_byte_size) / fat->cluster_byte_size; 
-    } else {
-        // 文件非空，当前簇的空闲量，如果空间够增长，则直接退出了
-        // 例如：大小为2048，再扩充1024,簇大小为1024
-        int cfree = fat->cluster_byte_size - (file->size % fat->cluster_byte_size);
-        if (cfree >= inc_bytes) {
-            file->size += inc_bytes;
-            return 0;
-        }
+static int dcache_hash (cluster_t dir, const char * name) {
+    uint32_t hash = dir;
+    for (int i = 0, len = name_len(name); i < len; i++) {
+        hash = hash * 31 + (uint8_t)to_upper(name[i]);
+    }
+    return hash & (FAT_DCACHE_SIZE - 1);
+}
 
-        // 不够，则分配新簇用来放额外的空间
-        cluster_cnt = up2(inc_bytes - cfree, fat->cluster_byte_size) / fat->cluster_byte_size; 
+/**
+ * @brief 在目录项缓存中查找目录dir下的名称name，未缓存时返回0
+ */
+static fat_dentry_t * dcache_lookup (fat_t * fat, cluster_t dir, const char * name) {
+    if (name_len(name) >= FAT_DCACHE_NAME_SIZE) {
+        return (fat_dentry_t *)0;
     }
 
-    cluster_t start = cluster_alloc_free(fat, cluster_cnt);
-    if (!cluster_is_valid(start)) {
-        log_printf("no cluster for file write");
-        return -1;
+    fat_dentry_t * dentry = fat->dcache + dcache_hash(dir, name);
+    if (dentry->valid && (dentry->dir == dir) && name_equal(dentry->name, name)) {
+        return dentry;
     }
+    return (fat_dentry_t *)0;
+}
 
-    // 在文件关闭时，回写
-    if (!cluster_is_valid(file->sblk)) {
-        file->cblk = file->sblk = start;
-    } else {
-        // 建立链接关系
-        int err = cluster_set_next(fat, file->cblk, start);
-        if (err < 0) {
-            return -1;
-        }
+/**
+ * @brief 将名称为name的项加入缓存，index为-1时记录该名称不存在。同一位置已有的项直接被替换
+ * 长文件名和短文件名都可用于查找，分别缓存
+ */
+static void dcache_insert (fat_t * fat, cluster_t dir, const char * name, int index, diritem_t * item) {
+    int len = name_len(name);
+    if (len >= FAT_DCACHE_NAME_SIZE) {
+        return;
     }
 
-    return 0;
+    fat_dentry_t * dentry = fat->dcache + dcache_hash(dir, name);
+    dentry->valid = 1;
+    dentry->dir = dir;
+    dentry->index = index;
+    for (int i = 0; i < len; i++) {
+        dentry->name[i] = to_upper(name[i]);
+    }
+    dentry->name[len] = '\0';
+    if (item) {
+        kernel_memcpy(&dentry->item, item, sizeof(diritem_t));
+    }
 }
 
 /**
- * @brief 移动文件指针
+ * @brief 目录dir中第index项被改写，同步更新缓存
+ * 仍为原来的短文件名项时(如关闭文件时回写大小)更新内容，否则该位置的缓存失效
  */
-static int move_file_pos(file_t* file, fat_t * fat, uint32_t move_bytes, int expand) {
-	uint32_t c_offset = file->pos % fat->cluster_byte_size;
-
-    // 跨簇，则调整curr_cluster。注意，如果已经是最后一个簇了，则curr_cluster不会调整
-	if (c_offset + move_bytes >= fat->cluster_byte_size) {
-        cluster_t next = cluster_get_next(fat, file->cblk);
-		if ((next == FAT_CLUSTER_INVALID) && expand) {
-            int err = expand_file(file, fat->cluster_byte_size);
-            if (err < 0) {
-                return -1;
-            }
+static void dcache_update (fat_t * fat, cluster_t dir, int index, diritem_t * item) {
+    int live = (item->DIR_Name[0] != DIRITEM_NAME_FREE) && (item->DIR_Name[0] != DIRITEM_NAME_END)
+            && !diritem_is_lfn(item);
 
-            next = cluster_get_next(fat, file->cblk);
+    for (int i = 0; i < FAT_DCACHE_SIZE; i++) {
+        fat_dentry_t * dentry = fat->dcache + i;
+        if (!dentry->valid || (dentry->dir != dir) || (dentry->index != index)) {
+            continue;
         }
 
-        file->cblk = next;
-	}
+        if (live && (kernel_memcmp(dentry->item.DIR_Name, item->DIR_Name, SFN_LEN) == 0)) {
+            kernel_memcpy(&dentry->item, item, sizeof(diritem_t));
+        } else {
+            dentry->valid = 0;
+        }
+    }
+}
 
-	file->pos += move_bytes;
-	return 0;
+/**
+ * @brief 目录dir中新增了项，清除其中"名称不存在"的缓存
+ * 新项可通过长文件名和短文件名两种名称访问，逐个判断不如全部清除简单
+ */
+static void dcache_drop_negative (fat_t * fat, cluster_t dir) {
+    for (int i = 0; i < FAT_DCACHE_SIZE; i++) {
+        fat_dentry_t * dentry = fat->dcache + i;
+        if (dentry->valid && (dentry->dir == dir) && (dentry->index < 0)) {
+            dentry->valid = 0;
+        }
+    }
 }
 
 /**
- * @brief 挂载fat文件系统
- * fs: 文件系统
- * dev_major: 主设备号
- * dev_minor: 次设备号
+ * @brief 读取目录dir中的第index项
  */
-int fatfs_mount (struct _fs_t * fs, int dev_major, int dev_minor) {
-    // 打开设备
-    int dev_id = dev_open(dev_major, dev_minor, (void *)0);
-    if (dev_id < 0) {
-        log_printf("open disk failed. major: %x, minor: %x", dev_major, dev_minor);
-        return -1;
+static diritem_t * read_dir_entry (fat_t * fat, cluster_t dir, int index) {
+    int sector = dir_entry_sector(fat, dir, index);
+    if (sector < 0) {
+        return (diritem_t *)0;
     }
 
-    // 读取dbr扇区并进行检查
-    dbr_t * dbr = (dbr_t *)memory_alloc_page();
-    if (!dbr) {
-        log_printf("mount fat failed: can't alloc buf.");
-        goto mount_failed;
+    int err = bread_sector(fat, sector);
+    if (err < 0) {
+        return (diritem_t *)0;
     }
 
-    // 这里需要使用查询的方式来读取，因为此时多进程还没有跑起来，只在初始化阶段？
-    int cnt = dev_read(dev_id, 0, (char *)dbr, 1);
+    int offset = index * sizeof(diritem_t);
+    return (diritem_t *)(fat->fat_buffer + offset % fat->bytes_per_sec);
+}
+
+/**
+ * @brief 写目录dir中的第index项
+ */
+static int write_dir_entry (fat_t * fat, cluster_t dir, diritem_t * item, int index) {
+    int sector = dir_entry_sector(fat, dir, index);
+    if (sector < 0) {
+        return -1;
+    }
+
+    int err = bread_sector(fat, sector);
+    if (err < 0) {
+        return -1;
+    }
+
+    // 所有目录项的修改都经过这里，同步更新缓存
+    dcache_update(fat, dir, index, item);
+
+    int offset = index * sizeof(diritem_t);
+    kernel_memcpy(fat->fat_buffer + offset % fat->bytes_per_sec, item, sizeof(diritem_t));
+    return bwrite_secotr(fat, sector);
+}
+
+/**
+ * @brief 在目录dir中查找名称为name的项，name以'\0'或'/'结束
+ * 名称可以是长文件名，也可以是短文件名，不区分大小写
+ * 找到返回0，item和index返回短文件名项的内容及索引。找不到返回-1，此时free_index返回新建该名称时
+ * 可用的连续空闲项的起始位置：子目录中不够时可能超出簇链末尾，需先扩展目录；根目录已满时为-1
+ * 查找结果(包括不存在)会被缓存，只有需要free_index时才必须扫描目录
+ */
+static int dir_find (fat_t * fat, cluster_t dir, const char * name, diritem_t * item, int * index, int * free_index) {
+    fat_dentry_t * dentry = dcache_lookup(fat, dir, name);
+    if (dentry) {
+        if (dentry->index >= 0) {
+            kernel_memcpy(item, &dentry->item, sizeof(diritem_t));
+            *index = dentry->index;
+            return 0;
+        } else if (free_index == (int *)0) {
+            return -1;
+        }
+    }
+
+    // 不能用8.3格式表示的名称，只可能与长文件名相同
+    char sfn[SFN_LEN];
+    int is_sfn = name_is_sfn(name);
+    if (is_sfn) {
+        to_sfn(sfn, name);
+    }
+
+    lfn_state_t lfn;
+    lfn.ord = -1;
+
+    int need = name_item_cnt(name);
+    int free_idx = -1, free_start = 0, free_cnt = 0;
+    for (int i = 0; ; i++) {
+        diritem_t * curr = read_dir_entry(fat, dir, i);
+        if (curr == (diritem_t *)0) {
+            // 已到子目录末尾，从末尾的空闲项开始，不够的部分扩展目录
+            if ((free_idx < 0) && (dir != FAT_ROOT_CLUSTER)) {
+                free_idx = free_cnt ? free_start : i;
+            }
+            break;
+        }
+
+        // 结束项，其后的项全部可用
+        if (curr->DIR_Name[0] == DIRITEM_NAME_END) {
+            int start = free_cnt ? free_start : i;
+            if ((free_idx < 0) && ((dir != FAT_ROOT_CLUSTER) || (start + need <= fat->root_ent_cnt))) {
+                free_idx = start;
+            }
+            break;
+        }
+
+        if (curr->DIR_Name[0] == DIRITEM_NAME_FREE) {
+            if (free_cnt++ == 0) {
+                free_start = i;
+            }
+            if ((free_idx < 0) && (free_cnt >= need)) {
+                free_idx = free_start;
+            }
+            lfn.ord = -1;
+            continue;
+        }
+        free_cnt = 0;
+
+        // 收集长文件名，跳过卷标
+        if (diritem_is_lfn(curr)) {
+            lfn_collect(&lfn, curr);
+            continue;
+        } else if (curr->DIR_Attr & DIRITEM_ATTR_VOLUME_ID) {
+            lfn.ord = -1;
+            continue;
+        }
+
+        const char * long_name = lfn_get_name(&lfn, curr);
+        if ((long_name && name_equal(long_name, name))
+                || (is_sfn && (kernel_memcmp(curr->DIR_Name, sfn, SFN_LEN) == 0))) {
+            kernel_memcpy(item, curr, sizeof(diritem_t));
+            *index = i;
+            dcache_insert(fat, dir, name, i, item);
+            return 0;
+        }
+    }
+
+    if (free_index) {
+        *free_index = free_idx;
+    }
+
+    // 记录该名称不存在
+    dcache_insert(fat, dir, name, -1, (diritem_t *)0);
+    return -1;
+}
+
+/**
+ * @brief 为名称name生成目录dir中不重复的8.3格式短文件名，如Long File.text生成LONGFI~1.TEX
+ * 名称本身符合8.3格式时直接使用。sfn_name存放生成的名称，至少SFN_LEN + 2字节
+ */
+static int dir_make_sfn (fat_t * fat, cluster_t dir, const char * name, char * sfn_name) {
+    int len = name_len(name);
+    if (name_is_sfn(name)) {
+        kernel_memcpy(sfn_name, (void *)name, len);
+        sfn_name[len] = '\0';
+        return 0;
+    }
+
+    // 最后一个点之后为扩展名，开头的点不算
+    int dot = len - 1;
+    while ((dot > 0) && (name[dot] != '.')) {
+        dot--;
+    }
+    if (dot <= 0) {
+        dot = len;
+    }
+
+    char base[9], ext[4];
+    int base_len = 0, ext_len = 0;
+    for (int i = 0; (i < dot) && (base_len < 8); i++) {
+        char c = sfn_char(name[i]);
+        if (c) {
+            base[base_len++] = c;
+        }
+    }
+    for (int i = dot + 1; (i < len) && (ext_len < 3); i++) {
+        char c = sfn_char(name[i]);
+        if (c) {
+            ext[ext_len++] = c;
+        }
+    }
+    if (base_len == 0) {
+        base[base_len++] = '_';
+    }
+    base[base_len] = '\0';
+    ext[ext_len] = '\0';
+
+    // 依次尝试~1、~2...，基本名截短以容纳序号
+    for (int n = 1; n < 1000000; n++) {
+        char tail[8];
+        tail[0] = '~';
+        kernel_itoa(tail + 1, n, 10);
+
+        int tail_len = kernel_strlen(tail);
+        int keep = (base_len + tail_len > 8) ? 8 - tail_len : base_len;
+        kernel_memcpy(sfn_name, base, keep);
+        kernel_memcpy(sfn_name + keep, tail, tail_len + 1);
+        if (ext_len) {
+            char * c = sfn_name + keep + tail_len;
+            *c++ = '.';
+            kernel_memcpy(c, ext, ext_len + 1);
+        }
+
+        diritem_t item;
+        int index;
+        if (dir_find(fat, dir, sfn_name, &item, &index, (int *)0) < 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief 给子目录追加一个簇，新簇清零，即其中的项全部为结束项
+ */
+static int dir_expand (fat_t * fat, cluster_t dir) {
+    if (dir == FAT_ROOT_CLUSTER) {
+        return -1;
+    }
+
+    cluster_t cluster = cluster_alloc_free(fat, 1);
+    if (!cluster_is_valid(cluster)) {
+        log_printf("no cluster for dir expand");
+        return -1;
+    }
+
+    fat->curr_sector = -1;
+    kernel_memset(fat->fat_buffer, 0, fat->cluster_byte_size);
+    int cnt = dev_write(fat->fs->dev_id, cluster_first_sector(fat, cluster), fat->fat_buffer, fat->sec_per_cluster);
+    if (cnt < fat->sec_per_cluster) {
+        cluster_free_chain(fat, cluster);
+        return -1;
+    }
+
+    // 链接到簇链的末尾
+    cluster_t last = dir;
+    cluster_t next;
+    while (cluster_is_valid(next = cluster_get_next(fat, last))) {
+        last = next;
+    }
+    return cluster_set_next(fat, last, cluster);
+}
+
+/**
+ * @brief 在目录dir的index处为名称name写入新项，index来自dir_find返回的free_index
+ * 名称不符合8.3格式时，先写长文件名项，再写生成的短文件名项。超出子目录簇链时先扩展目录
+ * 返回短文件名项的索引
+ */
+static int dir_add_entry (fat_t * fat, cluster_t dir, const char * name, diritem_t * item, int index) {
+    if (index < 0) {
+        log_printf("dir is full");
+        return -1;
+    }
+
+    if (!name_is_valid(name)) {
+        log_printf("invalid file name");
+        return -1;
+    }
+
+    char sfn_name[SFN_LEN + 2];
+    int err = dir_make_sfn(fat, dir, name, sfn_name);
+    if (err < 0) {
+        return -1;
+    }
+    to_sfn((char *)item->DIR_Name, sfn_name);
+
+    int cnt = name_item_cnt(name);
+    while (dir_entry_sector(fat, dir, index + cnt - 1) < 0) {
+        err = dir_expand(fat, dir);
+        if (err < 0) {
+            return -1;
+        }
+    }
+
+    // 长文件名项按序号倒序存放在短文件名项之前
+    uint8_t chksum = sfn_checksum(item->DIR_Name);
+    for (int ord = cnt - 1; ord >= 1; ord--) {
+        lfnitem_t lfn;
+        lfn_init(&lfn, name, name_len(name), ord, cnt - 1, chksum);
+        err = write_dir_entry(fat, dir, (diritem_t *)&lfn, index++);
+        if (err < 0) {
+            return -1;
+        }
+    }
+
+    err = write_dir_entry(fat, dir, item, index);
+    if (err < 0) {
+        return -1;
+    }
+
+    dcache_drop_negative(fat, dir);
+    dcache_insert(fat, dir, name, index, item);
+    return index;
+}
+
+/**
+ * @brief 删除目录dir中的第index项及其前面的长文件名项，释放其占用的簇
+ * 各项标记为空闲而非结束项，以免其后的项被隐藏
+ */
+static int dir_remove_entry (fat_t * fat, cluster_t dir, diritem_t * item, int index) {
+    cluster_free_chain(fat, diritem_get_cluster(fat, item));
+
+    uint8_t chksum = sfn_checksum(item->DIR_Name);
+    item->DIR_Name[0] = DIRITEM_NAME_FREE;
+    int err = write_dir_entry(fat, dir, item, index);
+    if (err < 0) {
+        return err;
+    }
+
+    // 往前找序号连续且校验和相同的长文件名项
+    for (int i = index - 1, ord = 1; i >= 0; i--, ord++) {
+        diritem_t * curr = read_dir_entry(fat, dir, i);
+        if ((curr == (diritem_t *)0) || (curr->DIR_Name[0] == DIRITEM_NAME_FREE) || !diritem_is_lfn(curr)) {
+            break;
+        }
+
+        lfnitem_t lfn;
+        kernel_memcpy(&lfn, curr, sizeof(lfnitem_t));
+        if (((lfn.LDIR_Ord & LFN_ORD_MASK) != ord) || (lfn.LDIR_Chksum != chksum)) {
+            break;
+        }
+
+        int last = lfn.LDIR_Ord & LFN_ORD_LAST;
+        lfn.LDIR_Ord = DIRITEM_NAME_FREE;
+        err = write_dir_entry(fat, dir, (diritem_t *)&lfn, i);
+        if ((err < 0) || last) {
+            break;
+        }
+    }
+    return fat_tbl_flush(fat);
+}
+
+/**
+ * @brief 沿路径逐级进入子目录，返回路径中的最后一级名称，p_dir返回其所在目录的起始簇
+ * 路径为空或只有/时，返回空串，p_dir为根目录。中间某级不存在或不是目录时返回0
+ */
+static const char * path_walk (fat_t * fat, const char * path, cluster_t * p_dir) {
+    cluster_t dir = fat->root_cluster;
+
+    while (*path == '/') {
+        path++;
+    }
+
+    const char * next;
+    while ((next = path_next_child(path)) != (const char *)0) {
+        diritem_t item;
+        int index;
+
+        int err = dir_find(fat, dir, path, &item, &index, (int *)0);
+        if ((err < 0) || !(item.DIR_Attr & DIRITEM_ATTR_DIRECTORY)) {
+            return (const char *)0;
+        }
+
+        // 指向根目录的..项中簇号为0
+        dir = diritem_get_cluster(fat, &item);
+        if (dir == FAT_CLUSTER_FREE) {
+            dir = fat->root_cluster;
+        }
+
+        path = next;
+        while (*path == '/') {
+            path++;
+        }
+    }
+
+    *p_dir = dir;
+    return path;
+}
+
+/**
+ * @brief 在簇映射表末尾添加文件中的第index簇，与最后一段连续时合并。表已满时返回-1
+ */
+static int inode_map_append (inode_t * inode, uint32_t index, cluster_t cluster) {
+    if (inode->extent_cnt) {
+        blk_extent_t * last = inode->extents + inode->extent_cnt - 1;
+        if ((last->index + last->cnt == index) && (last->start + last->cnt == cluster)) {
+            last->cnt++;
+            return 0;
+        }
+    }
+
+    if (inode->extent_cnt >= INODE_EXTENT_MAX) {
+        return -1;
+    }
+
+    blk_extent_t * extent = inode->extents + inode->extent_cnt++;
+    extent->index = index;
+    extent->start = cluster;
+    extent->cnt = 1;
+    return 0;
+}
+
+/**
+ * @brief 建立文件的簇映射表，沿簇链把物理上连续的簇合并成段
+ * 段数超出上限时只映射簇链的前一部分，其后的簇仍需沿簇链查找
+ */
+static int inode_map_build (fat_t * fat, inode_t * inode) {
+    inode->extents = (blk_extent_t *)memory_alloc_page();
+    if (inode->extents == (blk_extent_t *)0) {
+        return -1;
+    }
+
+    inode->extent_cnt = 0;
+    inode->map_done = 1;
+
+    uint32_t index = 0;
+    for (cluster_t curr = inode->sblk; cluster_is_valid(curr); curr = cluster_get_next(fat, curr)) {
+        if (inode_map_append(inode, index++, curr) < 0) {
+            inode->map_done = 0;
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 沿簇链从start往后走step簇
+ */
+static cluster_t cluster_walk (fat_t * fat, cluster_t start, uint32_t step) {
+    while (step-- && cluster_is_valid(start)) {
+        start = cluster_get_next(fat, start);
+    }
+    return start;
+}
+
+/**
+ * @brief 查找文件中第index簇的簇号，超出簇链时返回无效值
+ * 映射表首次使用时建立，之后二分查找所在的段即可，不必沿簇链逐簇查找
+ */
+static cluster_t file_cluster_at (fat_t * fat, inode_t * inode, uint32_t index) {
+    if (!inode->extents && (inode_map_build(fat, inode) < 0)) {
+        // 内存不足，退回到沿簇链查找
+        return cluster_walk(fat, inode->sblk, index);
+    }
+
+    int low = 0, high = inode->extent_cnt - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        blk_extent_t * extent = inode->extents + mid;
+        if (index < extent->index) {
+            high = mid - 1;
+        } else if (index >= extent->index + extent->cnt) {
+            low = mid + 1;
+        } else {
+            return extent->start + (index - extent->index);
+        }
+    }
+
+    if (inode->map_done || (inode->extent_cnt == 0)) {
+        return FAT_CLUSTER_INVALID;
+    }
+
+    // 超出映射表的部分，从表中最后一簇开始沿簇链查找
+    blk_extent_t * last = inode->extents + inode->extent_cnt - 1;
+    return cluster_walk(fat, last->start + last->cnt - 1, index - (last->index + last->cnt - 1));
+}
+
+/**
+ * @brief 确定文件簇链的最后一簇和簇数量，已确定时不再重复查找
+ * 映射表完整时直接从中取得，否则沿簇链统计
+ */
+static void file_chain_end (fat_t * fat, inode_t * inode) {
+    if (cluster_is_valid(inode->eblk)) {
+        return;
+    }
+
+    if (inode->extents && inode->map_done && inode->extent_cnt) {
+        blk_extent_t * extent = inode->extents + inode->extent_cnt - 1;
+        inode->bcnt = extent->index + extent->cnt;
+        inode->eblk = extent->start + extent->cnt - 1;
+    } else {
+        inode->bcnt = 0;
+        for (cluster_t curr = inode->sblk; cluster_is_valid(curr); curr = cluster_get_next(fat, curr)) {
+            inode->bcnt++;
+            inode->eblk = curr;
+        }
+    }
+}
+
+/**
+ * @brief 在文件簇链的末尾追加cluster_cnt个簇，返回其中的首簇，失败时返回无效值
+ * 只分配簇，文件大小由写操作在写入数据后更新。最后一簇和簇数量记录在inode中，不必每次遍历簇链
+ */
+static cluster_t expand_file(fat_t * fat, inode_t * inode, int cluster_cnt) {
+    file_chain_end(fat, inode);
+
+    cluster_t start = cluster_alloc_free(fat, cluster_cnt);
+    if (!cluster_is_valid(start)) {
+        log_printf("no cluster for file write");
+        return FAT_CLUSTER_INVALID;
+    }
+
+    // 建立链接关系，起始簇在文件关闭时回写
+    if (!cluster_is_valid(inode->eblk)) {
+        inode->sblk = start;
+        inode_set_dirty(inode);
+    } else {
+        int err = cluster_set_next(fat, inode->eblk, start);
+        if (err < 0) {
+            cluster_free_chain(fat, start);
+            return FAT_CLUSTER_INVALID;
+        }
+    }
+
+    // 新分配的簇是连成链的，找到其中的最后一簇，同时加入映射表
+    cluster_t last = start;
+    for (int i = 0; i < cluster_cnt; i++) {
+        if (i > 0) {
+            last = cluster_get_next(fat, last);
+        }
+
+        if (inode->extents && inode->map_done && (inode_map_append(inode, inode->bcnt + i, last) < 0)) {
+            inode->map_done = 0;
+        }
+    }
+    inode->eblk = last;
+    inode->bcnt += cluster_cnt;
+    return start;
+}
+
+/**
+ * @brief 将文件的簇链截回到前bcnt簇，eblk为保留的最后一簇，其后的簇释放
+ * 用于撤销回写失败时已追加但未写入数据的簇，映射表一并截短
+ */
+static void file_chain_cut (fat_t * fat, inode_t * inode, uint32_t bcnt, cluster_t eblk) {
+    cluster_t next;
+    if (cluster_is_valid(eblk)) {
+        next = cluster_get_next(fat, eblk);
+        cluster_set_next(fat, eblk, FAT_CLUSTER_INVALID);
+    } else {
+        next = inode->sblk;
+        inode->sblk = FAT_CLUSTER_INVALID;
+        inode_set_dirty(inode);
+    }
+    cluster_free_chain(fat, next);
+
+    while (inode->extent_cnt) {
+        blk_extent_t * last = inode->extents + inode->extent_cnt - 1;
+        if (last->index < bcnt) {
+            if (last->index + last->cnt > bcnt) {
+                last->cnt = bcnt - last->index;
+            }
+            break;
+        }
+        inode->extent_cnt--;
+    }
+
+    inode->eblk = eblk;
+    inode->bcnt = bcnt;
+    inode->version++;
+}
+
+/**
+ * @brief 从start开始统计物理上连续的簇数量，最多max个，last返回其中的最后一簇
+ */
+static int cluster_run_len (fat_t * fat, cluster_t start, int max, cluster_t * last) {
+    int cnt = 1;
+    cluster_t curr = start;
+
+    while (cnt < max) {
+        cluster_t next = cluster_get_next(fat, curr);
+        if (next != curr + 1) {
+            break;
+        }
+
+        curr = next;
+        cnt++;
+    }
+
+    *last = curr;
+    return cnt;
+}
+
+/**
+ * @brief 移动文件指针，last为本次读写涉及到的最后一簇
+ * 刚好移到簇边界时，当前簇调整为下一簇；如果已经是最后一个簇，则当前簇变为无效值
+ */
+static void move_file_pos(file_t* file, fat_t * fat, cluster_t last, uint32_t move_bytes) {
+	file->pos += move_bytes;
+    file->cblk = (file->pos % fat->cluster_byte_size) ? last : cluster_get_next(fat, last);
+}
+
+/**
+ * @brief 挂载fat文件系统
+ * 支持FAT16和FAT32，按数据区的簇数量区分类型
+ * fs: 文件系统
+ * dev_major: 主设备号
+ * dev_minor: 次设备号
+ */
+int fatfs_mount (struct _fs_t * fs, int dev_major, int dev_minor) {
+    fat_t * fat = &fs->fat_data;
+    fat->fat_tbl = (uint8_t *)0;
+    fat->fat_buffer = (uint8_t *)0;
+    fat->io_buf = (uint8_t *)0;
+    fat->dcache = (fat_dentry_t *)0;
+    fat->dpos_dir = FAT_CLUSTER_INVALID;
+
+    // 打开设备
+    int dev_id = dev_open(dev_major, dev_minor, (void *)0);
+    if (dev_id < 0) {
+        log_printf("open disk failed. major: %x, minor: %x", dev_major, dev_minor);
+        return -1;
+    }
+
+    // 读取dbr扇区并进行检查
+    dbr_t * dbr = (dbr_t *)memory_alloc_page();
+    if (!dbr) {
+        log_printf("mount fat failed: can't alloc buf.");
+        goto mount_failed;
+    }
+    fat->fat_buffer = (uint8_t *)dbr;
+    fat->buf_pages = 1;
+
+    // 这里需要使用查询的方式来读取，因为此时多进程还没有跑起来，只在初始化阶段？
+    int cnt = dev_read(dev_id, 0, (char *)dbr, 1);
     if (cnt < 1) {
         log_printf("read dbr failed.");
         goto mount_failed;
     }
 
-    // 解析DBR参数，解析出有用的参数
-    fat_t * fat = &fs->fat_data;
-    fat->fat_buffer = (uint8_t *)dbr;
+    // 解析DBR参数，解析出有用的参数。FAT32的FAT表大小等参数在扩展字段中
+    dbr32_t * dbr32 = (dbr32_t *)dbr;
     fat->bytes_per_sec = dbr->BPB_BytsPerSec;
     fat->tbl_start = dbr->BPB_RsvdSecCnt;
-    fat->tbl_sectors = dbr->BPB_FATSz16;
+    fat->tbl_sectors = dbr->BPB_FATSz16 ? dbr->BPB_FATSz16 : dbr32->BPB_FATSz32;
     fat->tbl_cnt = dbr->BPB_NumFATs;
     fat->root_ent_cnt = dbr->BPB_RootEntCnt;
     fat->sec_per_cluster = dbr->BPB_SecPerClus;
@@ -451,158 +1466,591 @@ int fatfs_mount (struct _fs_t * fs, int dev_major, int dev_minor) {
     fat->data_start = fat->root_start + fat->root_ent_cnt * 32 / SECTOR_SIZE;
     fat->curr_sector = -1;
     fat->fs = fs;
+    fs->dev_id = dev_id;
     mutex_init(&fat->mutex);
     fs->mutex = &fat->mutex;
 
-	// 简单检查是否是fat16文件系统, 可以在下边做进一步的更多检查。此处只检查做一点点检查
-	if (fat->tbl_cnt != 2) {
-        log_printf("fat table num error, major: %x, minor: %x", dev_major, dev_minor);
-		goto mount_failed;
-	}
+	// 简单检查参数是否合理
+    uint32_t total_sec = dbr->BPB_TotSec16 ? dbr->BPB_TotSec16 : dbr->BPB_TotSec32;
+	if ((fat->tbl_cnt < 1) || (fat->bytes_per_sec != SECTOR_SIZE) || (fat->sec_per_cluster == 0)
+            || (fat->tbl_sectors == 0) || (total_sec <= fat->data_start)) {
+        log_printf("fat param error, major: %x, minor: %x", dev_major, dev_minor);
+		goto mount_failed;
+	}
+
+    // 根据簇的数量确定FAT类型
+    uint32_t cluster_cnt = (total_sec - fat->data_start) / fat->sec_per_cluster;
+    if (cluster_cnt < FAT12_MAX_CLUSTERS) {
+        log_printf("fat12 not supported, major: %x, minor: %x", dev_major, dev_minor);
+        goto mount_failed;
+    }
+
+    fat->fat32 = cluster_cnt >= FAT16_MAX_CLUSTERS;
+    if (fat->fat32) {
+        // 根目录在簇链中；ExtFlags的bit7为1时只使用其中一个FAT表
+        fat->root_cluster = dbr32->BPB_RootClus;
+        fat->tbl_active = (dbr32->BPB_ExtFlags & 0x80) ? (dbr32->BPB_ExtFlags & 0xF) : -1;
+        fat->fsinfo_sector = dbr32->BPB_FSInfo;
+        if ((fat->fsinfo_sector == 0) || (fat->fsinfo_sector >= fat->tbl_start)) {
+            fat->fsinfo_sector = 0;
+        }
+    } else {
+        fat->root_cluster = FAT_ROOT_CLUSTER;
+        fat->tbl_active = -1;
+        fat->fsinfo_sector = 0;
+    }
+
+    if ((fat->tbl_active >= (int)fat->tbl_cnt)
+            || (fat->fat32 && !cluster_is_valid(fat->root_cluster))) {
+        log_printf("fat32 param error, major: %x, minor: %x", dev_major, dev_minor);
+        goto mount_failed;
+    }
+
+    // 读写时整簇经过fat_buffer中转，簇比一页大时重新分配
+    if (fat->cluster_byte_size > MEM_PAGE_SIZE) {
+        int pages = up2(fat->cluster_byte_size, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+        uint8_t * buf = (uint8_t *)memory_alloc_pages(pages);
+        if (!buf) {
+            log_printf("mount fat failed: can't alloc buf.");
+            goto mount_failed;
+        }
+
+        memory_free_page((uint32_t)fat->fat_buffer);
+        fat->fat_buffer = buf;
+        fat->buf_pages = pages;
+    }
+
+    // 读写文件数据时使用的扇区中转缓存
+    fat->io_buf = (uint8_t *)memory_alloc_page();
+    if (!fat->io_buf) {
+        log_printf("mount fat failed: can't alloc io buf.");
+        goto mount_failed;
+    }
+    fat->io_free = (1 << FAT_IOBUF_CNT) - 1;
+    sem_init(&fat->io_sem, FAT_IOBUF_CNT);
+
+    fat->dcache = (fat_dentry_t *)memory_alloc_pages(FAT_DCACHE_PAGES);
+    if (!fat->dcache) {
+        log_printf("mount fat failed: can't alloc dentry cache.");
+        goto mount_failed;
+    }
+    kernel_memset(fat->dcache, 0, FAT_DCACHE_PAGES * MEM_PAGE_SIZE);
+
+    // 计算簇的总数，不能超过FAT表所能容纳的项数
+    uint32_t tbl_items = fat->tbl_sectors * fat->bytes_per_sec / fat_entry_size(fat);
+    fat->cluster_total = cluster_cnt + 2;
+    if (fat->cluster_total > tbl_items) {
+        fat->cluster_total = tbl_items;
+    }
+
+    // 将整个FAT表读入内存，后面紧跟空闲位图和脏扇区位图
+    int tbl_bytes = fat->tbl_sectors * fat->bytes_per_sec;
+    int total_bytes = tbl_bytes + bitmap_byte_count(fat->cluster_total) + bitmap_byte_count(fat->tbl_sectors);
+    fat->tbl_pages = up2(total_bytes, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    fat->fat_tbl = (uint8_t *)memory_alloc_pages(fat->tbl_pages);
+    if (!fat->fat_tbl) {
+        log_printf("mount fat failed: can't alloc fat table.");
+        goto mount_failed;
+    }
+
+    // 分段读入，每次的扇区数有上限
+    int tbl_sector = fat->tbl_start + ((fat->tbl_active >= 0) ? fat->tbl_active : 0) * fat->tbl_sectors;
+    for (uint32_t offset = 0; offset < fat->tbl_sectors; offset += cnt) {
+        int read_cnt = fat->tbl_sectors - offset;
+        if (read_cnt > FAT_RUN_MAX_SECTORS) {
+            read_cnt = FAT_RUN_MAX_SECTORS;
+        }
+
+        cnt = dev_read(dev_id, tbl_sector + offset, (char *)fat->fat_tbl + offset * fat->bytes_per_sec, read_cnt);
+        if (cnt < read_cnt) {
+            log_printf("read fat table failed.");
+            goto mount_failed;
+        }
+    }
+
+    // 根据FAT表建立空闲簇位图，0号和1号簇保留
+    uint8_t * bits = fat->fat_tbl + tbl_bytes;
+    bitmap_init(&fat->free_map, bits, fat->cluster_total, 0);
+    bitmap_set_bit(&fat->free_map, 0, 2, 1);
+    fat->free_cnt = 0;
+    fat->resv_cnt = 0;
+    fat->next_free = 2;
+    for (uint32_t i = 2; i < fat->cluster_total; i++) {
+        if (fat_tbl_get(fat, i) != FAT_CLUSTER_FREE) {
+            bitmap_set_bit(&fat->free_map, i, 1, 1);
+        } else {
+            fat->free_cnt++;
+        }
+    }
+
+    bits += bitmap_byte_count(fat->cluster_total);
+    bitmap_init(&fat->dirty_map, bits, fat->tbl_sectors, 0);
+
+    // FAT32从FSInfo中记录的位置开始分配，空闲簇数量以实际统计的为准，回写FAT表时一并更新
+    if (fat->fsinfo_sector && (bread_sector(fat, fat->fsinfo_sector) == 0)) {
+        fsinfo_t * info = (fsinfo_t *)fat->fat_buffer;
+        if ((info->FSI_LeadSig == FSINFO_LEAD_SIG) && (info->FSI_StrucSig == FSINFO_STRUC_SIG)
+                && (info->FSI_Nxt_Free >= 2) && (info->FSI_Nxt_Free < fat->cluster_total)) {
+            fat->next_free = info->FSI_Nxt_Free;
+        }
+    }
+
+    // 记录相关的打开信息
+    fs->type = fat->fat32 ? FS_FAT32 : FS_FAT16;
+    fs->data = &fs->fat_data;
+    return 0;
+
+mount_failed:
+    if (fat->dcache) {
+        memory_free_pages((uint32_t)fat->dcache, FAT_DCACHE_PAGES);
+        fat->dcache = (fat_dentry_t *)0;
+    }
+    if (fat->io_buf) {
+        memory_free_page((uint32_t)fat->io_buf);
+        fat->io_buf = (uint8_t *)0;
+    }
+    if (fat->fat_tbl) {
+        memory_free_pages((uint32_t)fat->fat_tbl, fat->tbl_pages);
+        fat->fat_tbl = (uint8_t *)0;
+    }
+    if (fat->fat_buffer) {
+        memory_free_pages((uint32_t)fat->fat_buffer, fat->buf_pages);
+        fat->fat_buffer = (uint8_t *)0;
+    }
+    dev_close(dev_id);
+    return -1;
+}
+
+/**
+ * @brief 卸载fatfs文件系统
+ */
+void fatfs_unmount (struct _fs_t * fs) {
+    fat_t * fat = (fat_t *)fs->data;
+
+    fat_tbl_flush(fat);
+    dev_close(fs->dev_id);
+    memory_free_pages((uint32_t)fat->fat_tbl, fat->tbl_pages);
+    memory_free_pages((uint32_t)fat->fat_buffer, fat->buf_pages);
+    memory_free_page((uint32_t)fat->io_buf);
+    memory_free_pages((uint32_t)fat->dcache, FAT_DCACHE_PAGES);
+}
+
+/**
+ * @brief 将FAT目录项中的日期和时间转换为自1970年起的秒数，日期无效时返回0
+ * 日期：bit15-9为自1980年起的年数，bit8-5为月，bit4-0为日；时间：时、分、以2秒为单位的秒
+ */
+static uint32_t fat_time_to_unix (uint16_t date, uint16_t time) {
+    static const int month_days[] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+    int year = 1980 + (date >> 9);
+    int month = (date >> 5) & 0xF;
+    int day = date & 0x1F;
+    if ((month < 1) || (month > 12) || (day < 1)) {
+        return 0;
+    }
+
+    // 之前各年的天数，加上其中闰年多出的天数
+    int last = year - 1;
+    uint32_t days = (year - 1970) * 365 + (last / 4 - last / 100 + last / 400) - (1969 / 4 - 1969 / 100 + 1969 / 400);
+    days += month_days[month - 1] + day - 1;
+    if ((month > 2) && ((year % 4 == 0) && ((year % 100 != 0) || (year % 400 == 0)))) {
+        days++;
+    }
+
+    return days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2;
+}
+
+/**
+ * @brief 获取文件的inode并打开，文件未被打开过时从diritem中读取文件信息
+ */
+static int open_inode (fat_t * fat, file_t * file, diritem_t * item, cluster_t dir, int index) {
+    inode_t * inode = inode_get(fat->fs, dir, index);
+    if (inode == (inode_t *)0) {
+        log_printf("no inode for open.");
+        return -1;
+    }
+
+    if (!inode->valid) {
+        inode->type = diritem_get_type(item);
+        inode->size = item->DIR_FileSize;
+        inode->sblk = diritem_get_cluster(fat, item);
+        inode->eblk = FAT_CLUSTER_INVALID;
+        inode->atime = fat_time_to_unix(item->DIR_LastAccDate, 0);
+        inode->mtime = fat_time_to_unix(item->DIR_WrtDate, item->DIR_WrtTime);
+        inode->ctime = fat_time_to_unix(item->DIR_CrtDate, item->DIR_CrtTime);
+        inode->valid = 1;
+    }
+
+    file->inode = inode;
+    file->type = inode->type;
+    file->pos = 0;
+    file->cblk = inode->sblk;
+    file->version = inode->version;
+    return 0;
+}
+
+/**
+ * @brief 重新确定文件当前位置所在的簇
+ * 同一文件的其它打开者截断或扩展了文件后，本文件记录的当前簇可能已过时
+ */
+static void file_locate (fat_t * fat, file_t * file) {
+    inode_t * inode = file->inode;
+
+    file->cblk = file_cluster_at(fat, inode, file->pos / fat->cluster_byte_size);
+    file->version = inode->version;
+}
+
+/**
+ * @brief 打开指定的文件
+ * path为相对于文件系统根目录的路径，如dir/a.txt
+ */
+int fatfs_open (struct _fs_t * fs, const char * path, file_t * file) {
+    fat_t * fat = (fat_t *)fs->data;
+    diritem_t item;
+    cluster_t p_dir;
+    int index, free_index;
+
+    // 找到文件所在的目录
+    const char * name = path_walk(fat, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
+
+    if (dir_find(fat, p_dir, name, &item, &index, &free_index) == 0) {
+        // 目录不能当作普通文件打开
+        if (item.DIR_Attr & DIRITEM_ATTR_DIRECTORY) {
+            return -1;
+        }
+
+        // O_TRUNC的截断由调用者在取得文件锁后通过truncate完成
+        return open_inode(fat, file, &item, p_dir, index);
+    } else if (file->mode & O_CREAT) {
+        // 创建一个空闲的diritem项
+        kernel_memset(&item, 0, sizeof(diritem_t));
+        diritem_init(&item, 0, name);
+        index = dir_add_entry(fat, p_dir, name, &item, free_index);
+        if (index < 0) {
+            log_printf("create file failed.");
+            return -1;
+        }
+
+        // 目录可能扩展了新簇
+        fat_tbl_flush(fat);
+        return open_inode(fat, file, &item, p_dir, index);
+    }
 
-    if (kernel_memcmp(dbr->BS_FileSysType, "FAT16", 5) != 0) {
-        log_printf("not a fat16 file system, major: %x, minor: %x", dev_major, dev_minor);
-        goto mount_failed;
+    return -1;
+}
+
+/**
+ * @brief 打开时截断文件，清空数据，暂存未分配的数据一并丢弃。其它打开者通过version得知当前簇已失效
+ * 调用者需先持有文件锁，再持有fs->mutex，此时没有正在进行的读写和暂存数据的回写
+ */
+int fatfs_truncate (file_t * file) {
+    fat_t * fat = (fat_t *)file->fs->data;
+    inode_t * inode = file->inode;
+
+    if (!cluster_is_valid(inode->sblk) && !inode->dlen) {
+        return 0;
     }
 
-    // 记录相关的打开信息
-    fs->type = FS_FAT16;
-    fs->data = &fs->fat_data;
-    fs->dev_id = dev_id;
+    cluster_free_chain(fat, inode->sblk);
+    inode->sblk = inode->eblk = FAT_CLUSTER_INVALID;
+    inode->bcnt = 0;
+    inode->size = 0;
+    inode_set_dirty(inode);
+    inode->version++;
+    inode->extent_cnt = 0;
+    inode->map_done = 1;
+
+    fat->resv_cnt -= inode->resv;
+    inode->resv = 0;
+    inode->dlen = 0;
+
+    file->cblk = FAT_CLUSTER_INVALID;
+    file->version = inode->version;
     return 0;
+}
 
-mount_failed:
-    if (dbr) {
-        memory_free_page((uint32_t)dbr);
+/**
+ * @brief 计算本次可以整扇区直接读写的扇区数，从当前位置开始，连同其后物理连续的簇
+ * 调用时当前位置需位于扇区边界，nbytes至少为一个扇区。last返回涉及到的最后一簇
+ */
+static int file_sector_run (fat_t * fat, file_t * file, uint32_t nbytes, cluster_t * last) {
+    int sector_cnt = nbytes / fat->bytes_per_sec;
+    int sector_left = fat->sec_per_cluster - (file->pos % fat->cluster_byte_size) / fat->bytes_per_sec;
+
+    *last = file->cblk;
+    if (sector_cnt <= sector_left) {
+        return sector_cnt;
     }
-    dev_close(dev_id);
-    return -1;
+
+    // 当前簇剩余的扇区，再加上其后连续的整簇
+    int max = (sector_cnt - sector_left) / fat->sec_per_cluster;
+    if (max > (FAT_RUN_MAX_SECTORS - sector_left) / fat->sec_per_cluster) {
+        max = (FAT_RUN_MAX_SECTORS - sector_left) / fat->sec_per_cluster;
+    }
+    int run = cluster_run_len(fat, file->cblk, max + 1, last);
+    return sector_left + (run - 1) * fat->sec_per_cluster;
 }
 
 /**
- * @brief 卸载fatfs文件系统
+ * @brief 从中转缓存池中取一个扇区大小的缓存，没有空闲时等待
+ * 读写文件数据时不持有fat->mutex，不足一个扇区的部分不能再经过fat_buffer中转
  */
-void fatfs_unmount (struct _fs_t * fs) {
-    fat_t * fat = (fat_t *)fs->data;
+static uint8_t * io_buf_alloc (fat_t * fat) {
+    sem_wait(&fat->io_sem);
 
-    dev_close(fs->dev_id);
-    memory_free_page((uint32_t)fat->fat_buffer);
+    mutex_lock(&fat->mutex);
+    int i = 0;
+    while (!(fat->io_free & (1 << i))) {
+        i++;
+    }
+    fat->io_free &= ~(1 << i);
+    mutex_unlock(&fat->mutex);
+
+    return fat->io_buf + i * SECTOR_SIZE;
 }
 
 /**
- * @brief 从diritem中读取相应的文件信息
+ * @brief 归还中转缓存
  */
-static void read_from_diritem (fat_t * fat, file_t * file, diritem_t * item, int index) {
-    file->type = diritem_get_type(item);
-    file->size = (int)item->DIR_FileSize;
-    file->pos = 0;
-    file->sblk = (item->DIR_FstClusHI << 16) | item->DIR_FstClusL0;
-    file->cblk = file->sblk;
-    file->p_index = index;
+static void io_buf_free (fat_t * fat, uint8_t * buf) {
+    mutex_lock(&fat->mutex);
+    fat->io_free |= 1 << ((buf - fat->io_buf) / SECTOR_SIZE);
+    mutex_unlock(&fat->mutex);
+
+    sem_notify(&fat->io_sem);
 }
 
 /**
- * @brief 打开指定的文件
- * struct _fs_t * fs 
+ * @brief 为文件暂存的前len字节预留簇，空间不足时返回-1
+ * 预留的簇计入fat->resv_cnt，其它分配不能占用，保证回写时一定能分配到
  */
-int fatfs_open (struct _fs_t * fs, const char * path, file_t * file) {
-    fat_t * fat = (fat_t *)fs->data;
-    diritem_t * file_item = (diritem_t *)0;
-    int p_index = -1;
+static int delay_reserve (fat_t * fat, inode_t * inode, uint32_t len) {
+    int need = up2(len, fat->cluster_byte_size) / fat->cluster_byte_size;
+    if (need <= inode->resv) {
+        return 0;
+    }
 
-    // 遍历根目录的数据区，找到已经存在的匹配项
-    for (int i = 0; i < fat->root_ent_cnt; i++) {
-        diritem_t * item = read_dir_entry(fat, i);
-        if (item == (diritem_t *)0) {
-            return -1;
+    uint32_t extra = need - inode->resv;
+    if (extra > fat->free_cnt - fat->resv_cnt) {
+        return -1;
+    }
+
+    fat->resv_cnt += extra;
+    inode->resv = need;
+    return 0;
+}
+
+/**
+ * @brief 回写暂存的数据：一次性分配所需的簇，尽量物理连续，再按连续的簇段整段写出
+ * all为0时只回写其中的整簇，不足一簇的尾部留在缓存中继续累积。调用者持有文件锁
+ */
+static int delay_flush (fat_t * fat, inode_t * inode, int all) {
+    uint32_t bytes = all ? inode->dlen : inode->dlen / fat->cluster_byte_size * fat->cluster_byte_size;
+    if (bytes == 0) {
+        return 0;
+    }
+
+    // 用预留的簇来分配，分配的簇由文件的簇链所有。记下原来的末尾，写入失败时撤销
+    mutex_lock(&fat->mutex);
+    file_chain_end(fat, inode);
+    uint32_t old_bcnt = inode->bcnt;
+    cluster_t prev = inode->eblk;
+    int cluster_cnt = up2(bytes, fat->cluster_byte_size) / fat->cluster_byte_size;
+    fat->resv_cnt -= cluster_cnt;
+    inode->resv -= cluster_cnt;
+    cluster_t start = expand_file(fat, inode, cluster_cnt);
+    if (!cluster_is_valid(start)) {
+        fat->resv_cnt += cluster_cnt;
+        inode->resv += cluster_cnt;
+        mutex_unlock(&fat->mutex);
+        return -1;
+    }
+    mutex_unlock(&fat->mutex);
+
+    // 最后一个扇区中超出数据的部分清零
+    uint32_t sector_bytes = up2(bytes, fat->bytes_per_sec);
+    kernel_memset(inode->dbuf + bytes, 0, sector_bytes - bytes);
+
+    int err = 0;
+    uint8_t * data = inode->dbuf;
+    int sector_cnt = sector_bytes / fat->bytes_per_sec;
+    int done_cnt = 0;
+    cluster_t curr = start;
+    while (sector_cnt > 0) {
+        cluster_t last;
+
+        mutex_lock(&fat->mutex);
+        int run = cluster_run_len(fat, curr, FAT_RUN_MAX_SECTORS / fat->sec_per_cluster, &last);
+        cluster_t next = cluster_get_next(fat, last);
+        mutex_unlock(&fat->mutex);
+
+        int cnt = run * fat->sec_per_cluster;
+        if (cnt > sector_cnt) {
+            cnt = sector_cnt;
         }
 
-         // 结束项，不需要再扫描了，同时index也不能往前走
-        if (item->DIR_Name[0] == DIRITEM_NAME_END) {
-            p_index = i;
+        if (dev_write(fat->fs->dev_id, cluster_first_sector(fat, curr), data, cnt) < cnt) {
+            log_printf("write file data failed.");
+            err = -1;
             break;
         }
 
-        // 只显示普通文件和目录，其它的不显示
-        if (item->DIR_Name[0] == DIRITEM_NAME_FREE) {
-            p_index = i;
-            continue;
+        data += cnt * fat->bytes_per_sec;
+        sector_cnt -= cnt;
+        done_cnt += run;
+        prev = last;
+        curr = next;
+    }
+
+    if (err < 0) {
+        // 每段都从簇边界开始，之前的段已整簇写入。未写入的簇从簇链上摘下，重新作为预留，
+        // 数据仍留在缓存中，由之后的fsync或close重试
+        mutex_lock(&fat->mutex);
+        file_chain_cut(fat, inode, old_bcnt + done_cnt, prev);
+        fat->resv_cnt += cluster_cnt - done_cnt;
+        inode->resv += cluster_cnt - done_cnt;
+        mutex_unlock(&fat->mutex);
+
+        bytes = done_cnt * fat->cluster_byte_size;
+    }
+
+    // 剩余的部分移到缓存开头，仍从簇链末尾开始
+    inode->dlen -= bytes;
+    kernel_memcpy(inode->dbuf, inode->dbuf + bytes, inode->dlen);
+    return err;
+}
+
+/**
+ * @brief 将追加在已分配簇之后的数据写入暂存缓存，只预留空间，返回写入的字节数
+ * 缓存已满时先回写其中的整簇
+ */
+static int delay_write (fat_t * fat, file_t * file, const char * buf, uint32_t nbytes) {
+    inode_t * inode = file->inode;
+    uint32_t buf_size = INODE_DBUF_PAGES * MEM_PAGE_SIZE / fat->cluster_byte_size * fat->cluster_byte_size;
+
+    if (inode->dbuf == (uint8_t *)0) {
+        inode->dbuf = (uint8_t *)memory_alloc_pages(INODE_DBUF_PAGES);
+        if (inode->dbuf == (uint8_t *)0) {
+            log_printf("no memory for file write.");
+            return -1;
         }
+    }
 
-        // 找到要打开的目录
-        if (diritem_name_match(item, path)) {
-            file_item = item;
-            p_index = i;
-            break;
+    uint32_t offset = file->pos - inode->bcnt * fat->cluster_byte_size;
+    if (offset >= buf_size) {
+        if (delay_flush(fat, inode, 0) < 0) {
+            return -1;
+        }
+        offset = file->pos - inode->bcnt * fat->cluster_byte_size;
+        if (offset >= buf_size) {
+            log_printf("file write position out of range.");
+            return -1;
         }
     }
 
-    if (file_item) {
-        read_from_diritem(fat, file, file_item, p_index);
+    uint32_t cnt = buf_size - offset;
+    if (cnt > nbytes) {
+        cnt = nbytes;
+    }
 
-        // 如果要截断，则清空
-        if (file->mode & O_TRUNC) {
-            cluster_free_chain(fat, file->sblk);
-            file->cblk = file->sblk = FAT_CLUSTER_INVALID;
-            file->size = 0;
+    // 超出已暂存的部分需要预留簇，空间不足时只写入能预留到的部分
+    if (offset + cnt > inode->dlen) {
+        mutex_lock(&fat->mutex);
+        uint32_t limit = (inode->resv + fat->free_cnt - fat->resv_cnt) * fat->cluster_byte_size;
+        if (offset + cnt > limit) {
+            cnt = (limit > offset) ? limit - offset : 0;
         }
-        return 0;
-    } else if ((file->mode & O_CREAT) && (p_index >= 0)) {
-        // 创建一个空闲的diritem项
-        diritem_t item;
-        diritem_init(&item, 0, path);
-        int err = write_dir_entry(fat, &item, p_index);
+
+        int err = cnt ? delay_reserve(fat, inode, offset + cnt) : -1;
+        mutex_unlock(&fat->mutex);
         if (err < 0) {
-            log_printf("create file failed.");
+            log_printf("no cluster for file write");
             return -1;
         }
-
-        read_from_diritem(fat, file, &item, p_index);
-        return 0;
     }
 
-    return -1;
+    kernel_memcpy(inode->dbuf + offset, (void *)buf, cnt);
+    if (offset + cnt > inode->dlen) {
+        inode->dlen = offset + cnt;
+    }
+    return cnt;
 }
 
 /**
  * @brief 读了文件
+ * 扇区对齐的部分按物理连续的簇段整段读入用户缓存，不足一个扇区的头尾部分经中转缓存
+ * 簇链之后还未分配簇的部分直接从暂存缓存中拷贝
+ * 调用者持有文件锁。簇链的查找只访问内存中的FAT表，在fat->mutex内完成，读磁盘时不持有该锁
  */
 int fatfs_read (char * buf, int size, file_t * file) {
     fat_t * fat = (fat_t *)file->fs->data;
+    inode_t * inode = file->inode;
 
     // 调整读取量，不要超过文件总量
+    if (file->pos >= inode->size) {
+        return 0;
+    }
+
     uint32_t nbytes = size;
-    if (file->pos + nbytes > file->size) {
-        nbytes = file->size - file->pos;
+    if (file->pos + nbytes > inode->size) {
+        nbytes = inode->size - file->pos;
+    }
+
+    // 文件被其它打开者截断或扩展过，当前簇需重新确定
+    if ((file->version != inode->version) || !cluster_is_valid(file->cblk)) {
+        mutex_lock(&fat->mutex);
+        file_locate(fat, file);
+        mutex_unlock(&fat->mutex);
     }
 
     uint32_t total_read = 0;
     while (nbytes > 0) {
+        // 已分配的簇之后的数据还暂存在内存中
+        uint32_t alloc_end = inode->bcnt * fat->cluster_byte_size;
+        if (inode->dlen && (file->pos >= alloc_end)) {
+            kernel_memcpy(buf, inode->dbuf + file->pos - alloc_end, nbytes);
+            file->pos += nbytes;
+            total_read += nbytes;
+            break;
+        }
+
+        if (!cluster_is_valid(file->cblk)) {
+            break;
+        }
+
         uint32_t curr_read = nbytes;
-		uint32_t cluster_offset = file->pos % fat->cluster_byte_size;
-        uint32_t start_sector = fat->data_start + (file->cblk - 2)* fat->sec_per_cluster;  // 从2开始
+        uint32_t sector_offset = file->pos % fat->bytes_per_sec;
+        uint32_t start_sector = cluster_first_sector(fat, file->cblk) + (file->pos % fat->cluster_byte_size) / fat->bytes_per_sec;
+        cluster_t last = file->cblk;
+
+        if ((sector_offset == 0) && (nbytes >= fat->bytes_per_sec)) {
+            // 整扇区，连续的扇区一次读入
+            mutex_lock(&fat->mutex);
+            int cnt = file_sector_run(fat, file, nbytes, &last);
+            mutex_unlock(&fat->mutex);
 
-        // 如果是整簇, 只读一簇
-        if ((cluster_offset == 0) && (nbytes == fat->cluster_byte_size)) {
-            int err = dev_read(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
-            if (err < 0) {
+            if (dev_read(fat->fs->dev_id, start_sector, buf, cnt) < cnt) {
                 return total_read;
             }
-
-            curr_read = fat->cluster_byte_size;
+            curr_read = cnt * fat->bytes_per_sec;
         } else {
-            // 如果跨簇，只读第一个簇内的一部分
-            if (cluster_offset + curr_read > fat->cluster_byte_size) {
-                curr_read = fat->cluster_byte_size - cluster_offset;
+            // 不足一个扇区，读取整个扇区，然后从中拷贝
+            if (sector_offset + curr_read > fat->bytes_per_sec) {
+                curr_read = fat->bytes_per_sec - sector_offset;
             }
 
-            // 读取整个簇，然后从中拷贝
-            fat->curr_sector = -1;
-            int err = dev_read(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
-            if (err < 0) {
+            uint8_t * io_buf = io_buf_alloc(fat);
+            int cnt = dev_read(fat->fs->dev_id, start_sector, io_buf, 1);
+            if (cnt == 1) {
+                kernel_memcpy(buf, io_buf + sector_offset, curr_read);
+            }
+            io_buf_free(fat, io_buf);
+            if (cnt < 1) {
                 return total_read;
             }
-            kernel_memcpy(buf, fat->fat_buffer + cluster_offset, curr_read);
         }
 
         buf += curr_read;
@@ -610,10 +2058,9 @@ int fatfs_read (char * buf, int size, file_t * file) {
         total_read += curr_read;
 
         // 前移文件指针
-		int err = move_file_pos(file, fat, curr_read, 0);
-		if (err < 0) {
-            return total_read;
-        }
+        mutex_lock(&fat->mutex);
+		move_file_pos(file, fat, last, curr_read);
+        mutex_unlock(&fat->mutex);
 	}
 
     return total_read;
@@ -621,64 +2068,112 @@ int fatfs_read (char * buf, int size, file_t * file) {
 
 /**
  * @brief 写文件数据
+ * 已分配的簇中的数据与读类似：对齐的整扇区按连续簇段直接从用户缓存写出
+ * 追加在簇链之后的数据采用延迟分配，先暂存并预留空间，回写时再一次性分配连续的簇
+ * 与读相同，只在分配簇和查找簇链时持有fat->mutex
  */
 int fatfs_write (char * buf, int size, file_t * file) {
     fat_t * fat = (fat_t *)file->fs->data;
+    inode_t * inode = file->inode;
 
-    // 如果文件大小不够，则先扩展文件大小
-    if (file->pos + size > file->size) {
-        int inc_size = file->pos + size - file->size;
-        int err = expand_file(file, inc_size);
-        if (err < 0) {
-            return 0;
-        }
+    mutex_lock(&fat->mutex);
+
+    // 确定簇链的末尾，其后的写入都暂存起来
+    file_chain_end(fat, inode);
+
+    // 文件被其它打开者截断或扩展过，当前簇需重新确定
+    if ((file->version != inode->version)
+            || (!cluster_is_valid(file->cblk) && (file->pos < inode->bcnt * fat->cluster_byte_size))) {
+        file_locate(fat, file);
+    }
+
+    // 文件被截短后，位置可能超出文件末尾。与seek相同，不允许越过末尾，从末尾继续写
+    if (file->pos > inode->size) {
+        file->pos = inode->size;
+        file_locate(fat, file);
     }
+    mutex_unlock(&fat->mutex);
 
     uint32_t nbytes = size;
     uint32_t total_write = 0;
 	while (nbytes) {
-        // 每次写的数据量取决于当前簇中剩余的空间，以及size的量综合
-        uint32_t curr_write = nbytes;
-		uint32_t cluster_offset = file->pos % fat->cluster_byte_size;
-        uint32_t start_sector = fat->data_start + (file->cblk - 2)* fat->sec_per_cluster;  // 从2开始
-
-        // 如果是整簇, 写整簇
-        if ((cluster_offset == 0) && (nbytes == fat->cluster_byte_size)) {
-            int err = dev_write(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_write;
+        uint32_t alloc_end = inode->bcnt * fat->cluster_byte_size;
+        uint32_t curr_write;
+
+        if (file->pos >= alloc_end) {
+            // 位于簇链之后，写入暂存缓存
+            int cnt = delay_write(fat, file, buf, nbytes);
+            if (cnt < 0) {
+                break;
             }
 
-            curr_write = fat->cluster_byte_size;
+            curr_write = cnt;
+            file->pos += curr_write;
+            file->cblk = FAT_CLUSTER_INVALID;
         } else {
-            // 如果跨簇，只写第一个簇内的一部分
-            if (cluster_offset + curr_write > fat->cluster_byte_size) {
-                curr_write = fat->cluster_byte_size - cluster_offset;
+            if (!cluster_is_valid(file->cblk)) {
+                break;
             }
 
-            fat->curr_sector = -1;
-            int err = dev_read(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_write;
+            // 每次写的数据量取决于当前扇区中剩余的空间，以及size的量综合，不超出簇链
+            curr_write = nbytes;
+            if (curr_write > alloc_end - file->pos) {
+                curr_write = alloc_end - file->pos;
             }
-            kernel_memcpy(fat->fat_buffer + cluster_offset, buf, curr_write);        
-            
-            // 写整个簇，然后从中拷贝
-            err = dev_write(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_write;
+
+            uint32_t sector_offset = file->pos % fat->bytes_per_sec;
+            uint32_t start_sector = cluster_first_sector(fat, file->cblk) + (file->pos % fat->cluster_byte_size) / fat->bytes_per_sec;
+            cluster_t last = file->cblk;
+
+            if ((sector_offset == 0) && (curr_write >= fat->bytes_per_sec)) {
+                // 整扇区, 连续的扇区一次写出
+                mutex_lock(&fat->mutex);
+                int cnt = file_sector_run(fat, file, curr_write, &last);
+                mutex_unlock(&fat->mutex);
+
+                if (dev_write(fat->fs->dev_id, start_sector, buf, cnt) < cnt) {
+                    return total_write;
+                }
+                curr_write = cnt * fat->bytes_per_sec;
+            } else {
+                // 如果跨扇区，只写第一个扇区内的一部分
+                if (sector_offset + curr_write > fat->bytes_per_sec) {
+                    curr_write = fat->bytes_per_sec - sector_offset;
+                }
+
+                // 扇区中已有文件数据时才需要先读出，否则直接清空
+                uint8_t * io_buf = io_buf_alloc(fat);
+                int cnt = 1;
+                if (file->pos - sector_offset < inode->size) {
+                    cnt = dev_read(fat->fs->dev_id, start_sector, io_buf, 1);
+                } else {
+                    kernel_memset(io_buf, 0, fat->bytes_per_sec);
+                }
+
+                if (cnt == 1) {
+                    kernel_memcpy(io_buf + sector_offset, buf, curr_write);
+                    cnt = dev_write(fat->fs->dev_id, start_sector, io_buf, 1);
+                }
+                io_buf_free(fat, io_buf);
+                if (cnt < 1) {
+                    return total_write;
+                }
             }
+
+            // 前移文件指针
+            mutex_lock(&fat->mutex);
+            move_file_pos(file, fat, last, curr_write);
+            mutex_unlock(&fat->mutex);
         }
 
         buf += curr_write;
         nbytes -= curr_write;
         total_write += curr_write;
-        file->size += curr_write;
 
-        // 前移文件指针
-		int err = move_file_pos(file, fat, curr_write, 1);
-		if (err < 0) {
-            return total_write;
+        // 超出原文件末尾则更新文件大小
+        if (file->pos > inode->size) {
+            inode->size = file->pos;
+            inode_set_dirty(inode);
         }
     }
 
@@ -686,78 +2181,270 @@ int fatfs_write (char * buf, int size, file_t * file) {
 }
 
 /**
- * @brief 关闭文件
+ * @brief 回写文件的所有修改：暂存的数据、目录项中的大小和起始簇，以及FAT表
+ * 调用者持有文件锁
  */
-void fatfs_close (file_t * file) {
-    if (file->mode == O_RDONLY) {
-        return;
+static int inode_flush (fat_t * fat, inode_t * inode) {
+    int err = 0;
+
+    // 暂存的数据先分配簇并写入，之后目录项中的起始簇才是确定的
+    if (inode->dlen && (delay_flush(fat, inode, 1) < 0)) {
+        err = -1;
+    }
+
+    mutex_lock(&fat->mutex);
+    if (inode->dirty) {
+        // 大小和起始簇保存在共享的inode中，回写最新的值
+        diritem_t * item = read_dir_entry(fat, inode->p_dir, inode->p_index);
+        if (item == (diritem_t *)0) {
+            mutex_unlock(&fat->mutex);
+            return -1;
+        }
+
+        // 数据回写失败时，目录项中的大小只计入已写入簇链的部分，仍在缓存中的下次再更新
+        item->DIR_FileSize = inode->size - inode->dlen;
+        diritem_set_cluster(item, inode->sblk);
+        if (write_dir_entry(fat, inode->p_dir, item, inode->p_index) < 0) {
+            err = -1;
+        } else if (!inode->dlen) {
+            inode->dirty = 0;
+        }
+    }
+
+    // 文件写期间的簇链修改，与目录项一起回写
+    if (fat_tbl_flush(fat) < 0) {
+        err = -1;
     }
+    mutex_unlock(&fat->mutex);
+    return err;
+}
 
+/**
+ * @brief 关闭文件，回写文件的所有修改
+ * 最后一个打开者回写失败时，之后inode即被释放：丢弃暂存的数据，归还预留的簇，返回-1
+ * 调用者只持有文件锁，与fsync相同，写磁盘期间不持有fat->mutex
+ */
+int fatfs_close (file_t * file) {
     fat_t * fat = (fat_t *)file->fs->data;
+    inode_t * inode = file->inode;
 
-    diritem_t * item = read_dir_entry(fat, file->p_index);
-    if (item == (diritem_t *)0) {
-        return;
+    if (!inode->dirty && !inode->dlen) {
+        return 0;
+    }
+
+    if (inode_flush(fat, inode) < 0) {
+        if (inode->ref == 1) {
+            log_level_printf(LOG_ERR, "fatfs: flush %s on close failed, %d bytes lost", file->file_name, inode->dlen);
+            mutex_lock(&fat->mutex);
+            fat->resv_cnt -= inode->resv;
+            mutex_unlock(&fat->mutex);
+            inode->resv = 0;
+            inode->dlen = 0;
+            inode->dirty = 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 将文件的修改回写到磁盘
+ * FAT中没有访问时间等可以推迟回写的属性，fdatasync也同样处理
+ */
+int fatfs_fsync (file_t * file) {
+    return inode_flush((fat_t *)file->fs->data, file->inode);
+}
+
+/**
+ * @brief 回写文件系统中已打开文件的修改，age为修改至少已存在的tick数，为0时全部回写
+ */
+int fatfs_sync (struct _fs_t * fs, int age) {
+    fat_t * fat = (fat_t *)fs->data;
+    uint32_t now = time_get_tick();
+    int err = 0;
+
+    // 持有引用，遍历期间inode不会被释放；先取文件锁，与读写的加锁顺序相同
+    int index = 0;
+    inode_t * inode;
+    while ((inode = inode_next(fs, &index)) != (inode_t *)0) {
+        mutex_lock(&inode->mutex);
+        if ((inode->dirty || inode->dlen) && (now - inode->dirty_tick >= (uint32_t)age)) {
+            if (inode_flush(fat, inode) < 0) {
+                err = -1;
+            }
+        }
+        mutex_unlock(&inode->mutex);
+        inode_put(inode);
     }
 
-    item->DIR_FileSize = file->size;
-    item->DIR_FstClusHI = (uint16_t )(file->sblk >> 16);
-    item->DIR_FstClusL0 = (uint16_t )(file->sblk & 0xFFFF);
-    write_dir_entry(fat, item, file->p_index);
+    // 目录操作等对FAT表的修改
+    mutex_lock(&fat->mutex);
+    if (fat_tbl_flush(fat) < 0) {
+        err = -1;
+    }
+    mutex_unlock(&fat->mutex);
+    return err;
 }
 
 /**
- * @brief 文件读写位置的调整
- * dir: ???????
+ * @brief 文件读写位置的调整，返回调整后的位置
+ * dir: FS_SEEK_SET、FS_SEEK_CUR、FS_SEEK_END，offset可以为负
+ * 只能在文件范围内定位，写入时不支持填充文件中的空洞
  */
 int fatfs_seek (file_t * file, uint32_t offset, int dir) {
-     // 只支持基于文件开头的定位
-    if (dir != 0) {
+    fat_t * fat = (fat_t *)file->fs->data;
+    inode_t * inode = file->inode;
+
+    int pos;
+    switch (dir) {
+    case FS_SEEK_SET:
+        pos = (int)offset;
+        break;
+    case FS_SEEK_CUR:
+        pos = file->pos + (int)offset;
+        break;
+    case FS_SEEK_END:
+        pos = inode->size + (int)offset;
+        break;
+    default:
         return -1;
     }
 
-    fat_t * fat = (fat_t *)file->fs->data;
-    cluster_t curr_cluster = file->sblk;
-    uint32_t curr_pos = 0;
-    uint32_t offset_to_move = offset;
+    if ((pos < 0) || (pos > inode->size)) {
+        return -1;
+    }
 
-    while (offset_to_move > 0) {
-        uint32_t c_off = curr_pos % fat->cluster_byte_size;
-        uint32_t curr_move = offset_to_move;
+    // 由映射表直接查出所在的簇；刚好位于簇链末尾时为无效值，与读写后的状态一致
+    mutex_lock(&fat->mutex);
+    file->cblk = file_cluster_at(fat, inode, pos / fat->cluster_byte_size);
+    file->version = inode->version;
+    mutex_unlock(&fat->mutex);
 
-        // 不超过一簇，直接调整位置，无需跑到下一簇
-        if (c_off + curr_move < fat->cluster_byte_size) {
-            curr_pos += curr_move;
-            break;
-        }
+    file->pos = pos;
+    return pos;
+}
 
-        // 超过一簇，只在当前簇内移动
-        curr_move = fat->cluster_byte_size - c_off;
-        curr_pos += curr_move;
-        offset_to_move -= curr_move;
+/**
+ * @brief 计算目录占用的字节数，目录在FAT中没有记录大小，以其簇链的长度计算
+ * FAT16的根目录为固定区域
+ */
+static uint32_t dir_byte_size (fat_t * fat, cluster_t start) {
+    if (start == FAT_ROOT_CLUSTER) {
+        return fat->root_ent_cnt * sizeof(diritem_t);
+    }
 
-        // 取下一簇
-        curr_cluster = cluster_get_next(fat, curr_cluster);
-        if (!cluster_is_valid(curr_cluster)) {
-            return -1;
-        }
+    uint32_t size = 0;
+    for (cluster_t curr = start; cluster_is_valid(curr); curr = cluster_get_next(fat, curr)) {
+        size += fat->cluster_byte_size;
     }
+    return size;
+}
 
-    // 最后记录一下位置
-    file->pos = curr_pos;
-    file->cblk = curr_cluster;
-    return 0;
+/**
+ * @brief 填写文件信息中与时间无关的部分，块数以512字节为单位
+ * inode号取目录项在磁盘上的位置，各项唯一；根目录没有目录项，为0
+ */
+static void stat_fill (fat_t * fat, struct stat * st, cluster_t dir, int index, file_type_t type, uint32_t size) {
+    int items_per_sec = fat->bytes_per_sec / sizeof(diritem_t);
+    int sector = dir_entry_sector(fat, dir, index);
+
+    st->st_dev = fat->fs->dev_id;
+    st->st_ino = (sector < 0) ? 0 : sector * items_per_sec + index % items_per_sec;
+    st->st_mode = (type == FILE_DIR) ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+    st->st_nlink = 1;
+    st->st_size = size;
+    st->st_blksize = fat->cluster_byte_size;
+    st->st_blocks = up2(size, fat->cluster_byte_size) / 512;
 }
 
+/**
+ * @brief 获取已打开文件的信息，全部取自内存中的inode，不访问磁盘
+ */
 int fatfs_stat (file_t * file, struct stat *st) {
-    return -1;
+    fat_t * fat = (fat_t *)file->fs->data;
+    inode_t * inode = file->inode;
+
+    mutex_lock(&fat->mutex);
+    stat_fill(fat, st, inode->p_dir, inode->p_index, inode->type, inode->size);
+    mutex_unlock(&fat->mutex);
+
+    st->st_atime = inode->atime;
+    st->st_mtime = inode->mtime;
+    st->st_ctime = inode->ctime;
+    return 0;
+}
+
+/**
+ * @brief 按路径获取文件或目录的信息
+ * 目录项通常已在dcache中，文件已打开时以inode中的信息为准，其中的大小可能还未回写
+ */
+int fatfs_path_stat (struct _fs_t * fs, const char * path, struct stat *st) {
+    fat_t * fat = (fat_t *)fs->data;
+    diritem_t item;
+    cluster_t p_dir;
+    int index;
+
+    const char * name = path_walk(fat, path, &p_dir);
+    if (name == (const char *)0) {
+        return -1;
+    }
+
+    // 根目录没有目录项
+    if (*name == '\0') {
+        stat_fill(fat, st, p_dir, -1, FILE_DIR, dir_byte_size(fat, p_dir));
+        return 0;
+    }
+
+    if (dir_find(fat, p_dir, name, &item, &index, (int *)0) < 0) {
+        return -1;
+    }
+
+    file_type_t type = diritem_get_type(&item);
+    inode_t * inode = inode_find(fs, p_dir, index);
+    uint32_t size = (inode && inode->valid) ? inode->size : item.DIR_FileSize;
+
+    if (type == FILE_DIR) {
+        cluster_t start = diritem_get_cluster(fat, &item);
+        size = dir_byte_size(fat, (start == FAT_CLUSTER_FREE) ? fat->root_cluster : start);
+    }
+
+    stat_fill(fat, st, p_dir, index, type, size);
+    st->st_atime = fat_time_to_unix(item.DIR_LastAccDate, 0);
+    st->st_mtime = fat_time_to_unix(item.DIR_WrtDate, item.DIR_WrtTime);
+    st->st_ctime = fat_time_to_unix(item.DIR_CrtDate, item.DIR_CrtTime);
+    return 0;
 }
 
 /**
- * @brief 打开目录。只是简单地读取位置重设为0
+ * @brief 打开目录，找到目录的起始簇，读取位置重设为0
  */
 int fatfs_opendir (struct _fs_t * fs, const char * name, DIR * dir) {
+    fat_t * fat = (fat_t *)fs->data;
+    cluster_t p_dir;
+
+    const char * last = path_walk(fat, name, &p_dir);
+    if (last == (const char *)0) {
+        return -1;
+    }
+
+    // 路径为空时即为根目录，否则还需进入最后一级
+    cluster_t start = p_dir;
+    if (*last != '\0') {
+        diritem_t item;
+        int index;
+
+        int err = dir_find(fat, p_dir, last, &item, &index, (int *)0);
+        if ((err < 0) || !(item.DIR_Attr & DIRITEM_ATTR_DIRECTORY)) {
+            return -1;
+        }
+        start = diritem_get_cluster(fat, &item);
+        if (start == FAT_CLUSTER_FREE) {
+            start = fat->root_cluster;
+        }
+    }
+
     dir->index = 0;
+    dir->start = start;
     return 0;
 }
 
@@ -767,9 +2454,12 @@ int fatfs_opendir (struct _fs_t * fs, const char * name, DIR * dir) {
 int fatfs_readdir (struct _fs_t * fs,DIR* dir, struct dirent * dirent) {
     fat_t * fat = (fat_t *)fs->data;
 
+    lfn_state_t lfn;
+    lfn.ord = -1;
+
     // 做一些简单的判断，检查
-    while (dir->index < fat->root_ent_cnt) {
-        diritem_t * item = read_dir_entry(fat, dir->index);
+    for (;;) {
+        diritem_t * item = read_dir_entry(fat, dir->start, dir->index);
         if (item == (diritem_t *)0) {
             return -1;
         }
@@ -779,14 +2469,23 @@ int fatfs_readdir (struct _fs_t * fs,DIR* dir, struct dirent * dirent) {
             break;
         }
 
-        // 只显示普通文件和目录，其它的不显示
-        if (item->DIR_Name[0] != DIRITEM_NAME_FREE) {
+        // 只显示普通文件和目录，其它的不显示。有长文件名时显示长文件名
+        if (item->DIR_Name[0] == DIRITEM_NAME_FREE) {
+            lfn.ord = -1;
+        } else if (diritem_is_lfn(item)) {
+            lfn_collect(&lfn, item);
+        } else {
+            const char * long_name = lfn_get_name(&lfn, item);
             file_type_t type = diritem_get_type(item);
             if ((type == FILE_NORMAL) || (type == FILE_DIR)) {
                 dirent->index = dir->index++;
                 dirent->type = diritem_get_type(item);
                 dirent->size = item->DIR_FileSize;
-                diritem_get_name(item, dirent->name);
+                if (long_name) {
+                    kernel_strncpy(dirent->name, long_name, sizeof(dirent->name));
+                } else {
+                    diritem_get_name(item, dirent->name);
+                }
                 return 0;
             }
         }
@@ -805,52 +2504,131 @@ int fatfs_closedir (struct _fs_t * fs,DIR *dir) {
 }
 
 /**
- * @brief 删除文件
+ * @brief 删除文件，目录需要使用rmdir删除
  */
 int fatfs_unlink (struct _fs_t * fs, const char * path) {
     fat_t * fat = (fat_t *)fs->data;
+    diritem_t item;
+    cluster_t p_dir;
+    int index;
 
-    // 遍历根目录的数据区，找到已经存在的匹配项
-    for (int i = 0; i < fat->root_ent_cnt; i++) {
-        diritem_t * item = read_dir_entry(fat, i);
-        if (item == (diritem_t *)0) {
-            return -1;
-        }
+    const char * name = path_walk(fat, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
 
-         // 结束项，不需要再扫描了，同时index也不能往前走
-        if (item->DIR_Name[0] == DIRITEM_NAME_END) {
-            break;
-        }
+    int err = dir_find(fat, p_dir, name, &item, &index, (int *)0);
+    if ((err < 0) || (item.DIR_Attr & DIRITEM_ATTR_DIRECTORY)) {
+        return -1;
+    }
 
-        // 只显示普通文件和目录，其它的不显示
-        if (item->DIR_Name[0] == DIRITEM_NAME_FREE) {
-            continue;
-        }
+    // 文件仍被打开时，其簇链还在使用中
+    if (inode_find(fs, p_dir, index)) {
+        log_printf("file is busy.");
+        return -1;
+    }
+
+    return dir_remove_entry(fat, p_dir, &item, index);
+}
 
-        // 找到要打开的目录
-        if (diritem_name_match(item, path)) {
-            // 释放簇
-            int cluster = (item->DIR_FstClusHI << 16) | item->DIR_FstClusL0;
-            cluster_free_chain(fat, cluster);
+/**
+ * @brief 创建目录
+ * 为新目录分配一个簇，写入指向自身的.项和指向父目录的..项
+ */
+int fatfs_mkdir (struct _fs_t * fs, const char * path) {
+    fat_t * fat = (fat_t *)fs->data;
+    diritem_t item;
+    cluster_t p_dir;
+    int index, free_index;
 
-            // 写diritem项
-            diritem_t item;
-            kernel_memset(&item, 0, sizeof(diritem_t));
-            return write_dir_entry(fat, &item, i);
-        }
+    const char * name = path_walk(fat, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
     }
 
-    return -1;
-}
+    // 已经存在同名的文件或目录
+    if (dir_find(fat, p_dir, name, &item, &index, &free_index) == 0) {
+        return -1;
+    }
 
+    cluster_t cluster = cluster_alloc_free(fat, 1);
+    if (!cluster_is_valid(cluster)) {
+        log_printf("no cluster for mkdir");
+        return -1;
+    }
 
+    // 新目录簇的内容：.和..，其余全为结束项
+    fat->curr_sector = -1;
+    kernel_memset(fat->fat_buffer, 0, fat->cluster_byte_size);
+    diritem_t * dot = (diritem_t *)fat->fat_buffer;
+    diritem_init(dot, DIRITEM_ATTR_DIRECTORY, "");
+    kernel_memcpy(dot->DIR_Name, ".          ", SFN_LEN);
+    diritem_set_cluster(dot, cluster);
+
+    diritem_t * dotdot = dot + 1;
+    diritem_init(dotdot, DIRITEM_ATTR_DIRECTORY, "");
+    kernel_memcpy(dotdot->DIR_Name, "..         ", SFN_LEN);
+    diritem_set_cluster(dotdot, (p_dir == fat->root_cluster) ? FAT_CLUSTER_FREE : p_dir);
+
+    int cnt = dev_write(fat->fs->dev_id, cluster_first_sector(fat, cluster), fat->fat_buffer, fat->sec_per_cluster);
+    if (cnt < fat->sec_per_cluster) {
+        goto mkdir_failed;
+    }
 
+    // 在父目录中添加该目录的项
+    kernel_memset(&item, 0, sizeof(diritem_t));
+    diritem_init(&item, DIRITEM_ATTR_DIRECTORY, name);
+    diritem_set_cluster(&item, cluster);
+    int err = dir_add_entry(fat, p_dir, name, &item, free_index);
+    if (err < 0) {
+        goto mkdir_failed;
+    }
 
+    return fat_tbl_flush(fat);
 
+mkdir_failed:
+    log_printf("mkdir failed.");
+    cluster_free_chain(fat, cluster);
+    fat_tbl_flush(fat);
+    return -1;
+}
 
+/**
+ * @brief 删除目录，目录中只能有.和..两项
+ */
+int fatfs_rmdir (struct _fs_t * fs, const char * path) {
+    fat_t * fat = (fat_t *)fs->data;
+    diritem_t item;
+    cluster_t p_dir;
+    int index;
 
+    const char * name = path_walk(fat, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
 
+    int err = dir_find(fat, p_dir, name, &item, &index, (int *)0);
+    if ((err < 0) || !(item.DIR_Attr & DIRITEM_ATTR_DIRECTORY)) {
+        return -1;
+    }
 
+    // 检查目录是否为空
+    cluster_t start = diritem_get_cluster(fat, &item);
+    for (int i = 0; ; i++) {
+        diritem_t * curr = read_dir_entry(fat, start, i);
+        if ((curr == (diritem_t *)0) || (curr->DIR_Name[0] == DIRITEM_NAME_END)) {
+            break;
+        }
 
+        // 短文件名不会以.开头，只有.和..两项
+        if ((curr->DIR_Name[0] == DIRITEM_NAME_FREE) || (curr->DIR_Name[0] == '.')
+                || (curr->DIR_Attr & DIRITEM_ATTR_VOLUME_ID)) {
+            continue;
+        }
 
+        log_printf("dir not empty.");
+        return -1;
+    }
 
+    return dir_remove_entry(fat, p_dir, &item, index);
+}
@@ -7,23 +7,31 @@
 #include <sys/stat.h>
 #include "dev/console.h"
 #include "fs/file.h"
+#include "fs/inode.h"
 #include "tools/log.h"
 #include "dev/dev.h"
 #include <sys/file.h>
 #include "dev/disk.h"
 #include "os_cfg.h"
+#include "core/memory.h"
+#include "dev/time.h"
+#include "cpu/irq.h"
 
 #define FS_TABLE_SIZE		10		// 文件系统表数量
+#define SENDFILE_BUF_PAGES	16		// 文件之间直接复制时使用的内核缓存页数
 
 static list_t mounted_list;			   // 已挂载的文件系统
 static list_t free_list;		       // 空闲fs列表
 static fs_t   fs_tbl[FS_TABLE_SIZE];   // 文件系统列表，提前申请好内存，在文件系统初始化时将fs_tbl中所有元素都加入free_list中
                                        // 当需要挂载文件系统时，在free_list中取一个空闲表项加入mounted_list即可。
 static fs_t * root_fs;				   // 根文件系统
+static task_t writeback_task;		   // 回写任务，定期回写已有一段时间的文件修改
 
 
 extern fs_op_t devfs_op;
 extern fs_op_t fatfs_op;
+extern fs_op_t tmpfs_op;
+extern fs_op_t initramfs_op;
 
 
 
@@ -32,9 +40,13 @@ extern fs_op_t fatfs_op;
 // static fs_op_t * get_fs_op (fs_type_t type, int major);
 // static fs_t * mount (fs_type_t type, char * mount_point, int dev_major, int dev_minor);
 // static void mount_list_init (void);
+// static int path_append (char * full, int * len, const char * path);
+// static int path_make_full (const char * path, char * full);
+// static fs_t * path_to_fs (const char * full, const char ** rest);
+// static fs_t * dir_get_fs (DIR * dir);
 
 
-void         fs_init         (void);
+void         fs_init         (boot_info_t * boot_info);
 int          path_to_num     (const char * path, int * num);
 int          path_begin_with (const char * path, const char * str);
 const char * path_next_child (const char * path);
@@ -42,22 +54,44 @@ const char * path_next_child (const char * path);
 
 // static void fs_protect (fs_t * fs);
 // static void fs_unprotect (fs_t * fs);
+// static void file_protect (file_t * file);
+// static void file_unprotect (file_t * file);
 
 
 // 虚拟文件系统接口
 int sys_open     (const char *name, int flags, ...);
 int sys_dup      (int file);
 int sys_ioctl    (int fd, int cmd, int arg0, int arg1);
+int sys_poll     (struct pollfd * fds, int nfds, int timeout);
 int sys_read     (int file, char *ptr, int len);
 int sys_write    (int file, char *ptr, int len);
 int sys_lseek    (int file, int ptr, int dir);
 int sys_close    (int file);
 int sys_isatty   (int file);
 int sys_fstat    (int file, struct stat *st);
+int sys_stat     (const char * path, struct stat *st);
 int sys_opendir  (const char * name, DIR * dir);
 int sys_readdir  (DIR* dir, struct dirent * dirent);
 int sys_closedir (DIR *dir);
 int sys_unlink   (const char * path);
+int sys_mkdir    (const char * path);
+int sys_rmdir    (const char * path);
+int sys_chdir    (const char * path);
+int sys_getcwd   (char * buf, int size);
+// static file_t * file_get_rw (int file, int write);
+// static int file_rw_vec (file_t * file, const struct iovec * iov, int iovcnt, int write);
+// static int file_rw_at (file_t * file, char * ptr, int len, int offset, int write);
+int sys_readv    (int file, const struct iovec * iov, int iovcnt);
+int sys_writev   (int file, const struct iovec * iov, int iovcnt);
+int sys_pread    (int file, char * ptr, int len, int offset);
+int sys_pwrite   (int file, char * ptr, int len, int offset);
+int sys_sendfile (int out, int in, int * offset, int count);
+int sys_fsync    (int file);
+int sys_fdatasync(int file);
+int sys_sync     (void);
+// static void fs_sync_all (int age);
+// static void writeback_task_entry (void);
+void fs_writeback_init (void);
 
 
 
@@ -85,9 +119,14 @@ static int is_fd_bad (int file) {
 static fs_op_t * get_fs_op (fs_type_t type, int major) {
 	switch (type) {
 	case FS_FAT16:
+	case FS_FAT32:
 		return &fatfs_op;
 	case FS_DEVFS:
 		return &devfs_op;
+	case FS_TMPFS:
+		return &tmpfs_op;
+	case FS_INITRAMFS:
+		return &initramfs_op;
 	default:
 		return (fs_op_t *)0;
 	}
@@ -96,7 +135,7 @@ static fs_op_t * get_fs_op (fs_type_t type, int major) {
 
 /**
  * @brief 挂载文件系统
- * param1: 文件系统类型，比如：FS_DEVFS、FS_FAT16
+ * param1: 文件系统类型，比如：FS_DEVFS、FS_FAT16。FAT16和FAT32由fatfs挂载时自动识别
  * param2: 挂载点，比如："/dev"、"/home"
  * param3: 主设备号，比如：0
  * param4: 次设备号，比如：0
@@ -167,9 +206,10 @@ static void mount_list_init (void) {
 /**
  * @brief 文件系统初始化
  */
-void fs_init (void) {
+void fs_init (boot_info_t * boot_info) {
 	mount_list_init();
     file_table_init();   // 文件描述符表初始化
+    inode_table_init();
 
 	// 磁盘检查
 	disk_init();
@@ -181,6 +221,15 @@ void fs_init (void) {
 	// 挂载根文件系统
 	root_fs = mount(FS_FAT16, "/home", ROOT_DEV);
 	ASSERT(root_fs != (fs_t *)0);
+
+	// 挂载内存文件系统，存放临时文件，内存不足时没有/tmp，不影响其它功能
+	mount(FS_TMPFS, "/tmp", 0, 0);
+
+	// 挂载loader读入内存的initrd，其中为各应用程序，启动时运行程序不必再读磁盘
+	// initramfs没有设备，两个参数为镜像的地址和大小
+	if (boot_info->initrd_size) {
+		mount(FS_INITRAMFS, "/bin", (int)boot_info->initrd_start, (int)boot_info->initrd_size);
+	}
 }
 
 /**
@@ -222,6 +271,118 @@ const char * path_next_child (const char * path) {
     return *c ? c : (const char *)0;
 }
 
+/**
+ * @brief 将path中的各级名称逐个追加到full中，full中各级名称均以/开头，len为其当前长度
+ * 遇到.跳过，遇到..则退回上一级，已在根目录时保持不变
+ */
+static int path_append (char * full, int * len, const char * path) {
+	while (*path) {
+		while (*path == '/') {
+			path++;
+		}
+
+		// 取出一级名称
+		const char * name = path;
+		int name_len = 0;
+		while (name[name_len] && (name[name_len] != '/')) {
+			name_len++;
+		}
+		path += name_len;
+
+		if ((name_len == 0) || ((name_len == 1) && (name[0] == '.'))) {
+			continue;
+		}
+
+		if ((name_len == 2) && (name[0] == '.') && (name[1] == '.')) {
+			while ((*len > 0) && (full[*len - 1] != '/')) {
+				(*len)--;
+			}
+			if (*len > 0) {
+				(*len)--;
+			}
+			continue;
+		}
+
+		if (*len + 1 + name_len >= FS_PATH_SIZE) {
+			return -1;
+		}
+		full[(*len)++] = '/';
+		kernel_memcpy(full + *len, (void *)name, name_len);
+		*len += name_len;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief 生成以/开头的完整路径，相对路径基于当前任务的工作目录，同时去掉其中的.和..
+ * full的大小至少为FS_PATH_SIZE
+ */
+static int path_make_full (const char * path, char * full) {
+	int len = 0;
+
+	if (path[0] != '/') {
+		int err = path_append(full, &len, task_current()->cwd);
+		if (err < 0) {
+			return -1;
+		}
+	}
+
+	int err = path_append(full, &len, path);
+	if (err < 0) {
+		log_printf("path too long.");
+		return -1;
+	}
+
+	// 根目录
+	if (len == 0) {
+		full[len++] = '/';
+	}
+	full[len] = '\0';
+	return 0;
+}
+
+/**
+ * @brief 查找完整路径所在的文件系统，rest返回在该文件系统中的路径
+ * 不在任何挂载点之下的路径，均认为在根文件系统中
+ */
+static fs_t * path_to_fs (const char * full, const char ** rest) {
+	list_node_t * node = list_first(&mounted_list);
+	while (node) {
+		fs_t * curr = list_node_parent(node, fs_t, node);
+		if (path_begin_with(full, curr->mount_point)) {
+			// 挂载点需是完整的一级目录，如/dev不匹配/devices
+			const char * c = full + kernel_strlen(curr->mount_point);
+			if ((*c == '\0') || (*c == '/')) {
+				while (*c == '/') {
+					c++;
+				}
+				*rest = c;
+				return curr;
+			}
+		}
+		node = list_node_next(node);
+	}
+
+	*rest = full + 1;
+	return root_fs;
+}
+
+/**
+ * @brief 获取目录所在的文件系统，该值由sys_opendir填写，需检查其有效性
+ */
+static fs_t * dir_get_fs (DIR * dir) {
+	if ((dir->fs < 0) || (dir->fs >= FS_TABLE_SIZE)) {
+		return (fs_t *)0;
+	}
+
+	fs_t * fs = fs_tbl + dir->fs;
+	if (!fs->op || !fs->op->opendir) {
+		return (fs_t *)0;
+	}
+	return fs;
+}
+
 static void fs_protect (fs_t * fs) {
 	if (fs->mutex) {
 		mutex_lock(fs->mutex);
@@ -234,6 +395,24 @@ static void fs_unprotect (fs_t * fs) {
 	}
 }
 
+/**
+ * @brief 文件数据的读写、定位只锁住该文件的inode，不同文件之间可以并行
+ * 文件系统的元数据(如FAT表)由其自身在需要时用fs->mutex保护，读写磁盘期间不持有。
+ * 没有inode的文件(如设备)自己负责同步，不加锁，以免阻塞在tty读上的任务挡住对同一文件的写
+ * 加锁顺序：先文件锁，后fs->mutex
+ */
+static void file_protect (file_t * file) {
+	if (file->inode) {
+		mutex_lock(&file->inode->mutex);
+	}
+}
+
+static void file_unprotect (file_t * file) {
+	if (file->inode) {
+		mutex_unlock(&file->inode->mutex);
+	}
+}
+
 /**
  * 打开文件
  * name: /dev 
@@ -250,24 +429,12 @@ int sys_open(const char *name, int flags, ...) {
 		goto sys_open_failed;
 	}
 
-	// 检查名称是否以挂载点开头，如果没有，则认为name在根目录下
-	// 即只允许根目录下的遍历
-	fs_t * fs = (fs_t *)0;
-	list_node_t * node = list_first(&mounted_list);
-	while (node) {
-		fs_t * curr = list_node_parent(node, fs_t, node);
-		if (path_begin_with(name, curr->mount_point)) {
-			fs = curr;
-			break;
-		}
-		node = list_node_next(node);
-	}
-
-	if (fs) {
-		name = path_next_child(name);
-	} else {
-		fs = root_fs;
+	// 转换为完整路径，再根据挂载点找到所在的文件系统
+	char full[FS_PATH_SIZE];
+	if (path_make_full(name, full) < 0) {
+		goto sys_open_failed;
 	}
+	fs_t * fs = path_to_fs(full, &name);
 
 	file->mode = flags;
 	file->fs = fs;
@@ -279,10 +446,27 @@ int sys_open(const char *name, int flags, ...) {
 		fs_unprotect(fs);
 
 		log_printf("open %s failed.", name);
-		return -1;
+		goto sys_open_failed;
 	}
 	fs_unprotect(fs);
 
+	// 截断要释放数据块，需先取文件锁，等待同一文件上正在进行的读写和回写完成
+	if ((flags & O_TRUNC) && fs->op->truncate) {
+		file_protect(file);
+		fs_protect(fs);
+		err = fs->op->truncate(file);
+		fs_unprotect(fs);
+		file_unprotect(file);
+
+		if (err < 0) {
+			log_printf("truncate %s failed.", name);
+			if (file->inode) {
+				inode_put(file->inode);
+			}
+			goto sys_open_failed;
+		}
+	}
+
 	return fd;
 
 sys_open_failed:
@@ -342,6 +526,70 @@ int sys_ioctl(int fd, int cmd, int arg0, int arg1) {
 	return err;
 }
 
+/**
+ * @brief 检查各文件上已就绪的事件，返回有事件的文件数量
+ */
+static int poll_check (struct pollfd * fds, int nfds) {
+	int cnt = 0;
+
+	for (int i = 0; i < nfds; i++) {
+		struct pollfd * pfd = fds + i;
+		pfd->revents = 0;
+		if (pfd->fd < 0) {
+			continue;
+		}
+
+		file_t * pfile = is_fd_bad(pfd->fd) ? (file_t *)0 : task_file(pfd->fd);
+		if (pfile == (file_t *)0) {
+			pfd->revents = POLLNVAL;
+		} else if (pfile->fs->op->poll) {
+			pfd->revents = pfile->fs->op->poll(pfile, pfd->events | POLLERR | POLLHUP);
+		} else {
+			// 普通文件总是可读写
+			pfd->revents = pfd->events & (POLLIN | POLLOUT);
+		}
+
+		if (pfd->revents) {
+			cnt++;
+		}
+	}
+	return cnt;
+}
+
+/**
+ * @brief 等待多个文件上的事件，timeout为毫秒数，小于0时一直等待，为0时只检查不等待
+ * 检查时不加文件系统锁：目前只有设备需要检查，其状态由中断保护。
+ * 检查与等待在同一中断保护中，设备在两者之间产生的事件不会丢失
+ */
+int sys_poll (struct pollfd * fds, int nfds, int timeout) {
+	if ((nfds < 0) || (nfds > TASK_OFILE_NR) || ((nfds > 0) && (fds == (struct pollfd *)0))) {
+		return -1;
+	}
+
+	uint32_t deadline = time_get_tick() + (timeout + OS_TICK_MS - 1) / OS_TICK_MS;
+
+	irq_state_t state = irq_enter_protection();
+	int cnt;
+	while (((cnt = poll_check(fds, nfds)) == 0) && timeout) {
+		int ms = -1;
+		if (timeout > 0) {
+			int left = (int)(deadline - time_get_tick());
+			if (left <= 0) {
+				break;
+			}
+			ms = left * OS_TICK_MS;
+		}
+
+		if (dev_poll_wait(ms) < 0) {
+			// 超时，最后再检查一次
+			cnt = poll_check(fds, nfds);
+			break;
+		}
+	}
+	irq_leave_protection(state);
+	return cnt;
+}
+
 /**
  * 读取文件api
  */
@@ -363,9 +611,9 @@ int sys_read(int file, char *ptr, int len) {
 
 	// 读取文件
 	fs_t * fs = p_file->fs;
-	fs_protect(fs);
+	file_protect(p_file);
 	int err = fs->op->read(ptr, len, p_file);
-	fs_unprotect(fs);
+	file_unprotect(p_file);
 	return err;
 }
 
@@ -393,9 +641,9 @@ int sys_write(int file, char *ptr, int len) {
 
 	// 写入文件
 	fs_t * fs = p_file->fs;
-	fs_protect(fs);
+	file_protect(p_file);
 	int err = fs->op->write(ptr, len, p_file);
-	fs_unprotect(fs);
+	file_unprotect(p_file);
 	return err;
 }
 
@@ -416,9 +664,9 @@ int sys_lseek(int file, int ptr, int dir) {
 	// 写入文件
 	fs_t * fs = p_file->fs;
 
-	fs_protect(fs);
+	file_protect(p_file);
 	int err = fs->op->seek(p_file, ptr, dir);
-	fs_unprotect(fs);
+	file_unprotect(p_file);
 	return err;
 }
 
@@ -439,17 +687,25 @@ int sys_close(int file) {
 
 	ASSERT(p_file->ref > 0);
 
+	int err = 0;
 	if (p_file->ref-- == 1) {
 		fs_t * fs = p_file->fs;
 
-		fs_protect(fs);
-		fs->op->close(p_file);
-		fs_unprotect(fs);
+		// 关闭时回写文件的数据和信息，与fsync相同只持有文件锁，元数据由文件系统自己加锁保护
+		// 回写失败时仍然关闭，但返回错误
+		file_protect(p_file);
+		err = fs->op->close(p_file);
+		file_unprotect(p_file);
+
+		// 解锁后再释放，以免inode被重新分配时锁仍被占用
+		if (p_file->inode) {
+			inode_put(p_file->inode);
+		}
 	    file_free(p_file);
 	}
 
 	task_remove_fd(file);
-	return 0;
+	return err;
 }
 
 
@@ -486,36 +742,425 @@ int sys_fstat(int file, struct stat *st) {
 
     kernel_memset(st, 0, sizeof(struct stat));
 
-	fs_protect(fs);
+	file_protect(p_file);
 	int err = fs->op->stat(p_file, st);
+	file_unprotect(p_file);
+	return err;
+}
+
+/**
+ * @brief 按路径获取文件或目录的状态，不需要打开文件
+ */
+int sys_stat (const char * path, struct stat *st) {
+	char full[FS_PATH_SIZE];
+	if (path_make_full(path, full) < 0) {
+		return -1;
+	}
+
+	fs_t * fs = path_to_fs(full, &path);
+	if (!fs->op->path_stat) {
+		return -1;
+	}
+
+	kernel_memset(st, 0, sizeof(struct stat));
+
+	fs_protect(fs);
+	int err = fs->op->path_stat(fs, path, st);
 	fs_unprotect(fs);
 	return err;
 }
 
+/**
+ * @brief 打开目录，记录目录所在的文件系统供后续的读取使用
+ */
 int sys_opendir(const char * name, DIR * dir) {
-	fs_protect(root_fs);
-	int err = root_fs->op->opendir(root_fs, name, dir);
-	fs_unprotect(root_fs);
+	char full[FS_PATH_SIZE];
+	if (path_make_full(name, full) < 0) {
+		return -1;
+	}
+
+	const char * path;
+	fs_t * fs = path_to_fs(full, &path);
+	if (!fs->op->opendir) {
+		return -1;
+	}
+
+	dir->fs = fs - fs_tbl;
+	fs_protect(fs);
+	int err = fs->op->opendir(fs, path, dir);
+	fs_unprotect(fs);
 	return err;
 }
 
 int sys_readdir(DIR* dir, struct dirent * dirent) {
-	fs_protect(root_fs);
-	int err = root_fs->op->readdir(root_fs, dir, dirent);
-	fs_unprotect(root_fs);
+	fs_t * fs = dir_get_fs(dir);
+	if (!fs) {
+		return -1;
+	}
+
+	fs_protect(fs);
+	int err = fs->op->readdir(fs, dir, dirent);
+	fs_unprotect(fs);
 	return err;
 }
 
 int sys_closedir(DIR *dir) {
-	fs_protect(root_fs);
-	int err = root_fs->op->closedir(root_fs, dir);
-	fs_unprotect(root_fs);
+	fs_t * fs = dir_get_fs(dir);
+	if (!fs) {
+		return -1;
+	}
+
+	fs_protect(fs);
+	int err = fs->op->closedir(fs, dir);
+	fs_unprotect(fs);
 	return err;
 }
 
 int sys_unlink (const char * path) {
-	fs_protect(root_fs);
-	int err = root_fs->op->unlink(root_fs, path);
-	fs_unprotect(root_fs);
+	char full[FS_PATH_SIZE];
+	if (path_make_full(path, full) < 0) {
+		return -1;
+	}
+
+	fs_t * fs = path_to_fs(full, &path);
+	if (!fs->op->unlink) {
+		return -1;
+	}
+
+	fs_protect(fs);
+	int err = fs->op->unlink(fs, path);
+	fs_unprotect(fs);
+	return err;
+}
+
+/**
+ * @brief 创建目录
+ */
+int sys_mkdir (const char * path) {
+	char full[FS_PATH_SIZE];
+	if (path_make_full(path, full) < 0) {
+		return -1;
+	}
+
+	fs_t * fs = path_to_fs(full, &path);
+	if (!fs->op->mkdir) {
+		return -1;
+	}
+
+	fs_protect(fs);
+	int err = fs->op->mkdir(fs, path);
+	fs_unprotect(fs);
 	return err;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 删除空目录
+ */
+int sys_rmdir (const char * path) {
+	char full[FS_PATH_SIZE];
+	if (path_make_full(path, full) < 0) {
+		return -1;
+	}
+
+	fs_t * fs = path_to_fs(full, &path);
+	if (!fs->op->rmdir) {
+		return -1;
+	}
+
+	fs_protect(fs);
+	int err = fs->op->rmdir(fs, path);
+	fs_unprotect(fs);
+	return err;
+}
+
+/**
+ * @brief 切换当前任务的工作目录，目标需是能够打开的目录
+ */
+int sys_chdir (const char * path) {
+	char full[FS_PATH_SIZE];
+	if (path_make_full(path, full) < 0) {
+		return -1;
+	}
+
+	if (kernel_strlen(full) >= TASK_CWD_SIZE) {
+		log_printf("path too long.");
+		return -1;
+	}
+
+	// 试着打开一下目录，检查其是否存在
+	DIR dir;
+	if (sys_opendir(full, &dir) < 0) {
+		return -1;
+	}
+	sys_closedir(&dir);
+
+	kernel_strncpy(task_current()->cwd, full, TASK_CWD_SIZE);
+	return 0;
+}
+
+/**
+ * @brief 获取当前任务的工作目录
+ */
+int sys_getcwd (char * buf, int size) {
+	const char * cwd = task_current()->cwd;
+	if (kernel_strlen(cwd) >= size) {
+		return -1;
+	}
+
+	kernel_strncpy(buf, cwd, size);
+	return 0;
+}
+
+/**
+ * @brief 取得用于读或写的已打开文件，打开方式不允许时返回0
+ */
+static file_t * file_get_rw (int file, int write) {
+	if (is_fd_bad(file)) {
+		return (file_t *)0;
+	}
+
+	file_t * p_file = task_file(file);
+	if (!p_file) {
+		log_printf("file not opened");
+		return (file_t *)0;
+	}
+
+	if (p_file->mode == (write ? O_RDONLY : O_WRONLY)) {
+		log_printf("file mode error");
+		return (file_t *)0;
+	}
+	return p_file;
+}
+
+/**
+ * @brief 按iov中的各段依次读写，整个过程只加一次文件锁，各段之间不会被同一文件的其它读写插入
+ * 某段未能读写完整时结束，返回已读写的总量
+ */
+static int file_rw_vec (file_t * file, const struct iovec * iov, int iovcnt, int write) {
+	fs_t * fs = file->fs;
+	int total = 0;
+
+	file_protect(file);
+	for (int i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len <= 0) {
+			continue;
+		}
+
+		char * ptr = (char *)iov[i].iov_base;
+		int cnt = write ? fs->op->write(ptr, iov[i].iov_len, file) : fs->op->read(ptr, iov[i].iov_len, file);
+		if (cnt < 0) {
+			total = total ? total : -1;
+			break;
+		}
+
+		total += cnt;
+		if (cnt < iov[i].iov_len) {
+			break;
+		}
+	}
+	file_unprotect(file);
+	return total;
+}
+
+/**
+ * @brief 在offset处读写，不改变文件当前的读写位置
+ * 在文件锁内临时定位再恢复，其它使用同一文件的读写看不到中间的位置
+ */
+static int file_rw_at (file_t * file, char * ptr, int len, int offset, int write) {
+	fs_t * fs = file->fs;
+	int cnt = -1;
+
+	file_protect(file);
+	int old_pos = file->pos;
+	if (fs->op->seek(file, offset, FS_SEEK_SET) >= 0) {
+		cnt = write ? fs->op->write(ptr, len, file) : fs->op->read(ptr, len, file);
+		fs->op->seek(file, old_pos, FS_SEEK_SET);
+	}
+	file_unprotect(file);
+	return cnt;
+}
+
+/**
+ * @brief 分散读：依次读入iov中的各段缓存
+ */
+int sys_readv (int file, const struct iovec * iov, int iovcnt) {
+	file_t * p_file = file_get_rw(file, 0);
+	if (!p_file || !iov || (iovcnt < 0)) {
+		return -1;
+	}
+
+	return file_rw_vec(p_file, iov, iovcnt, 0);
+}
+
+/**
+ * @brief 聚集写：依次写出iov中的各段缓存
+ */
+int sys_writev (int file, const struct iovec * iov, int iovcnt) {
+	file_t * p_file = file_get_rw(file, 1);
+	if (!p_file || !iov || (iovcnt < 0)) {
+		return -1;
+	}
+
+	return file_rw_vec(p_file, iov, iovcnt, 1);
+}
+
+/**
+ * @brief 从文件的offset处读取，不改变文件的读写位置
+ */
+int sys_pread (int file, char * ptr, int len, int offset) {
+	file_t * p_file = file_get_rw(file, 0);
+	if (!p_file || !ptr || (len < 0) || (offset < 0)) {
+		return -1;
+	}
+
+	return file_rw_at(p_file, ptr, len, offset, 0);
+}
+
+/**
+ * @brief 写入到文件的offset处，不改变文件的读写位置
+ */
+int sys_pwrite (int file, char * ptr, int len, int offset) {
+	file_t * p_file = file_get_rw(file, 1);
+	if (!p_file || !ptr || (len < 0) || (offset < 0)) {
+		return -1;
+	}
+
+	return file_rw_at(p_file, ptr, len, offset, 1);
+}
+
+/**
+ * @brief 在内核中将文件in的数据复制到文件out，返回复制的字节数
+ * offset不为0时从*offset处开始读，完成后更新*offset，in的读写位置不变；为0时从in的当前位置读
+ * 数据经内核缓存成批中转，不经过用户空间，每批最多SENDFILE_BUF_PAGES页。两个文件的锁不同时持有
+ */
+int sys_sendfile (int out, int in, int * offset, int count) {
+	file_t * in_file = file_get_rw(in, 0);
+	file_t * out_file = file_get_rw(out, 1);
+	if (!in_file || !out_file || (count < 0)) {
+		return -1;
+	}
+
+	char * buf = (char *)memory_alloc_pages(SENDFILE_BUF_PAGES);
+	if (buf == (char *)0) {
+		log_printf("no memory for sendfile");
+		return -1;
+	}
+
+	fs_t * in_fs = in_file->fs;
+	fs_t * out_fs = out_file->fs;
+	int pos = offset ? *offset : 0;
+	int total = 0;
+	while (total < count) {
+		int size = count - total;
+		if (size > SENDFILE_BUF_PAGES * MEM_PAGE_SIZE) {
+			size = SENDFILE_BUF_PAGES * MEM_PAGE_SIZE;
+		}
+
+		// 指定了位置时，临时移到该处读取，读完再恢复原来的位置
+		file_protect(in_file);
+		int old_pos = in_file->pos;
+		int cnt = -1;
+		if (!offset || (in_fs->op->seek(in_file, pos, FS_SEEK_SET) >= 0)) {
+			cnt = in_fs->op->read(buf, size, in_file);
+		}
+		if (offset) {
+			in_fs->op->seek(in_file, old_pos, FS_SEEK_SET);
+		}
+		file_unprotect(in_file);
+		if (cnt <= 0) {
+			break;
+		}
+
+		file_protect(out_file);
+		int err = out_fs->op->write(buf, cnt, out_file);
+		file_unprotect(out_file);
+
+		// 只有写出去的部分才算完成
+		if (err > 0) {
+			pos += err;
+			total += err;
+		}
+		if (err < cnt) {
+			break;
+		}
+	}
+
+	if (offset) {
+		*offset = pos;
+	}
+	memory_free_pages((uint32_t)buf, SENDFILE_BUF_PAGES);
+	return total;
+}
+
+/**
+ * @brief 将文件的修改回写到磁盘，返回后数据和文件信息已写入
+ */
+int sys_fsync (int file) {
+	if (is_fd_bad(file)) {
+		return -1;
+	}
+
+	file_t * p_file = task_file(file);
+	if (p_file == (file_t *)0) {
+		return -1;
+	}
+
+	// 没有缓存的文件，如设备，无需回写
+	fs_t * fs = p_file->fs;
+	if (!fs->op->fsync) {
+		return 0;
+	}
+
+	file_protect(p_file);
+	int err = fs->op->fsync(p_file);
+	file_unprotect(p_file);
+	return err;
+}
+
+/**
+ * @brief 只回写访问数据所必需的部分。目前的文件系统没有可以推迟的属性，与fsync相同
+ */
+int sys_fdatasync (int file) {
+	return sys_fsync(file);
+}
+
+/**
+ * @brief 回写所有文件系统中修改已存在至少age个tick的文件，age为0时全部回写
+ */
+static void fs_sync_all (int age) {
+	list_node_t * node = list_first(&mounted_list);
+	while (node) {
+		fs_t * fs = list_node_parent(node, fs_t, node);
+		if (fs->op->sync) {
+			fs->op->sync(fs, age);
+		}
+		node = list_node_next(node);
+	}
+}
+
+/**
+ * @brief 回写所有文件系统的修改。与sync()相同不报告错误，总是返回0
+ */
+int sys_sync (void) {
+	fs_sync_all(0);
+	return 0;
+}
+
+/**
+ * @brief 回写任务：由定时器唤醒，周期性地回写修改已超过FS_WRITEBACK_AGE_MS的文件
+ */
+static void writeback_task_entry (void) {
+	for (;;) {
+		sys_msleep(FS_WRITEBACK_PERIOD_MS);
+		fs_sync_all(FS_WRITEBACK_AGE_MS / OS_TICK_MS);
+	}
+}
+
+/**
+ * @brief 创建回写任务，运行于内核模式。需在任务管理器初始化后调用
+ */
+void fs_writeback_init (void) {
+	int err = task_init(&writeback_task, "writeback", TASK_FLAG_SYSTEM, (uint32_t)writeback_task_entry, 0);
+	ASSERT(err == 0);
+	task_start(&writeback_task);
+}
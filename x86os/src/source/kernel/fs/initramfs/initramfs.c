@@ -0,0 +1,401 @@
+
+#include "fs/initramfs/initramfs.h"
+#include "fs/fs.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <sys/fcntl.h>
+#include <sys/stat.h>
+
+#define INITRAMFS_ROOT          -1          // 根目录没有文件头，以-1表示
+
+
+
+// static tar_header_t * entry_at (initramfs_t * ramfs, int offset);
+// static int entry_next (tar_header_t * hdr, int offset);
+// static int entry_name (tar_header_t * hdr, const char ** name);
+// static file_type_t entry_type (tar_header_t * hdr);
+// static tar_header_t * entry_find (initramfs_t * ramfs, const char * path, int * offset);
+// static void stat_fill (struct stat * st, tar_header_t * hdr, int offset);
+
+int  initramfs_mount    (struct _fs_t * fs, int dev_major, int dev_minor);
+void initramfs_unmount  (struct _fs_t * fs);
+int  initramfs_open     (struct _fs_t * fs, const char * path, file_t * file);
+int  initramfs_read     (char * buf, int size, file_t * file);
+int  initramfs_write    (char * buf, int size, file_t * file);
+int  initramfs_close    (file_t * file);
+int  initramfs_seek     (file_t * file, uint32_t offset, int dir);
+int  initramfs_stat     (file_t * file, struct stat *st);
+int  initramfs_path_stat (struct _fs_t * fs, const char * path, struct stat *st);
+int  initramfs_opendir  (struct _fs_t * fs, const char * name, DIR * dir);
+int  initramfs_readdir  (struct _fs_t * fs, DIR* dir, struct dirent * dirent);
+int  initramfs_closedir (struct _fs_t * fs, DIR *dir);
+
+
+
+/**
+ * @brief 取镜像中offset处的文件头，超出镜像或不是有效的文件头时返回0
+ */
+static tar_header_t * entry_at (initramfs_t * ramfs, int offset) {
+    if ((offset < 0) || (offset % TAR_BLOCK_SIZE) || (offset + TAR_BLOCK_SIZE > ramfs->size)) {
+        return (tar_header_t *)0;
+    }
+
+    tar_header_t * hdr = (tar_header_t *)(ramfs->start + offset);
+    return tar_header_valid(hdr) ? hdr : (tar_header_t *)0;
+}
+
+/**
+ * @brief 计算下一个文件头的位置，数据按块补齐
+ */
+static int entry_next (tar_header_t * hdr, int offset) {
+    uint32_t size = tar_octal(hdr->size, sizeof(hdr->size));
+    return offset + TAR_BLOCK_SIZE + up2(size, TAR_BLOCK_SIZE);
+}
+
+/**
+ * @brief 取文件头中的路径，去掉开头的./和目录末尾的/，返回其长度
+ * 路径占满整个字段时没有结束符
+ */
+static int entry_name (tar_header_t * hdr, const char ** name) {
+    const char * start = hdr->name;
+    int len = 0;
+    while ((len < sizeof(hdr->name)) && start[len]) {
+        len++;
+    }
+
+    if ((len >= 2) && (start[0] == '.') && (start[1] == '/')) {
+        start += 2;
+        len -= 2;
+    }
+    while ((len > 0) && (start[len - 1] == '/')) {
+        len--;
+    }
+
+    *name = start;
+    return len;
+}
+
+/**
+ * @brief 取文件类型，只支持普通文件和目录，其它如链接等为FILE_UNKNOWN
+ */
+static file_type_t entry_type (tar_header_t * hdr) {
+    switch (hdr->typeflag) {
+    case TAR_TYPE_NORMAL:
+    case '\0':
+        return FILE_NORMAL;
+    case TAR_TYPE_DIR:
+        return FILE_DIR;
+    default:
+        return FILE_UNKNOWN;
+    }
+}
+
+/**
+ * @brief 按路径查找文件或目录，offset返回其文件头在镜像中的位置
+ * 镜像中记录的是完整路径，直接整体比较，不需要逐级查找
+ */
+static tar_header_t * entry_find (initramfs_t * ramfs, const char * path, int * offset) {
+    int path_len = kernel_strlen(path);
+
+    tar_header_t * hdr;
+    for (int curr = 0; (hdr = entry_at(ramfs, curr)) != (tar_header_t *)0; curr = entry_next(hdr, curr)) {
+        const char * name;
+        int len = entry_name(hdr, &name);
+        if ((len == path_len) && (kernel_memcmp((void *)name, (void *)path, len) == 0)) {
+            *offset = curr;
+            return hdr;
+        }
+    }
+
+    return (tar_header_t *)0;
+}
+
+/**
+ * @brief 挂载initramfs
+ * 没有对应的设备，两个参数分别为镜像的起始地址和字节数，由loader读入内存
+ */
+int initramfs_mount (struct _fs_t * fs, int dev_major, int dev_minor) {
+    initramfs_t * ramfs = &fs->ramfs_data;
+    ramfs->start = (uint8_t *)dev_major;
+    ramfs->size = (uint32_t)dev_minor;
+    ramfs->file_cnt = 0;
+
+    if (!ramfs->start || !entry_at(ramfs, 0)) {
+        log_printf("mount initramfs failed: bad image.");
+        return -1;
+    }
+
+    // 统计文件数量，同时检查各文件的数据没有超出镜像
+    tar_header_t * hdr;
+    int offset;
+    for (offset = 0; (hdr = entry_at(ramfs, offset)) != (tar_header_t *)0; offset = entry_next(hdr, offset)) {
+        if (entry_next(hdr, offset) > ramfs->size) {
+            break;
+        }
+
+        if (entry_type(hdr) == FILE_NORMAL) {
+            ramfs->file_cnt++;
+        }
+    }
+    ramfs->size = offset;
+    log_printf("initramfs: %d files, %d bytes", ramfs->file_cnt, ramfs->size);
+
+    // 只读，不需要加锁
+    fs->mutex = (mutex_t *)0;
+    fs->dev_id = -1;
+    fs->type = FS_INITRAMFS;
+    fs->data = ramfs;
+    return 0;
+}
+
+/**
+ * @brief 卸载，镜像所在的内存由loader分配，一直保留
+ */
+void initramfs_unmount (struct _fs_t * fs) {
+}
+
+/**
+ * @brief 打开文件，只能以只读方式打开
+ * 文件的数据在内存中不会变化，多次打开之间不需要共享信息，所以不使用inode
+ */
+int initramfs_open (struct _fs_t * fs, const char * path, file_t * file) {
+    initramfs_t * ramfs = (initramfs_t *)fs->data;
+    int offset;
+
+    if (file->mode & (O_WRONLY | O_RDWR | O_CREAT | O_TRUNC | O_APPEND)) {
+        log_printf("initramfs is read only.");
+        return -1;
+    }
+
+    tar_header_t * hdr = entry_find(ramfs, path, &offset);
+    if (!hdr || (entry_type(hdr) != FILE_NORMAL)) {
+        return -1;
+    }
+
+    // cblk记录文件头在镜像中的位置
+    file->type = FILE_NORMAL;
+    file->pos = 0;
+    file->cblk = offset;
+    file->inode = (struct _inode_t *)0;
+    return 0;
+}
+
+/**
+ * @brief 读文件，直接从镜像中复制
+ */
+int initramfs_read (char * buf, int size, file_t * file) {
+    initramfs_t * ramfs = (initramfs_t *)file->fs->data;
+    tar_header_t * hdr = (tar_header_t *)(ramfs->start + file->cblk);
+    uint32_t file_size = tar_octal(hdr->size, sizeof(hdr->size));
+
+    if ((size <= 0) || (file->pos >= file_size)) {
+        return 0;
+    }
+
+    uint32_t nbytes = size;
+    if (file->pos + nbytes > file_size) {
+        nbytes = file_size - file->pos;
+    }
+
+    kernel_memcpy(buf, (uint8_t *)hdr + TAR_BLOCK_SIZE + file->pos, nbytes);
+    file->pos += nbytes;
+    return nbytes;
+}
+
+/**
+ * @brief 只读文件系统，不能写
+ */
+int initramfs_write (char * buf, int size, file_t * file) {
+    return -1;
+}
+
+/**
+ * @brief 关闭文件
+ */
+int initramfs_close (file_t * file) {
+    return 0;
+}
+
+/**
+ * @brief 文件读写定位，只能在文件范围之内
+ */
+int initramfs_seek (file_t * file, uint32_t offset, int dir) {
+    initramfs_t * ramfs = (initramfs_t *)file->fs->data;
+    tar_header_t * hdr = (tar_header_t *)(ramfs->start + file->cblk);
+    int file_size = (int)tar_octal(hdr->size, sizeof(hdr->size));
+
+    int pos;
+    switch (dir) {
+    case FS_SEEK_SET:
+        pos = (int)offset;
+        break;
+    case FS_SEEK_CUR:
+        pos = file->pos + (int)offset;
+        break;
+    case FS_SEEK_END:
+        pos = file_size + (int)offset;
+        break;
+    default:
+        return -1;
+    }
+
+    if ((pos < 0) || (pos > file_size)) {
+        return -1;
+    }
+
+    file->pos = pos;
+    return pos;
+}
+
+/**
+ * @brief 填写文件信息，以文件头所在的块号作为inode号，根目录没有文件头
+ */
+static void stat_fill (struct stat * st, tar_header_t * hdr, int offset) {
+    kernel_memset(st, 0, sizeof(struct stat));
+    st->st_dev = -1;
+    st->st_nlink = 1;
+    st->st_blksize = TAR_BLOCK_SIZE;
+
+    if (!hdr) {
+        st->st_ino = 1;
+        st->st_mode = S_IFDIR | 0555;
+        return;
+    }
+
+    st->st_ino = offset / TAR_BLOCK_SIZE + 2;
+    st->st_mode = ((entry_type(hdr) == FILE_DIR) ? S_IFDIR : S_IFREG) | 0555;
+    st->st_size = tar_octal(hdr->size, sizeof(hdr->size));
+    st->st_blocks = up2(st->st_size, TAR_BLOCK_SIZE) / 512;
+    st->st_mtime = st->st_ctime = st->st_atime = tar_octal(hdr->mtime, sizeof(hdr->mtime));
+}
+
+/**
+ * @brief 获取已打开文件的信息
+ */
+int initramfs_stat (file_t * file, struct stat *st) {
+    initramfs_t * ramfs = (initramfs_t *)file->fs->data;
+    stat_fill(st, (tar_header_t *)(ramfs->start + file->cblk), file->cblk);
+    return 0;
+}
+
+/**
+ * @brief 按路径获取文件或目录的信息
+ */
+int initramfs_path_stat (struct _fs_t * fs, const char * path, struct stat *st) {
+    initramfs_t * ramfs = (initramfs_t *)fs->data;
+    int offset;
+
+    if (*path == '\0') {
+        stat_fill(st, (tar_header_t *)0, 0);
+        return 0;
+    }
+
+    tar_header_t * hdr = entry_find(ramfs, path, &offset);
+    if (!hdr || (entry_type(hdr) == FILE_UNKNOWN)) {
+        return -1;
+    }
+
+    stat_fill(st, hdr, offset);
+    return 0;
+}
+
+/**
+ * @brief 打开目录，DIR中记录目录的文件头位置
+ */
+int initramfs_opendir (struct _fs_t * fs, const char * name, DIR * dir) {
+    initramfs_t * ramfs = (initramfs_t *)fs->data;
+    int offset = INITRAMFS_ROOT;
+
+    if (*name != '\0') {
+        tar_header_t * hdr = entry_find(ramfs, name, &offset);
+        if (!hdr || (entry_type(hdr) != FILE_DIR)) {
+            return -1;
+        }
+    }
+
+    dir->index = 0;
+    dir->start = offset;
+    return 0;
+}
+
+/**
+ * @brief 读取一个目录项
+ * 镜像中的各项按顺序排列，index为镜像中的序号，目录中的项即路径为"目录/名称"的项
+ */
+int initramfs_readdir (struct _fs_t * fs, DIR* dir, struct dirent * dirent) {
+    initramfs_t * ramfs = (initramfs_t *)fs->data;
+
+    // start由用户进程传入，需检查
+    const char * dir_name = "";
+    int dir_len = 0;
+    if (dir->start != INITRAMFS_ROOT) {
+        tar_header_t * dir_hdr = entry_at(ramfs, dir->start);
+        if (!dir_hdr || (entry_type(dir_hdr) != FILE_DIR)) {
+            return -1;
+        }
+        dir_len = entry_name(dir_hdr, &dir_name);
+    }
+
+    tar_header_t * hdr;
+    int index = 0;
+    for (int curr = 0; (hdr = entry_at(ramfs, curr)) != (tar_header_t *)0; curr = entry_next(hdr, curr), index++) {
+        if ((index < dir->index) || (entry_type(hdr) == FILE_UNKNOWN)) {
+            continue;
+        }
+
+        // 路径以目录名开头，其余部分为一级名称
+        const char * name;
+        int len = entry_name(hdr, &name);
+        if (dir_len) {
+            if ((len <= dir_len + 1) || kernel_memcmp((void *)name, (void *)dir_name, dir_len) || (name[dir_len] != '/')) {
+                continue;
+            }
+            name += dir_len + 1;
+            len -= dir_len + 1;
+        }
+
+        int child = 1;
+        for (int i = 0; i < len; i++) {
+            if (name[i] == '/') {
+                child = 0;
+                break;
+            }
+        }
+        if (!child || (len == 0) || (len >= sizeof(dirent->name))) {
+            continue;
+        }
+
+        dir->index = index + 1;
+        dirent->index = index;
+        dirent->type = entry_type(hdr);
+        dirent->size = (dirent->type == FILE_DIR) ? 0 : tar_octal(hdr->size, sizeof(hdr->size));
+        kernel_memcpy(dirent->name, (void *)name, len);
+        dirent->name[len] = '\0';
+        return 0;
+    }
+
+    dir->index = index;
+    return -1;
+}
+
+/**
+ * @brief 关闭目录遍历
+ */
+int initramfs_closedir (struct _fs_t * fs, DIR *dir) {
+    return 0;
+}
+
+fs_op_t initramfs_op = {
+    .mount    = initramfs_mount,
+    .unmount  = initramfs_unmount,
+    .open     = initramfs_open,
+    .read     = initramfs_read,
+    .write    = initramfs_write,
+    .seek     = initramfs_seek,
+    .stat     = initramfs_stat,
+    .path_stat = initramfs_path_stat,
+    .close    = initramfs_close,
+    .opendir  = initramfs_opendir,
+    .readdir  = initramfs_readdir,
+    .closedir = initramfs_closedir,
+};
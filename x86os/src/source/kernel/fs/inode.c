@@ -0,0 +1,127 @@
+
+#include "fs/inode.h"
+#include "tools/klib.h"
+#include "ipc/mutex.h"
+#include "core/memory.h"
+#include "dev/time.h"
+
+static inode_t inode_table[INODE_TABLE_SIZE];   // 系统中已打开文件的inode表
+static mutex_t inode_table_mutex;               // 访问inode_table的互斥信号量
+
+// inode_t * inode_get (struct _fs_t * fs, int p_dir, int p_index);
+// inode_t * inode_find (struct _fs_t * fs, int p_dir, int p_index);
+// inode_t * inode_next (struct _fs_t * fs, int * index);
+// void inode_put (inode_t * inode);
+// void inode_set_dirty (inode_t * inode);
+// void inode_table_init (void);
+
+/**
+ * @brief 在表中查找已打开的inode，调用者需持有inode_table_mutex
+ */
+static inode_t * inode_lookup (struct _fs_t * fs, int p_dir, int p_index) {
+    for (int i = 0; i < INODE_TABLE_SIZE; i++) {
+        inode_t * inode = inode_table + i;
+        if (inode->ref && (inode->fs == fs) && (inode->p_dir == p_dir) && (inode->p_index == p_index)) {
+            return inode;
+        }
+    }
+    return (inode_t *)0;
+}
+
+/**
+ * @brief 获取文件对应的inode，已打开时增加引用计数，否则分配一个新的
+ * 新分配的inode的valid为0，由文件系统填写文件信息
+ */
+inode_t * inode_get (struct _fs_t * fs, int p_dir, int p_index) {
+    mutex_lock(&inode_table_mutex);
+
+    inode_t * inode = inode_lookup(fs, p_dir, p_index);
+    if (inode) {
+        inode->ref++;
+    } else {
+        for (int i = 0; i < INODE_TABLE_SIZE; i++) {
+            inode_t * p_inode = inode_table + i;
+            if (p_inode->ref == 0) {
+                kernel_memset(p_inode, 0, sizeof(inode_t));
+                p_inode->ref = 1;
+                p_inode->fs = fs;
+                p_inode->p_dir = p_dir;
+                p_inode->p_index = p_index;
+                mutex_init(&p_inode->mutex);
+                inode = p_inode;
+                break;
+            }
+        }
+    }
+
+    mutex_unlock(&inode_table_mutex);
+    return inode;
+}
+
+/**
+ * @brief 查找文件是否已打开，不增加引用计数
+ */
+inode_t * inode_find (struct _fs_t * fs, int p_dir, int p_index) {
+    mutex_lock(&inode_table_mutex);
+    inode_t * inode = inode_lookup(fs, p_dir, p_index);
+    mutex_unlock(&inode_table_mutex);
+    return inode;
+}
+
+/**
+ * @brief 从表中第*index项开始查找文件系统fs中已打开的inode，找到时增加引用计数
+ * *index更新为下次查找的起始位置，用于遍历所有已打开的文件，没有更多时返回0
+ */
+inode_t * inode_next (struct _fs_t * fs, int * index) {
+    inode_t * inode = (inode_t *)0;
+
+    mutex_lock(&inode_table_mutex);
+    while (*index < INODE_TABLE_SIZE) {
+        inode_t * curr = inode_table + (*index)++;
+        if (curr->ref && curr->valid && (curr->fs == fs)) {
+            curr->ref++;
+            inode = curr;
+            break;
+        }
+    }
+    mutex_unlock(&inode_table_mutex);
+    return inode;
+}
+
+/**
+ * @brief 释放对inode的引用，减到0时该项空闲
+ */
+void inode_put (inode_t * inode) {
+    mutex_lock(&inode_table_mutex);
+    if (inode->ref && (--inode->ref == 0)) {
+        if (inode->extents) {
+            memory_free_page((uint32_t)inode->extents);
+            inode->extents = (blk_extent_t *)0;
+        }
+
+        // 暂存的数据已在关闭时回写，回写失败时已由文件系统丢弃
+        if (inode->dbuf) {
+            memory_free_pages((uint32_t)inode->dbuf, INODE_DBUF_PAGES);
+            inode->dbuf = (uint8_t *)0;
+        }
+    }
+    mutex_unlock(&inode_table_mutex);
+}
+
+/**
+ * @brief 标记inode需要回写，记录开始变脏的时刻
+ */
+void inode_set_dirty (inode_t * inode) {
+    if (!inode->dirty) {
+        inode->dirty = 1;
+        inode->dirty_tick = time_get_tick();
+    }
+}
+
+/**
+ * @brief inode表初始化
+ */
+void inode_table_init (void) {
+	kernel_memset(&inode_table, 0, sizeof(inode_table));
+	mutex_init(&inode_table_mutex);
+}
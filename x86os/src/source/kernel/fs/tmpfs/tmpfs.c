@@ -0,0 +1,628 @@
+
+#include "fs/tmpfs/tmpfs.h"
+#include "fs/fs.h"
+#include "fs/inode.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+#include <sys/fcntl.h>
+#include <sys/stat.h>
+
+
+
+// static int name_len (const char * name);
+// static int name_hash (const char * name, int len);
+// static tmpfs_node_t * node_of (tmpfs_t * tmp, int id);
+// static int dir_lookup (tmpfs_t * tmp, int dir, const char * name);
+// static int node_create (tmpfs_t * tmp, int dir, const char * name, file_type_t type);
+// static void node_remove (tmpfs_t * tmp, int id);
+// static void node_free_pages (tmpfs_node_t * node);
+// static const char * path_walk (tmpfs_t * tmp, const char * path, int * p_dir);
+// static void stat_fill (tmpfs_t * tmp, struct stat * st, int id);
+
+int  tmpfs_mount    (struct _fs_t * fs, int dev_major, int dev_minor);
+void tmpfs_unmount  (struct _fs_t * fs);
+int  tmpfs_open     (struct _fs_t * fs, const char * path, file_t * file);
+int  tmpfs_truncate (file_t * file);
+int  tmpfs_read     (char * buf, int size, file_t * file);
+int  tmpfs_write    (char * buf, int size, file_t * file);
+int  tmpfs_close    (file_t * file);
+int  tmpfs_seek     (file_t * file, uint32_t offset, int dir);
+int  tmpfs_stat     (file_t * file, struct stat *st);
+int  tmpfs_path_stat (struct _fs_t * fs, const char * path, struct stat *st);
+int  tmpfs_opendir  (struct _fs_t * fs, const char * name, DIR * dir);
+int  tmpfs_readdir  (struct _fs_t * fs, DIR* dir, struct dirent * dirent);
+int  tmpfs_closedir (struct _fs_t * fs, DIR *dir);
+int  tmpfs_unlink   (struct _fs_t * fs, const char * path);
+int  tmpfs_mkdir    (struct _fs_t * fs, const char * path);
+int  tmpfs_rmdir    (struct _fs_t * fs, const char * path);
+
+
+
+/**
+ * @brief 计算路径中一级名称的长度，名称以'\0'或'/'结束
+ */
+static int name_len (const char * name) {
+    int len = 0;
+    while (name[len] && (name[len] != '/')) {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief 计算名称在目录散列表中所在的桶
+ */
+static int name_hash (const char * name, int len) {
+    uint32_t hash = 0;
+    for (int i = 0; i < len; i++) {
+        hash = hash * 31 + (uint8_t)name[i];
+    }
+    return hash % TMPFS_HASH_SIZE;
+}
+
+/**
+ * @brief 由结点号取得结点，结点号无效或未使用时返回0
+ */
+static tmpfs_node_t * node_of (tmpfs_t * tmp, int id) {
+    if ((id < 0) || (id >= TMPFS_NODE_CNT) || !tmp->nodes[id].used) {
+        return (tmpfs_node_t *)0;
+    }
+    return tmp->nodes + id;
+}
+
+/**
+ * @brief 在目录dir中查找名称为name的项，name以'\0'或'/'结束，找不到时返回TMPFS_NODE_NONE
+ * 只需查找名称所在的那个桶
+ */
+static int dir_lookup (tmpfs_t * tmp, int dir, const char * name) {
+    int len = name_len(name);
+    if ((len == 0) || (len >= TMPFS_NAME_SIZE)) {
+        return TMPFS_NODE_NONE;
+    }
+
+    tmpfs_node_t * p_node = tmp->nodes + dir;
+    for (int id = p_node->hash[name_hash(name, len)]; id != TMPFS_NODE_NONE; id = tmp->nodes[id].next) {
+        tmpfs_node_t * node = tmp->nodes + id;
+        if ((kernel_memcmp(node->name, (void *)name, len) == 0) && (node->name[len] == '\0')) {
+            return id;
+        }
+    }
+    return TMPFS_NODE_NONE;
+}
+
+/**
+ * @brief 在目录dir中新建名称为name的文件或目录，返回新结点号，失败返回-1
+ */
+static int node_create (tmpfs_t * tmp, int dir, const char * name, file_type_t type) {
+    int len = name_len(name);
+    if ((len == 0) || (len >= TMPFS_NAME_SIZE) || (name[len] != '\0')) {
+        log_printf("tmpfs: bad name %s", name);
+        return -1;
+    }
+
+    // 找一个空闲的结点
+    int id;
+    for (id = 0; id < TMPFS_NODE_CNT; id++) {
+        if (!tmp->nodes[id].used) {
+            break;
+        }
+    }
+    if (id >= TMPFS_NODE_CNT) {
+        log_printf("tmpfs: no free node");
+        return -1;
+    }
+
+    tmpfs_node_t * node = tmp->nodes + id;
+    kernel_memset(node, 0, sizeof(tmpfs_node_t));
+    kernel_memcpy(node->name, (void *)name, len);
+    node->used = 1;
+    node->type = type;
+    node->parent = dir;
+    for (int i = 0; i < TMPFS_HASH_SIZE; i++) {
+        node->hash[i] = TMPFS_NODE_NONE;
+    }
+
+    // 插入到所在目录对应桶的开头
+    tmpfs_node_t * p_node = tmp->nodes + dir;
+    int bucket = name_hash(name, len);
+    node->next = p_node->hash[bucket];
+    p_node->hash[bucket] = id;
+    p_node->child_cnt++;
+    return id;
+}
+
+/**
+ * @brief 释放文件的全部数据页及页表
+ */
+static void node_free_pages (tmpfs_node_t * node) {
+    if (node->pages) {
+        for (int i = 0; i < node->page_cnt; i++) {
+            memory_free_page(node->pages[i]);
+        }
+        memory_free_page((uint32_t)node->pages);
+    }
+
+    node->pages = (uint32_t *)0;
+    node->page_cnt = 0;
+    node->size = 0;
+}
+
+/**
+ * @brief 将结点从所在目录中移除并释放
+ */
+static void node_remove (tmpfs_t * tmp, int id) {
+    tmpfs_node_t * node = tmp->nodes + id;
+    tmpfs_node_t * p_node = tmp->nodes + node->parent;
+
+    int * link = p_node->hash + name_hash(node->name, kernel_strlen(node->name));
+    while (*link != id) {
+        link = &tmp->nodes[*link].next;
+    }
+    *link = node->next;
+    p_node->child_cnt--;
+
+    node_free_pages(node);
+    node->used = 0;
+}
+
+/**
+ * @brief 沿路径逐级进入子目录，返回路径中的最后一级名称，p_dir返回其所在目录的结点号
+ * 路径为空或只有/时，返回空串，p_dir为根目录。中间某级不存在或不是目录时返回0
+ */
+static const char * path_walk (tmpfs_t * tmp, const char * path, int * p_dir) {
+    int dir = TMPFS_ROOT;
+
+    while (*path == '/') {
+        path++;
+    }
+
+    const char * next;
+    while ((next = path_next_child(path)) != (const char *)0) {
+        int id = dir_lookup(tmp, dir, path);
+        if ((id == TMPFS_NODE_NONE) || (tmp->nodes[id].type != FILE_DIR)) {
+            return (const char *)0;
+        }
+
+        dir = id;
+        path = next;
+        while (*path == '/') {
+            path++;
+        }
+    }
+
+    *p_dir = dir;
+    return path;
+}
+
+/**
+ * @brief 挂载tmpfs，不需要设备，只分配结点表并建立根目录
+ */
+int tmpfs_mount (struct _fs_t * fs, int dev_major, int dev_minor) {
+    tmpfs_t * tmp = &fs->tmp_data;
+
+    tmp->node_pages = up2(sizeof(tmpfs_node_t) * TMPFS_NODE_CNT, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    tmp->nodes = (tmpfs_node_t *)memory_alloc_pages(tmp->node_pages);
+    if (!tmp->nodes) {
+        log_printf("mount tmpfs failed: can't alloc node table.");
+        return -1;
+    }
+    kernel_memset(tmp->nodes, 0, tmp->node_pages * MEM_PAGE_SIZE);
+
+    tmpfs_node_t * root = tmp->nodes + TMPFS_ROOT;
+    root->used = 1;
+    root->type = FILE_DIR;
+    root->parent = TMPFS_ROOT;
+    for (int i = 0; i < TMPFS_HASH_SIZE; i++) {
+        root->hash[i] = TMPFS_NODE_NONE;
+    }
+
+    mutex_init(&tmp->mutex);
+    fs->mutex = &tmp->mutex;
+    fs->dev_id = -1;
+    fs->type = FS_TMPFS;
+    fs->data = tmp;
+    return 0;
+}
+
+/**
+ * @brief 卸载tmpfs，其中的全部文件随之丢弃
+ */
+void tmpfs_unmount (struct _fs_t * fs) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+
+    for (int i = 0; i < TMPFS_NODE_CNT; i++) {
+        if (tmp->nodes[i].used) {
+            node_free_pages(tmp->nodes + i);
+        }
+    }
+
+    memory_free_pages((uint32_t)tmp->nodes, tmp->node_pages);
+    tmp->nodes = (tmpfs_node_t *)0;
+}
+
+/**
+ * @brief 打开指定的文件
+ * inode以(所在目录, 结点号)为键，只用于文件锁以及判断文件是否正被使用
+ */
+int tmpfs_open (struct _fs_t * fs, const char * path, file_t * file) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+    int p_dir;
+
+    const char * name = path_walk(tmp, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
+
+    int id = dir_lookup(tmp, p_dir, name);
+    if (id == TMPFS_NODE_NONE) {
+        if (!(file->mode & O_CREAT)) {
+            return -1;
+        }
+
+        id = node_create(tmp, p_dir, name, FILE_NORMAL);
+        if (id < 0) {
+            return -1;
+        }
+    } else if (tmp->nodes[id].type == FILE_DIR) {
+        // 目录不能当作普通文件打开
+        return -1;
+    }
+
+    inode_t * inode = inode_get(fs, p_dir, id);
+    if (inode == (inode_t *)0) {
+        log_printf("no inode for open.");
+        return -1;
+    }
+
+    if (!inode->valid) {
+        inode->type = FILE_NORMAL;
+        inode->valid = 1;
+    }
+
+    file->inode = inode;
+    file->type = FILE_NORMAL;
+    file->pos = 0;
+    return 0;
+}
+
+/**
+ * @brief 打开时截断文件，释放全部数据页
+ * 调用者持有文件锁，其它打开者不会正在读写这些页
+ */
+int tmpfs_truncate (file_t * file) {
+    tmpfs_t * tmp = (tmpfs_t *)file->fs->data;
+
+    node_free_pages(tmp->nodes + file->inode->p_index);
+    return 0;
+}
+
+/**
+ * @brief 读取文件数据，逐页从数据页中复制
+ */
+int tmpfs_read (char * buf, int size, file_t * file) {
+    tmpfs_t * tmp = (tmpfs_t *)file->fs->data;
+    tmpfs_node_t * node = tmp->nodes + file->inode->p_index;
+
+    if ((size <= 0) || (file->pos >= node->size)) {
+        return 0;
+    }
+
+    uint32_t nbytes = size;
+    if (file->pos + nbytes > node->size) {
+        nbytes = node->size - file->pos;
+    }
+
+    int total = 0;
+    while (nbytes > 0) {
+        uint32_t offset = file->pos % MEM_PAGE_SIZE;
+        uint32_t cnt = MEM_PAGE_SIZE - offset;
+        if (cnt > nbytes) {
+            cnt = nbytes;
+        }
+
+        uint8_t * page = (uint8_t *)node->pages[file->pos / MEM_PAGE_SIZE];
+        kernel_memcpy(buf, page + offset, cnt);
+
+        buf += cnt;
+        file->pos += cnt;
+        total += cnt;
+        nbytes -= cnt;
+    }
+
+    return total;
+}
+
+/**
+ * @brief 写文件数据，写到已分配的页之后时再分配新页
+ * 文件页数达到上限或内存不足时，返回已写入的字节数
+ */
+int tmpfs_write (char * buf, int size, file_t * file) {
+    tmpfs_t * tmp = (tmpfs_t *)file->fs->data;
+    tmpfs_node_t * node = tmp->nodes + file->inode->p_index;
+
+    // 页表在首次写入时分配
+    if ((size > 0) && !node->pages) {
+        node->pages = (uint32_t *)memory_alloc_page();
+        if (!node->pages) {
+            log_printf("tmpfs: no memory for page table");
+            return -1;
+        }
+    }
+
+    int total = 0;
+    while (size > 0) {
+        uint32_t index = file->pos / MEM_PAGE_SIZE;
+        if (index >= TMPFS_PAGE_MAX) {
+            log_printf("tmpfs: file too large");
+            break;
+        }
+
+        // 位置只能在文件范围之内，所以新页总是紧接在已有页之后
+        if (index >= node->page_cnt) {
+            uint32_t page = memory_alloc_page();
+            if (!page) {
+                log_printf("tmpfs: no memory for data");
+                break;
+            }
+            node->pages[node->page_cnt++] = page;
+        }
+
+        uint32_t offset = file->pos % MEM_PAGE_SIZE;
+        uint32_t cnt = MEM_PAGE_SIZE - offset;
+        if (cnt > size) {
+            cnt = size;
+        }
+
+        uint8_t * page = (uint8_t *)node->pages[index];
+        kernel_memcpy(page + offset, buf, cnt);
+
+        buf += cnt;
+        file->pos += cnt;
+        total += cnt;
+        size -= cnt;
+        if (file->pos > node->size) {
+            node->size = file->pos;
+        }
+    }
+
+    return total ? total : ((size > 0) ? -1 : 0);
+}
+
+/**
+ * @brief 关闭文件，数据一直保留在内存中，不需要回写
+ */
+int tmpfs_close (file_t * file) {
+    return 0;
+}
+
+/**
+ * @brief 文件读写定位，只能在文件范围之内
+ */
+int tmpfs_seek (file_t * file, uint32_t offset, int dir) {
+    tmpfs_t * tmp = (tmpfs_t *)file->fs->data;
+    tmpfs_node_t * node = tmp->nodes + file->inode->p_index;
+
+    int pos;
+    switch (dir) {
+    case FS_SEEK_SET:
+        pos = (int)offset;
+        break;
+    case FS_SEEK_CUR:
+        pos = file->pos + (int)offset;
+        break;
+    case FS_SEEK_END:
+        pos = node->size + (int)offset;
+        break;
+    default:
+        return -1;
+    }
+
+    if ((pos < 0) || (pos > node->size)) {
+        return -1;
+    }
+
+    file->pos = pos;
+    return pos;
+}
+
+/**
+ * @brief 填写结点的文件信息，结点号即inode号，块数以512字节为单位
+ */
+static void stat_fill (tmpfs_t * tmp, struct stat * st, int id) {
+    tmpfs_node_t * node = tmp->nodes + id;
+
+    kernel_memset(st, 0, sizeof(struct stat));
+    st->st_dev = -1;
+    st->st_ino = id + 1;
+    st->st_mode = (node->type == FILE_DIR) ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+    st->st_nlink = 1;
+    st->st_size = (node->type == FILE_DIR) ? node->child_cnt : node->size;
+    st->st_blksize = MEM_PAGE_SIZE;
+    st->st_blocks = node->page_cnt * (MEM_PAGE_SIZE / 512);
+}
+
+/**
+ * @brief 获取已打开文件的信息
+ */
+int tmpfs_stat (file_t * file, struct stat *st) {
+    tmpfs_t * tmp = (tmpfs_t *)file->fs->data;
+    stat_fill(tmp, st, file->inode->p_index);
+    return 0;
+}
+
+/**
+ * @brief 按路径获取文件或目录的信息
+ */
+int tmpfs_path_stat (struct _fs_t * fs, const char * path, struct stat *st) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+    int p_dir;
+
+    const char * name = path_walk(tmp, path, &p_dir);
+    if (name == (const char *)0) {
+        return -1;
+    }
+
+    int id = (*name == '\0') ? p_dir : dir_lookup(tmp, p_dir, name);
+    if (id == TMPFS_NODE_NONE) {
+        return -1;
+    }
+
+    stat_fill(tmp, st, id);
+    return 0;
+}
+
+/**
+ * @brief 打开目录，DIR中记录目录的结点号
+ */
+int tmpfs_opendir (struct _fs_t * fs, const char * name, DIR * dir) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+    int p_dir;
+
+    const char * last = path_walk(tmp, name, &p_dir);
+    if (last == (const char *)0) {
+        return -1;
+    }
+
+    int id = p_dir;
+    if (*last != '\0') {
+        id = dir_lookup(tmp, p_dir, last);
+        if ((id == TMPFS_NODE_NONE) || (tmp->nodes[id].type != FILE_DIR)) {
+            return -1;
+        }
+    }
+
+    dir->index = 0;
+    dir->start = id;
+    return 0;
+}
+
+/**
+ * @brief 读取一个目录项
+ * 按桶的顺序依次遍历，跳过前index项。目录在两次读取之间被修改时，可能重复或遗漏
+ */
+int tmpfs_readdir (struct _fs_t * fs, DIR* dir, struct dirent * dirent) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+
+    // start由用户进程传入，需检查
+    tmpfs_node_t * p_node = node_of(tmp, dir->start);
+    if (!p_node || (p_node->type != FILE_DIR)) {
+        return -1;
+    }
+
+    int skip = dir->index;
+    for (int i = 0; i < TMPFS_HASH_SIZE; i++) {
+        for (int id = p_node->hash[i]; id != TMPFS_NODE_NONE; id = tmp->nodes[id].next) {
+            if (skip-- > 0) {
+                continue;
+            }
+
+            tmpfs_node_t * node = tmp->nodes + id;
+            dirent->index = dir->index++;
+            dirent->type = node->type;
+            dirent->size = (node->type == FILE_DIR) ? 0 : node->size;
+            kernel_strncpy(dirent->name, node->name, sizeof(dirent->name));
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief 关闭目录遍历
+ */
+int tmpfs_closedir (struct _fs_t * fs, DIR *dir) {
+    return 0;
+}
+
+/**
+ * @brief 删除文件，文件仍被打开时不允许删除
+ */
+int tmpfs_unlink (struct _fs_t * fs, const char * path) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+    int p_dir;
+
+    const char * name = path_walk(tmp, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
+
+    int id = dir_lookup(tmp, p_dir, name);
+    if ((id == TMPFS_NODE_NONE) || (tmp->nodes[id].type == FILE_DIR)) {
+        return -1;
+    }
+
+    if (inode_find(fs, p_dir, id)) {
+        log_printf("tmpfs: file busy.");
+        return -1;
+    }
+
+    node_remove(tmp, id);
+    return 0;
+}
+
+/**
+ * @brief 创建目录
+ */
+int tmpfs_mkdir (struct _fs_t * fs, const char * path) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+    int p_dir;
+
+    const char * name = path_walk(tmp, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
+
+    // 已经存在同名的文件或目录
+    if (dir_lookup(tmp, p_dir, name) != TMPFS_NODE_NONE) {
+        return -1;
+    }
+
+    return (node_create(tmp, p_dir, name, FILE_DIR) < 0) ? -1 : 0;
+}
+
+/**
+ * @brief 删除目录，目录须为空
+ */
+int tmpfs_rmdir (struct _fs_t * fs, const char * path) {
+    tmpfs_t * tmp = (tmpfs_t *)fs->data;
+    int p_dir;
+
+    const char * name = path_walk(tmp, path, &p_dir);
+    if ((name == (const char *)0) || (*name == '\0')) {
+        return -1;
+    }
+
+    int id = dir_lookup(tmp, p_dir, name);
+    if ((id == TMPFS_NODE_NONE) || (tmp->nodes[id].type != FILE_DIR)) {
+        return -1;
+    }
+
+    if (tmp->nodes[id].child_cnt) {
+        log_printf("dir not empty.");
+        return -1;
+    }
+
+    node_remove(tmp, id);
+    return 0;
+}
+
+fs_op_t tmpfs_op = {
+    .mount    = tmpfs_mount,
+    .unmount  = tmpfs_unmount,
+    .open     = tmpfs_open,
+    .truncate = tmpfs_truncate,
+    .read     = tmpfs_read,
+    .write    = tmpfs_write,
+    .seek     = tmpfs_seek,
+    .stat     = tmpfs_stat,
+    .path_stat = tmpfs_path_stat,
+    .close    = tmpfs_close,
+    .opendir  = tmpfs_opendir,
+    .readdir  = tmpfs_readdir,
+    .closedir = tmpfs_closedir,
+    .unlink   = tmpfs_unlink,
+    .mkdir    = tmpfs_mkdir,
+    .rmdir    = tmpfs_rmdir,
+};
@@ -57,6 +57,8 @@ uint32_t memory_alloc_for_page_dir (uint32_t page_dir, uint32_t vaddr, uint32_t
 int      memory_alloc_page_for     (uint32_t addr, uint32_t size, int perm);
 uint32_t memory_alloc_page         (void);
 void     memory_free_page          (uint32_t addr);
+uint32_t memory_alloc_pages        (int page_count);
+void     memory_free_pages         (uint32_t addr, int page_count);
 void     memory_destroy_uvm        (uint32_t page_dir);
 uint32_t memory_copy_uvm           (uint32_t page_dir);
 uint32_t memory_get_paddr          (uint32_t page_dir, uint32_t vaddr);
@@ -27,6 +27,21 @@
 #define SYS_readdir				61
 #define SYS_closedir			62
 #define SYS_unlink				63
+#define SYS_mkdir				64
+#define SYS_rmdir				65
+#define SYS_chdir				66
+#define SYS_getcwd				67
+#define SYS_fsync				68
+#define SYS_fdatasync			69
+#define SYS_sync				70
+#define SYS_sendfile			71
+#define SYS_readv				72
+#define SYS_writev				73
+#define SYS_pread				74
+#define SYS_pwrite				75
+#define SYS_stat				76
+#define SYS_poll				77
+#define SYS_dmesg				78
 
 
 #define SYS_printmsg            100
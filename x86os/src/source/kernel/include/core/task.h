@@ -10,6 +10,7 @@
 #define TASK_NAME_SIZE				32			// 任务名字长度
 #define TASK_TIME_SLICE_DEFAULT		10			// 时间片计数
 #define TASK_OFILE_NR				128			// 最多支持打开的文件数量
+#define TASK_CWD_SIZE				128			// 当前工作目录路径长度
 
 #define TASK_FLAG_SYSTEM       	(1 << 0)		// 系统任务
 
@@ -41,10 +42,12 @@ typedef struct _task_t {
     int status;				        // 进程执行结果
 
     int sleep_ticks;		        // 睡眠时间
+    list_t * wait_list;             // 限时等待时所在的等待队列，超时后由定时处理移出
     int time_slice;			        // 时间片
 	int slice_ticks;		        // 递减时间片计数
 
     file_t * file_table[TASK_OFILE_NR];	// 一个任务最多打开的文件数量
+    char cwd[TASK_CWD_SIZE];			// 当前工作目录，以/开头的绝对路径
 
 	tss_t tss;				// 任务的TSS段
 	uint16_t tss_sel;		// tss选择子
@@ -60,6 +63,7 @@ typedef struct _task_t {
 
 
 int  task_init (task_t *task, const char * name, int flag, uint32_t entry, uint32_t esp);
+void task_start (task_t * task);
 void task_switch_from_to (task_t * from, task_t * to);
 void task_set_ready(task_t *task);
 void task_set_block (task_t *task);
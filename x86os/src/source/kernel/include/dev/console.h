@@ -8,6 +8,7 @@
 #include "comm/types.h"
 #include "dev/tty.h"
 #include "ipc/mutex.h"
+#include "core/memory.h"
 
 // https://wiki.osdev.org/Printing_To_Screen
 #define CONSOLE_VIDEO_BASE			0xb8000		// 控制台显存起始地址,共32KB
@@ -15,6 +16,17 @@
 #define CONSOLE_DISP_END			(0xb8000 + 32*1024)	// 显存的结束地址
 #define CONSOLE_ROW_MAX				25			// 行数
 #define CONSOLE_COL_MAX				80			// 最大列数
+#define CONSOLE_VRAM_ROWS			((CONSOLE_DISP_END - CONSOLE_DISP_ADDR) / (CONSOLE_COL_MAX * 2))	// 显存可容纳的行数
+
+// 影子缓存的页数，初始化时分配。内核数据位于低端内存中，空间有限，不放在console_t里
+#define CONSOLE_SHADOW_PAGES		((CONSOLE_ROW_MAX * CONSOLE_COL_MAX * 2 + MEM_PAGE_SIZE - 1) / MEM_PAGE_SIZE)
+
+// 回滚历史：每个控制台一个环形缓存，行移出屏幕时压缩后存入，首次使用时分配
+// 每行去掉行尾空白后按属性游程编码：[长度] {属性 个数 字符...}... [长度]，前后都有长度以便双向遍历
+// 一般的文本行只需几十字节，8个控制台全部写满共占2MB
+#define CONSOLE_HISTORY_PAGES		64			// 历史缓存的页数，缓存大小须为2的幂
+#define CONSOLE_HISTORY_SIZE		(CONSOLE_HISTORY_PAGES * MEM_PAGE_SIZE)
+#define CONSOLE_HISTORY_LINES		10000		// 最多保存的行数
 
 #define ASCII_ESC                   0x1b        // ESC ascii码            
 
@@ -57,7 +69,21 @@ typedef union {
  * 终端显示部件
  */
 typedef struct _console_t {
-	disp_char_t * disp_base;	// 显示基地址
+	disp_char_t * disp_base;	// 显存基地址，各控制台共用，整个显存作为当前显示的控制台的滚动区
+
+    // 影子缓存：所有写操作都在内存中进行，再将有变化的行刷新到显存
+    // 按行组成环形缓存，第top行为屏幕的首行，上滚时只需移动top
+    disp_char_t * shadow;           // 共CONSOLE_ROW_MAX * CONSOLE_COL_MAX项，未分配时为0
+    int top;                        // 屏幕首行在shadow中的行号
+    uint32_t dirty_rows;            // 需要刷新到显存的行，按屏幕上的行号置位
+    int scroll_lines;               // 上次刷新后上滚的行数，刷新时通过移动显示起始地址完成
+
+    // 回滚历史，按字节组成环形缓存，最老的行在前
+    uint8_t * history;              // 历史缓存，未分配时为0
+    int hist_head, hist_tail;       // 最老一行的起始位置，下一行的写入位置
+    int hist_used;                  // 已使用的字节数
+    int hist_lines;                 // 保存的行数
+    int view_lines;                 // 向上翻看的行数，0表示显示当前屏幕
 
     enum {
         CONSOLE_WRITE_NORMAL,			// 普通模式
@@ -79,6 +105,7 @@ typedef struct _console_t {
 int console_init (int idx);
 int console_write (tty_t * tty);
 void console_close (int dev);
-void console_select(int idx);
+int console_select(int idx);
 void console_set_cursor(int idx, int visiable);
+void console_page_history(int idx, int up);
 #endif /* SRC_UI_TTY_WIDGET_H_ */
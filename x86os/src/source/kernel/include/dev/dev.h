@@ -11,6 +11,7 @@ enum {
     DEV_UNKNOWN = 0,        // 未知类型
     DEV_TTY,                // TTY设备，将屏幕（只写）和键盘（只读）抽象为TTY设备
     DEV_DISK,               // 磁盘设备
+    DEV_SERIAL,             // 串口设备，作为tty使用
 };
 
 struct _dev_desc_t;
@@ -40,6 +41,7 @@ typedef struct _dev_desc_t {
     int  (*write)   (device_t * dev, int addr, char * buf, int size);
     int  (*control) (device_t * dev, int cmd, int arg0, int arg1);
     void (*close)   (device_t * dev);
+    int  (*poll)    (device_t * dev, int events);    // 返回已就绪的事件，不等待；为0时总是可读写
 } dev_desc_t;
 
 
@@ -49,5 +51,9 @@ int  dev_read    (int dev_id, int addr,  char * buf, int size);
 int  dev_write   (int dev_id, int addr,  char * buf, int size);
 int  dev_control (int dev_id, int cmd,   int arg0,   int arg1);
 void dev_close   (int dev_id);
+int  dev_poll    (int dev_id, int events);
+
+void dev_poll_wakeup (void);
+int  dev_poll_wait   (int ms);
 
 #endif // DEV_H
@@ -14,6 +14,11 @@
 
 // https://wiki.osdev.org/PS/2_Keyboard
 #define KBD_CMD_RW_LED			0xED   // 写按键
+#define KBD_REPLY_ACK			0xFA   // 键盘对命令的应答
+#define KBD_REPLY_RESEND		0xFE   // 要求重发命令
+
+// 中断只将扫描码放入环形缓存，由键盘任务解码后送往tty。大小须为2的幂
+#define KBD_RING_SIZE			64
 
 #define KEY_RSHIFT		0x36
 #define KEY_LSHIFT 		0x2A
@@ -85,7 +90,19 @@ typedef struct _kbd_state_t {
     int rctrl_press : 1;         // ctrl键按下
 }kbd_state_t;
 
+/**
+ * 扫描码环形缓存，中断写入、键盘任务读出
+ * 单CPU下一方只改写write，另一方只改写read，无需加锁
+ */
+typedef struct _kbd_ring_t {
+    volatile uint8_t buf[KBD_RING_SIZE];
+    volatile uint32_t write;        // 自由增长，取模得到位置
+    volatile uint32_t read;
+    volatile uint32_t dropped;      // 缓存满时丢弃的扫描码数量
+}kbd_ring_t;
+
 void kbd_init(void);
+void kbd_task_init (void);
 
 void exception_handler_kbd (void);
 
@@ -0,0 +1,66 @@
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "comm/types.h"
+#include "dev/tty.h"
+#include "ipc/sem.h"
+#include "core/memory.h"
+
+// 16550串口，参考资料：https://wiki.osdev.org/Serial_Ports
+#define SERIAL_NR					1			// 支持的串口数量，目前只有COM1
+#define SERIAL_COM1_PORT			0x3F8		// COM1的IO端口起始地址
+#define SERIAL_BAUD					115200		// 波特率
+#define SERIAL_CLOCK				115200		// 除数为1时的波特率
+#define SERIAL_FIFO_SIZE			16			// 16550发送FIFO的大小，发送空中断时可一次写入这么多字节
+#define SERIAL_OBUF_SIZE			8192		// 发送缓存大小，日志较多时也不用等待
+#define SERIAL_OBUF_PAGES			(SERIAL_OBUF_SIZE / MEM_PAGE_SIZE)	// 发送缓存占用的页数
+
+// 各寄存器相对于起始端口的偏移
+#define SERIAL_REG_DATA				0			// 收发数据；DLAB=1时为除数低字节
+#define SERIAL_REG_IER				1			// 中断使能；DLAB=1时为除数高字节
+#define SERIAL_REG_IIR				2			// 读：中断标识
+#define SERIAL_REG_FCR				2			// 写：FIFO控制
+#define SERIAL_REG_LCR				3			// 线路控制
+#define SERIAL_REG_MCR				4			// Modem控制
+#define SERIAL_REG_LSR				5			// 线路状态
+#define SERIAL_REG_MSR				6			// Modem状态
+
+#define SERIAL_IER_RX				(1 << 0)	// 接收到数据中断
+#define SERIAL_IER_TX				(1 << 1)	// 发送保持寄存器空中断
+
+#define SERIAL_IIR_NONE				(1 << 0)	// 没有待处理的中断
+#define SERIAL_IIR_MASK				0x0E		// 中断类型
+#define SERIAL_IIR_MODEM			0x00		// Modem状态变化
+#define SERIAL_IIR_TX				0x02		// 发送保持寄存器空
+#define SERIAL_IIR_RX				0x04		// 接收到数据
+#define SERIAL_IIR_LINE				0x06		// 线路状态出错
+#define SERIAL_IIR_TIMEOUT			0x0C		// 接收FIFO中有数据但未达到触发值
+
+#define SERIAL_LCR_8N1				0x03		// 8位数据，无校验，1位停止位
+#define SERIAL_LCR_DLAB				0x80		// 访问除数寄存器
+
+#define SERIAL_FCR_ENABLE			0xC7		// 开启并清空FIFO，接收触发值为14字节
+
+#define SERIAL_MCR_NORMAL			0x0B		// DTR、RTS，OUT2开启中断输出
+#define SERIAL_MCR_LOOPBACK			0x1E		// 回环模式，用于检测串口是否存在
+
+#define SERIAL_LSR_DR				(1 << 0)	// 接收到数据
+#define SERIAL_LSR_THRE				(1 << 5)	// 发送保持寄存器空，开启FIFO时表示发送FIFO空
+
+/**
+ * 串口tty，行规程与控制台tty共用，只有收发方式不同
+ */
+typedef struct _serial_t {
+	tty_t tty;					// 须为第一项，输出回调中由tty得到所在的串口
+	char * obuf;				// 发送缓存，代替tty中较小的obuf。首次打开时分配，不占低端内存
+	uint16_t port;				// IO端口起始地址
+	int inited;					// 是否已检测并初始化
+	int tx_busy;				// 已写入FIFO，正等待发送空中断
+	int tx_wait;				// 有任务在等待发送缓存的空间
+	sem_t tx_sem;				// 发送缓存满时的等待
+} serial_t;
+
+void exception_handler_serial (void);
+
+#endif // SERIAL_H
@@ -15,6 +15,7 @@
 #define PIT_MODE0                   (3 << 1)
 
 void time_init (void);
+uint32_t time_get_tick (void);
 void exception_handler_timer (void);
 
 #endif //OS_TIMER_H
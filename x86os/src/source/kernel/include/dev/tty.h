@@ -7,8 +7,10 @@
 #define TTY_NR						8		// 最大支持的tty设备数量
 #define TTY_IBUF_SIZE				512		// tty输入缓存大小
 #define TTY_OBUF_SIZE				512		// tty输出缓存大小
-#define TTY_CMD_ECHO				0x1		// 开回显
-#define TTY_CMD_IN_COUNT			0x2		// 获取输入缓冲区中已有的数据量
+#define TTY_WRITE_CHUNK				128		// 写入时每次转换并放入输出缓存的字节数
+#define TTY_LINE_SIZE				256		// 规范模式下一行的最大长度
+#define TTY_CMD_TCGETS				0x3		// 读取termios设置，arg0为struct termios *
+#define TTY_CMD_TCSETS				0x4		// 修改termios设置，arg0为struct termios *，arg1为TCSANOW等
 
 
 
@@ -23,35 +25,80 @@ typedef struct _tty_fifo_t {
 
 int tty_fifo_get (tty_fifo_t * fifo, char * c);
 int tty_fifo_put (tty_fifo_t * fifo, char c);
+int tty_fifo_get_n (tty_fifo_t * fifo, char * buf, int size);
+int tty_fifo_put_n (tty_fifo_t * fifo, const char * buf, int size);
 
 
 
-#define TTY_INLCR			(1 << 0)		// 将\n转成\r\n
-#define TTY_IECHO			(1 << 2)		// 是否回显
+// termios行规程设置，内核与应用共用，只实现其中的一部分
+typedef unsigned int tcflag_t;
+typedef unsigned char cc_t;
 
-#define TTY_OCRLF			(1 << 0)		// 输出是否将\n转换成\r\n
+#define NCCS				8
+
+// c_cc中的控制字符及参数
+#define VEOF				0			// 文件结束，默认Ctrl+D
+#define VERASE				1			// 删除前一字符，默认退格键
+#define VKILL				2			// 删除整行，默认Ctrl+U
+#define VMIN				3			// 非规范模式：至少读取的字节数
+#define VTIME				4			// 非规范模式：等待的时间，单位为0.1秒
+
+// c_iflag
+#define ICRNL				(1 << 0)	// 输入的\r转换成\n
+
+// c_oflag
+#define OPOST				(1 << 0)	// 对输出进行处理
+#define ONLCR				(1 << 1)	// 输出的\n转换成\r\n
+
+// c_lflag
+#define ICANON				(1 << 0)	// 规范模式：按行编辑，整行返回
+#define ECHO				(1 << 1)	// 回显输入
+#define ECHOE				(1 << 2)	// 删除字符时擦除屏幕上的字符
+
+// tcsetattr的生效时机，输出总是立即完成，所以TCSADRAIN与TCSANOW相同
+#define TCSANOW				0
+#define TCSADRAIN			1
+#define TCSAFLUSH			2			// 同时丢弃未读的输入
+
+struct termios {
+	tcflag_t c_iflag;			// 输入处理
+	tcflag_t c_oflag;			// 输出处理
+	tcflag_t c_cflag;			// 硬件设置，未使用
+	tcflag_t c_lflag;			// 行规程
+	cc_t c_cc[NCCS];			// 控制字符
+};
 
 /**
  * tty设备
  */
 typedef struct _tty_t {
 	char         obuf[TTY_OBUF_SIZE];
-	tty_fifo_t   ofifo;				   // 输出队列
-	sem_t        osem;
+	tty_fifo_t   ofifo;				   // 输出队列，写者自己调用console_write取空，不需要等待
 
 	char         ibuf[TTY_IBUF_SIZE];
 	tty_fifo_t   ififo;				   // 输入处理后的队列
 	sem_t        isem;
 
-	int          iflags;			   // 输入标志
-    int          oflags;			   // 输出标志
-	int          console_idx;		   // 控制台索引号，tty对应哪块显示区域，即minor值
+	struct termios termios;			   // 行规程设置
+
+	// 规范模式下由读取者在内核中编辑的当前行，完成后整行交给读取者
+	char         line[TTY_LINE_SIZE];
+	int          line_len;			   // 行中已有的字节数
+	int          line_read;			   // 已读走的字节数
+	int          line_done;			   // 是否已遇到行结束或文件结束
+	int          console_idx;		   // 控制台索引号，tty对应哪块显示区域，即minor值；非控制台为-1
+
+	int          (*output)(struct _tty_t * tty);	// 取走输出队列中的数据：控制台直接显示，串口启动发送
 } tty_t;
 
 
 
+void tty_fifo_init (tty_fifo_t * fifo, char * buf, int size);
+void tty_setup (tty_t * tty);
 void tty_select (int tty);
 void tty_in (char ch);
+void tty_receive (tty_t * tty, char ch);
+void tty_page_history (int up);
 
 
 
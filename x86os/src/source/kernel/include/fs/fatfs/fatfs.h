@@ -3,11 +3,15 @@
 #define FAT_H
 
 #include "ipc/mutex.h"
+#include "ipc/sem.h"
+#include "tools/bitmap.h"
 
 #pragma pack(1)    // 千万记得加这个
 
-#define FAT_CLUSTER_INVALID 		0xFFF8      	// 无效的簇号
+#define FAT_CLUSTER_INVALID 		0x0FFFFFF8      // 无效的簇号，即簇链结束标记。FAT16的保留值读出后统一转换成FAT32的形式
 #define FAT_CLUSTER_FREE          	0x00     	    // 空闲或无效的簇号
+#define FAT32_CLUSTER_MASK          0x0FFFFFFF      // FAT32表项只有低28位有效
+#define FAT_ROOT_CLUSTER            0x00            // 根目录的簇号，FAT16的根目录位于固定区域，不在簇链中
 
 #define DIRITEM_NAME_FREE               0xE5                // 目录项空闲名标记
 #define DIRITEM_NAME_END                0x00                // 目录项结束名标记
@@ -21,6 +25,24 @@
 #define DIRITEM_ATTR_LONG_NAME          0x0F                // 目录项属性：长文件名
 
 #define SFN_LEN                    	 	11              // sfn文件名长
+#define LFN_MAX_LEN                     255             // 长文件名的最大长度
+#define LFN_CHARS_PER_ITEM              13              // 每个长文件名目录项存放的字符数
+#define LFN_ORD_LAST                    0x40            // 长文件名目录项序号：最后一项标记
+#define LFN_ORD_MASK                    0x3F            // 长文件名目录项序号掩码
+
+#define FAT12_MAX_CLUSTERS              4085            // 簇数少于该值为FAT12
+#define FAT16_MAX_CLUSTERS              65525           // 簇数少于该值为FAT16，否则为FAT32
+
+#define FSINFO_LEAD_SIG                 0x41615252      // FSInfo扇区的标记
+#define FSINFO_STRUC_SIG                0x61417272
+#define FSINFO_TRAIL_SIG                0xAA550000
+#define FSINFO_UNKNOWN                  0xFFFFFFFF      // FSInfo中的值未知
+
+#define FAT_RUN_MAX_SECTORS             0xFFFF          // 一次连续读写的最大扇区数，受ATA命令扇区数限制
+#define FAT_DCACHE_SIZE                 64              // 目录项缓存的项数，需为2的幂
+#define FAT_DCACHE_NAME_SIZE            32              // 目录项缓存的名称长度，更长的名称不缓存
+#define FAT_DCACHE_PAGES                ((FAT_DCACHE_SIZE * sizeof(fat_dentry_t) + MEM_PAGE_SIZE - 1) / MEM_PAGE_SIZE)  // 目录项缓存的页数
+#define FAT_IOBUF_CNT                   8               // 文件数据读写的扇区中转缓存数量，共占一页
 
 /**
  * FAT目录项
@@ -41,6 +63,20 @@ typedef struct _diritem_t {
     uint32_t DIR_FileSize;                 // 文件字节大小
 } diritem_t;
 
+/**
+ * VFAT长文件名目录项，位于对应的短文件名目录项之前，按序号倒序存放
+ */
+typedef struct _lfnitem_t {
+    uint8_t  LDIR_Ord;                      // 序号，最后一项(物理上的第一项)带LFN_ORD_LAST标记
+    uint16_t LDIR_Name1[5];                 // 第1~5个字符，UCS-2
+    uint8_t  LDIR_Attr;                     // 属性，固定为DIRITEM_ATTR_LONG_NAME
+    uint8_t  LDIR_Type;                     // 固定为0
+    uint8_t  LDIR_Chksum;                   // 对应短文件名的校验和
+    uint16_t LDIR_Name2[6];                 // 第6~11个字符
+    uint16_t LDIR_FstClusLO;                // 固定为0
+    uint16_t LDIR_Name3[2];                 // 第12~13个字符
+} lfnitem_t;
+
 /**
  * 完整的DBR类型: 共496B, 一个扇区最后2B用于结束标记0x55和0xaa
  * 一个磁盘 = MBR + 分区FAT + 分区NTFS + ...
@@ -71,8 +107,77 @@ typedef struct _dbr_t {
 	uint8_t BS_FileSysType[8];             // 文件类型名称
 } dbr_t;
 
+/**
+ * FAT32的DBR：BPB_TotSec32之前与FAT16相同，之后为FAT32的扩展字段
+ */
+typedef struct _dbr32_t {
+    uint8_t BS_jmpBoot[3];                 // 跳转代码
+    uint8_t BS_OEMName[8];                 // OEM名称
+    uint16_t BPB_BytsPerSec;               // 每扇区字节数
+    uint8_t BPB_SecPerClus;                // 每簇扇区数
+    uint16_t BPB_RsvdSecCnt;               // 保留区扇区数
+    uint8_t BPB_NumFATs;                   // FAT表的份数
+    uint16_t BPB_RootEntCnt;               // 固定为0
+    uint16_t BPB_TotSec16;                 // 固定为0
+    uint8_t BPB_Media;                     // 媒体类型
+    uint16_t BPB_FATSz16;                  // 固定为0
+    uint16_t BPB_SecPerTrk;                // 每磁道扇区数
+    uint16_t BPB_NumHeads;                 // 磁头数
+    uint32_t BPB_HiddSec;                  // 隐藏扇区数
+    uint32_t BPB_TotSec32;                 // 总的扇区数
+
+    uint32_t BPB_FATSz32;                  // 每个FAT表的扇区数
+    uint16_t BPB_ExtFlags;                 // bit7为1时只使用bit0~3指定的FAT表，否则各表互为镜像
+    uint16_t BPB_FSVer;                    // 版本号
+    uint32_t BPB_RootClus;                 // 根目录的起始簇
+    uint16_t BPB_FSInfo;                   // FSInfo所在扇区
+    uint16_t BPB_BkBootSec;                // 备份引导扇区
+    uint8_t BPB_Reserved[12];
+    uint8_t BS_DrvNum;                     // 磁盘驱动器参数
+    uint8_t BS_Reserved1;
+    uint8_t BS_BootSig;                    // 扩展引导标记
+    uint32_t BS_VolID;                     // 卷序列号
+    uint8_t BS_VolLab[11];                 // 磁盘卷标
+    uint8_t BS_FileSysType[8];             // 文件类型名称
+} dbr32_t;
+
+/**
+ * FAT32的FSInfo扇区，保存空闲簇数量和下一空闲簇的提示值
+ */
+typedef struct _fsinfo_t {
+    uint32_t FSI_LeadSig;                  // FSINFO_LEAD_SIG
+    uint8_t FSI_Reserved1[480];
+    uint32_t FSI_StrucSig;                 // FSINFO_STRUC_SIG
+    uint32_t FSI_Free_Count;               // 空闲簇数量，FSINFO_UNKNOWN为未知
+    uint32_t FSI_Nxt_Free;                 // 从该簇开始查找空闲簇
+    uint8_t FSI_Reserved2[12];
+    uint32_t FSI_TrailSig;                 // FSINFO_TRAIL_SIG
+} fsinfo_t;
+
 #pragma pack()
 
+typedef uint32_t cluster_t;
+
+/**
+ * 目录项缓存项：按(所在目录, 名称)散列，避免每次打开文件都线性扫描目录
+ */
+typedef struct _fat_dentry_t {
+    int valid;                              // 是否有效
+    cluster_t dir;                          // 所在目录的起始簇
+    char name[FAT_DCACHE_NAME_SIZE];        // 查找时使用的名称，转换成大写
+    int index;                              // 短文件名项在目录中的索引，-1表示该名称不存在
+    diritem_t item;                         // 短文件名项的内容
+} fat_dentry_t;
+
+/**
+ * 遍历目录时收集的长文件名
+ */
+typedef struct _lfn_state_t {
+    char name[LFN_MAX_LEN + 1];             // 已收集的名称
+    int ord;                                // 最近收集的项的序号，-1表示无效
+    uint8_t chksum;                         // 对应短文件名的校验和
+} lfn_state_t;
+
 /**
  * fat结构
  */
@@ -87,17 +192,42 @@ typedef struct _fat_t {
     uint32_t root_start;                    // 根目录起始扇区号
     uint32_t data_start;                    // 数据区起始扇区号
     uint32_t cluster_byte_size;             // 每簇字节数
+    int fat32;                              // 是否为FAT32
+    cluster_t root_cluster;                 // 根目录的起始簇：FAT16为FAT_ROOT_CLUSTER，FAT32为BPB_RootClus
+    int tbl_active;                         // 只使用一个FAT表时的表号，各表互为镜像时为-1
+    uint32_t fsinfo_sector;                 // FAT32的FSInfo扇区，没有时为0
 
     // 与文件系统读写相关信息
-    uint8_t * fat_buffer;             		// FAT表项缓冲
+    uint8_t * fat_buffer;             		// FAT表项缓冲，至少能容纳一个簇
+    int buf_pages;                          // fat_buffer占用的页数
     int curr_sector;                        // 当前缓存的扇区数
 
+    // FAT表缓存：挂载时整表读入内存，簇链的查找和修改都在内存中完成
+    uint8_t * fat_tbl;                      // 内存中的FAT表，与磁盘上的格式相同
+    int tbl_pages;                          // fat_tbl及下面两个位图共占用的页数
+    uint32_t cluster_total;                 // 簇总数，含0和1两个保留项
+    bitmap_t free_map;                      // 簇占用位图，1表示已占用
+    bitmap_t dirty_map;                     // FAT表扇区脏位图，1表示需要回写
+    uint32_t next_free;                     // 下次查找空闲簇的起始位置
+    uint32_t free_cnt;                      // 空闲簇数量
+    uint32_t resv_cnt;                      // 为延迟分配预留的簇数量，不能再分配给其它用途
+
+    fat_dentry_t * dcache;                  // 目录项缓存，共FAT_DCACHE_SIZE项，挂载时分配，不占用内核的低端内存
+
+    // 最近访问的子目录位置：顺序扫描目录时从这里继续沿簇链查找，不必每项都从头开始
+    cluster_t dpos_dir;                     // 子目录的起始簇，无效值表示没有记录
+    uint32_t dpos_index;                    // 该目录中的第几簇
+    cluster_t dpos_cluster;                 // 对应的簇号
+
+    // 文件数据读写不足一个扇区时的中转缓存，读写磁盘期间不持有mutex，因此不能使用fat_buffer
+    uint8_t * io_buf;                       // FAT_IOBUF_CNT个扇区大小的缓存
+    uint32_t io_free;                       // 空闲缓存位图，1表示空闲
+    sem_t io_sem;                           // 空闲缓存的数量
+
     struct _fs_t * fs;                      // 所在的文件系统
-    mutex_t mutex;                          // 互斥信号量
+    mutex_t mutex;                          // 元数据锁：保护FAT表、目录及fat_buffer，文件数据的读写由文件锁保护
 } fat_t;
 
-typedef uint16_t cluster_t;
-
 #endif // FAT_H
 
 /*
@@ -17,7 +17,25 @@ typedef enum _file_type_t {
     FILE_DIR,
 } file_type_t;
 
+// poll的事件，取值与Linux相同，内核与应用共用
+#define POLLIN                  0x0001      // 有数据可读
+#define POLLPRI                 0x0002      // 有紧急数据可读
+#define POLLOUT                 0x0004      // 可以写入
+#define POLLERR                 0x0008      // 出错
+#define POLLHUP                 0x0010      // 已挂断
+#define POLLNVAL                0x0020      // 文件描述符无效
+
+/**
+ * poll等待的一个文件及其事件
+ */
+struct pollfd {
+    int fd;                             // 文件描述符，小于0时忽略
+    short events;                       // 等待的事件
+    short revents;                      // 实际发生的事件，由内核填写
+};
+
 struct _fs_t;
+struct _inode_t;
 
 /**
  * 文件描述符
@@ -26,18 +44,17 @@ struct _fs_t;
 typedef struct _file_t {
     char file_name[FILE_NAME_SIZE];	    // 文件名
     file_type_t type;                   // 文件类型，TTY文件，普通文件，目录文件
-    uint32_t size;                      // 文件大小
     int ref;                            // 引用计数,一个文件可能被打开多次
 
     int dev_id;                         // 文件所属的设备号，比如文件类型为TTY设备，那么打开的是哪个TTY设备呢？由dev_id标识
 
     int pos;                   	        // 当前位置
-    int sblk;                           // 内部起始块位置
     int cblk;                           // 当前块
-    int p_index;                        // 在父目录中的索引
+    int version;                        // 确定cblk时inode的version
     int mode;					        // 读写模式
 
     struct _fs_t * fs;                  // 所在的文件系统
+    struct _inode_t * inode;            // 文件的共享信息，同一文件的多次打开共享，设备等没有时为0
 } file_t;
 
 
@@ -7,6 +7,9 @@
 #include "tools/list.h"
 #include "applib/lib_syscall.h"
 #include "fs/fatfs/fatfs.h"
+#include "fs/tmpfs/tmpfs.h"
+#include "fs/initramfs/initramfs.h"
+#include "comm/boot_info.h"
 #include "ipc/mutex.h"
 
 struct _fs_t;
@@ -21,27 +24,43 @@ typedef struct _fs_op_t {
     void (*unmount) (struct _fs_t * fs);
 
     int  (*open)    (struct _fs_t * fs, const char * path, file_t * file);
+    int  (*truncate)(file_t * file);                // O_TRUNC打开后调用，此时持有文件锁和fs->mutex
     int  (*read)    (char * buf, int size, file_t * file);
     int  (*write)   (char * buf, int size, file_t * file);
-    void (*close)   (file_t * file);
+    int  (*close)   (file_t * file);
     int  (*seek)    (file_t * file, uint32_t offset, int dir);
     int  (*stat)    (file_t * file, struct stat *st);
+    int  (*path_stat) (struct _fs_t * fs, const char * path, struct stat *st);
     int  (*ioctl)   (file_t * file, int cmd, int arg0, int arg1);
+    int  (*poll)    (file_t * file, int events);     // 返回已就绪的事件，不等待；为0时总是可读写
+    int  (*fsync)   (file_t * file);
+    int  (*sync)    (struct _fs_t * fs, int age);
 
     int  (*opendir) (struct _fs_t * fs,const char * name, DIR * dir);
     int  (*readdir) (struct _fs_t * fs, DIR* dir, struct dirent * dirent);
     int  (*closedir)(struct _fs_t * fs,DIR *dir);
     int  (*unlink)  (struct _fs_t * fs, const char * path);
+    int  (*mkdir)   (struct _fs_t * fs, const char * path);
+    int  (*rmdir)   (struct _fs_t * fs, const char * path);
 } fs_op_t;
 
 #define FS_MOUNTP_SIZE      512
+#define FS_PATH_SIZE        256         // 完整路径的最大长度
+
+// lseek的定位方式，取值与newlib中的SEEK_SET等相同
+#define FS_SEEK_SET         0           // 相对文件开头
+#define FS_SEEK_CUR         1           // 相对当前位置
+#define FS_SEEK_END         2           // 相对文件末尾
 
 
 
 // 文件系统类型
 typedef enum _fs_type_t {
     FS_FAT16,
+    FS_FAT32,
     FS_DEVFS,
+    FS_TMPFS,
+    FS_INITRAMFS,
 } fs_type_t;
 
 
@@ -59,13 +78,15 @@ typedef struct _fs_t {
     // 这样就不用考虑内存分配的问题
     union {
         fat_t fat_data;         // 文件系统相关数据
+        tmpfs_t tmp_data;       // tmpfs的结点表等
+        initramfs_t ramfs_data; // initrd镜像所在的内存
     };
     mutex_t * mutex;              // 文件系统操作互斥信号量
 } fs_t;
 
 
 
-void fs_init (void);
+void fs_init (boot_info_t * boot_info);
 int path_to_num (const char * path, int * num);
 const char * path_next_child (const char * path);
 
@@ -77,15 +98,32 @@ int sys_close(int file);
 
 int sys_isatty(int file);
 int sys_fstat(int file, struct stat *st);
+int sys_stat(const char * path, struct stat *st);
 
 int sys_dup (int file);
 int sys_ioctl(int fd, int cmd, int arg0, int arg1);
+int sys_poll(struct pollfd * fds, int nfds, int timeout);
 
 int sys_opendir(const char * name, DIR * dir);
 int sys_readdir(DIR* dir, struct dirent * dirent);
 int sys_closedir(DIR *dir);
 
 int sys_unlink (const char * path);
+int sys_mkdir (const char * path);
+int sys_rmdir (const char * path);
+int sys_chdir (const char * path);
+int sys_getcwd (char * buf, int size);
+
+int sys_readv (int file, const struct iovec * iov, int iovcnt);
+int sys_writev (int file, const struct iovec * iov, int iovcnt);
+int sys_pread (int file, char * ptr, int len, int offset);
+int sys_pwrite (int file, char * ptr, int len, int offset);
+int sys_sendfile (int out, int in, int * offset, int count);
+int sys_fsync (int file);
+int sys_fdatasync (int file);
+int sys_sync (void);
+
+void fs_writeback_init (void);
 
 #endif // FILE_H
 
@@ -0,0 +1,17 @@
+
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+#include "comm/types.h"
+#include "comm/tar.h"
+
+/**
+ * initramfs文件系统数据：loader读入内存的ustar镜像，只读，直接从镜像中取数据
+ */
+typedef struct _initramfs_t {
+    uint8_t * start;                // 镜像的起始地址
+    uint32_t size;                  // 镜像的字节数
+    int file_cnt;                   // 其中的文件数量
+} initramfs_t;
+
+#endif // INITRAMFS_H
@@ -0,0 +1,68 @@
+
+#ifndef INODE_H
+#define INODE_H
+
+#include "comm/types.h"
+#include "ipc/mutex.h"
+#include "fs/file.h"
+#include "core/memory.h"
+
+#define INODE_TABLE_SIZE        256         // 可同时打开的不同文件的数量
+#define INODE_EXTENT_MAX        (MEM_PAGE_SIZE / sizeof(blk_extent_t))     // 块映射表的最大段数
+#define INODE_DBUF_PAGES        16          // 延迟分配缓存的页数
+
+struct _fs_t;
+
+/**
+ * 块映射表中的一段：文件中连续的若干块在磁盘上也连续
+ */
+typedef struct _blk_extent_t {
+    uint32_t index;                     // 首块在文件中的序号
+    uint32_t start;                     // 首块的块号
+    uint32_t cnt;                       // 块数量
+} blk_extent_t;
+
+/**
+ * 内存中的inode：同一文件的多次打开共享一个，保存与打开方式无关的文件信息
+ * 由(所在文件系统, 所在目录, 在目录中的索引)确定
+ */
+typedef struct _inode_t {
+    int ref;                            // 引用计数，为0时空闲
+    struct _fs_t * fs;                  // 所在的文件系统
+    int p_dir;                          // 父目录的起始位置，如FAT中父目录的起始簇
+    int p_index;                        // 在父目录中的索引
+
+    int valid;                          // 文件信息是否已由文件系统填好
+    int dirty;                          // 大小、起始块等已修改，需回写到目录项
+    uint32_t dirty_tick;                // 开始变脏的时刻，回写任务据此判断修改已存在多久
+    file_type_t type;                   // 文件类型
+    uint32_t size;                      // 文件大小
+    int sblk;                           // 起始块
+    int eblk;                           // 最后一块，未知时为无效值
+    int bcnt;                           // 已分配的块数量，eblk有效时才有效
+    int version;                        // 块链被截断时加1，打开者据此判断自己记录的当前块是否已过时
+    uint32_t atime;                     // 最后访问时间，自1970年起的秒数
+    uint32_t mtime;                     // 最后修改时间
+    uint32_t ctime;                     // 创建时间
+
+    // 块映射表：首次定位时建立，由文件中的块序号直接查出块号，不必沿块链逐块查找
+    blk_extent_t * extents;             // 占一页，未建立时为0
+    int extent_cnt;                     // 有效的段数
+    int map_done;                       // 是否已覆盖整个块链，段数超出上限时只覆盖前一部分
+
+    // 延迟分配：追加到已分配块之后的数据先暂存在内存中，只预留空间，回写时再一次性分配连续的块
+    uint8_t * dbuf;                     // 暂存缓存，占INODE_DBUF_PAGES页，未使用时为0
+    uint32_t dlen;                      // 暂存的字节数，从第bcnt块的开头算起
+    int resv;                           // 为暂存数据预留的块数
+
+    mutex_t mutex;                      // 文件读写锁，同一文件的读写、定位互斥，不同文件之间可并行
+} inode_t;
+
+inode_t * inode_get (struct _fs_t * fs, int p_dir, int p_index);
+inode_t * inode_find (struct _fs_t * fs, int p_dir, int p_index);
+inode_t * inode_next (struct _fs_t * fs, int * index);
+void inode_put (inode_t * inode);
+void inode_set_dirty (inode_t * inode);
+void inode_table_init (void);
+
+#endif // INODE_H
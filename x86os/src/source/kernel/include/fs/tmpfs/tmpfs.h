@@ -0,0 +1,46 @@
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "comm/types.h"
+#include "ipc/mutex.h"
+#include "fs/file.h"
+#include "core/memory.h"
+
+#define TMPFS_NODE_CNT          256         // 文件及目录的总数上限，含根目录
+#define TMPFS_NAME_SIZE         32          // 名称的最大长度，含结束符
+#define TMPFS_HASH_SIZE         16          // 目录散列表的桶数
+#define TMPFS_ROOT              0           // 根目录的结点号
+#define TMPFS_NODE_NONE         -1          // 空结点号，用于结束散列链等
+#define TMPFS_PAGE_MAX          (MEM_PAGE_SIZE / sizeof(uint32_t))     // 单个文件的最大页数，页表占一页
+
+/**
+ * tmpfs中的一个文件或目录，全部保存在内存中
+ */
+typedef struct _tmpfs_node_t {
+    int used;                               // 是否已使用
+    char name[TMPFS_NAME_SIZE];             // 名称
+    file_type_t type;                       // FILE_NORMAL或FILE_DIR
+    int parent;                             // 所在目录的结点号
+    int next;                               // 所在目录中同一个桶里的下一项
+
+    // 目录：子项按名称散列到各个桶中
+    int hash[TMPFS_HASH_SIZE];              // 各个桶的首项
+    int child_cnt;                          // 子项数量
+
+    // 文件：数据按页存放，页表中依次记录各页的地址
+    uint32_t size;                          // 文件大小
+    uint32_t * pages;                       // 页表，占一页，未写入数据时为0
+    int page_cnt;                           // 已分配的数据页数
+} tmpfs_node_t;
+
+/**
+ * tmpfs文件系统数据
+ */
+typedef struct _tmpfs_t {
+    tmpfs_node_t * nodes;                   // 结点表，挂载时分配
+    int node_pages;                         // 结点表占用的页数
+    mutex_t mutex;                          // 元数据锁：保护结点表及目录，文件数据的读写由文件锁保护
+} tmpfs_t;
+
+#endif // TMPFS_H
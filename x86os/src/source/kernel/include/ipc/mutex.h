@@ -2,14 +2,15 @@
 #ifndef MUTEX_H
 #define MUTEX_H
 
-#include "core/task.h"
 #include "tools/list.h"
 
+struct _task_t;
+
 /**
  * 进程同步用的计数信号量
  */
 typedef struct _mutex_t {
-    task_t * owner;
+    struct _task_t * owner;
     int locked_count;
     list_t wait_list;
 }mutex_t;
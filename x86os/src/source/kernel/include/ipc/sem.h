@@ -2,6 +2,7 @@
 #ifndef OS_SEM_H
 #define OS_SEM_H
 
+#include "comm/types.h"
 #include "tools/list.h"
 
 /**
@@ -14,6 +15,7 @@ typedef struct _sem_t {
 
 void sem_init (sem_t * sem, int init_count);
 void sem_wait (sem_t * sem);
+int sem_wait_timeout (sem_t * sem, uint32_t ms);
 void sem_notify (sem_t * sem);
 int sem_count (sem_t * sem);
 
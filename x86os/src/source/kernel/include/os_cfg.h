@@ -18,4 +18,7 @@
 
 #define ROOT_DEV            DEV_DISK, 0xb1  // 根目录所在的设备
 
+#define FS_WRITEBACK_PERIOD_MS  1000        // 回写任务的检查周期
+#define FS_WRITEBACK_AGE_MS     5000        // 文件有未回写的修改超过该时长后由回写任务回写
+
 #endif //OS_OS_CFG_H
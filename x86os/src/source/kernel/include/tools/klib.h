@@ -27,8 +27,10 @@ void kernel_memcpy (void * dest, void * src, int size);
 void kernel_memset(void * dest, uint8_t v, int size);
 int kernel_memcmp (void * d1, void * d2, int size);
 void kernel_itoa(char * buf, int num, int base);
-void kernel_sprintf(char * buffer, const char * fmt, ...);
-void kernel_vsprintf(char * buffer, const char * fmt, va_list args);
+int kernel_sprintf(char * buffer, const char * fmt, ...);
+int kernel_snprintf(char * buffer, int size, const char * fmt, ...);
+int kernel_vsprintf(char * buffer, const char * fmt, va_list args);
+int kernel_vsnprintf(char * buffer, int size, const char * fmt, va_list args);
 
 #ifndef RELEASE
 #define ASSERT(condition)    \
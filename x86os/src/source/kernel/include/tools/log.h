@@ -2,7 +2,24 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdarg.h>
+
+// 日志级别，数值越小越重要
+#define LOG_ERR             3
+#define LOG_WARN            4
+#define LOG_INFO            6
+#define LOG_DEBUG           7
+
+#define LOG_CONSOLE_LEVEL   LOG_INFO        // 不高于该级别的日志才输出到控制台，其余只能用dmesg查看
+#define LOG_TEXT_SIZE       128             // 单条日志的最大长度
+
 void log_init (void);
+void log_task_init (void);
+void log_flush (void);
+void log_vprintf (int level, const char * fmt, va_list args);
+void log_level_printf (int level, const char * fmt, ...);
 void log_printf(const char * fmt, ...);
 
-#endif // LOG_H
\ No newline at end of file
+int sys_dmesg (char * buf, int size);
+
+#endif // LOG_H
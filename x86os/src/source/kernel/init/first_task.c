@@ -39,6 +39,8 @@ int first_task_main (void) {
             char tty_num[] = "/dev/tty?";
             tty_num[sizeof(tty_num) - 2] = i + '0';
             char * argv[] = {tty_num, (char *)0};
+            // 优先从内存中的initramfs加载，没有initrd时再从磁盘加载
+            execve("/bin/shell.elf", argv, (char **)0);
             execve("shell.elf", argv, (char **)0);
             print_msg("create shell proc failed", 0);
             while (1) {
@@ -47,6 +49,18 @@ int first_task_main (void) {
         }
     }
 
+    // 串口上也运行一个shell，没有串口时shell打开失败后退出
+    int pid = fork();
+    if (pid == 0) {
+        char * argv[] = {"/dev/ttyS0", (char *)0};
+        execve("/bin/shell.elf", argv, (char **)0);
+        execve("shell.elf", argv, (char **)0);
+        print_msg("create shell proc failed", 0);
+        while (1) {
+            msleep(10000);
+        }
+    }
+
     while (1) {
         // 不断收集孤儿进程
         int status;
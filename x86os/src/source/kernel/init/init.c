@@ -26,13 +26,17 @@ void kernel_init (boot_info_t * boot_info) {
     // 初始化CPU，再重新加载
     cpu_init();   // 对GDT表初始化，对互斥锁进行初始化
     irq_init();
-    log_init();
 
     // 内存初始化要放前面一点，因为后面的代码可能需要内存分配
+    // 控制台的缓存从内存中分配，日志输出在其后初始化，此前的日志先保存在日志缓存中
     memory_init(boot_info);
-    fs_init();  // 文件系统初始化
+    log_init();
+    fs_init(boot_info);  // 文件系统初始化
     time_init();
     task_manager_init();
+    log_task_init();
+    kbd_task_init();
+    fs_writeback_init();
 }
 
 
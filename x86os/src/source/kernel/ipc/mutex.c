@@ -1,6 +1,7 @@
 
 #include "cpu/irq.h"
 #include "ipc/mutex.h"
+#include "core/task.h"
 
 /**
  * 锁初始化
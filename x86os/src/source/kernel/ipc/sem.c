@@ -2,6 +2,7 @@
 #include "cpu/irq.h"
 #include "core/task.h"
 #include "ipc/sem.h"
+#include "os_cfg.h"
 
 /**
  * 信号量初始化
@@ -30,6 +31,34 @@ void sem_wait (sem_t * sem) {
     irq_leave_protection(irq_state);
 }
 
+/**
+ * 限时申请信号量，超时返回-1
+ * 等待时同时位于信号量的等待队列和睡眠队列，由先到者将其从另一队列中移除
+ */
+int sem_wait_timeout (sem_t * sem, uint32_t ms) {
+    irq_state_t  irq_state = irq_enter_protection();
+
+    int err = 0;
+    if (sem->count > 0) {
+        sem->count--;
+    } else if (ms == 0) {
+        err = -1;
+    } else {
+        task_t * curr = task_current();
+        task_set_block(curr);
+        list_insert_last(&sem->wait_list, &curr->wait_node);
+        curr->wait_list = &sem->wait_list;
+        task_set_sleep(curr, (ms + (OS_TICK_MS - 1)) / OS_TICK_MS);
+        task_dispatch();
+
+        // 超时唤醒时睡眠计数已减到0，被通知唤醒时还有剩余
+        err = (curr->sleep_ticks == 0) ? -1 : 0;
+    }
+
+    irq_leave_protection(irq_state);
+    return err;
+}
+
 /**
  * 释放信号量
  */
@@ -40,6 +69,11 @@ void sem_notify (sem_t * sem) {
         // 有进程等待，则唤醒加入就绪队列
         list_node_t * node = list_remove_first(&sem->wait_list);
         task_t * task = list_node_parent(node, task_t, wait_node);
+        if (task->wait_list) {
+            // 限时等待的任务还在睡眠队列中
+            task->wait_list = (list_t *)0;
+            task_set_wakeup(task);
+        }
         task_set_ready(task);
 
         task_dispatch();
@@ -56,9 +56,10 @@ int bitmap_alloc_nbits (bitmap_t * bitmap, int bit, int count) {
     int search_idx = 0;
     int ok_idx = -1;
 
+    bit = bit ? 1 : 0;
     while (search_idx < bitmap->bit_count) {
         // 定位到第一个相同的索引处
-        if (bitmap_get_bit(bitmap, search_idx) != bit) {
+        if (bitmap_is_set(bitmap, search_idx) != bit) {
             // 不同，继续寻找起始的bit
             search_idx++;
             continue;
@@ -67,21 +68,23 @@ int bitmap_alloc_nbits (bitmap_t * bitmap, int bit, int count) {
         // 记录起始索引
         ok_idx = search_idx;
 
-        // 继续计算下一部分
+        // 继续检查后续的count-1个位
         int i;
-        for (i = 1; (i < count) && (search_idx < bitmap->bit_count); i++) {
-            if (bitmap_get_bit(bitmap, search_idx++) != bit) {
-                // 不足count个，退出，重新进行最外层的比较
-                ok_idx = -1;
+        for (i = 1; i < count; i++) {
+            if ((ok_idx + i >= bitmap->bit_count) || (bitmap_is_set(bitmap, ok_idx + i) != bit)) {
+                // 不足count个，退出，从不匹配的位之后重新比较
                 break;
             }
         }
 
         // 找到，设置各位，然后退出
         if (i >= count) {
-            bitmap_set_bit(bitmap, ok_idx, count, ~bit);
+            bitmap_set_bit(bitmap, ok_idx, count, !bit);
             return ok_idx;
         }
+
+        search_idx = ok_idx + i + 1;
+        ok_idx = -1;
     }
 
     return -1;
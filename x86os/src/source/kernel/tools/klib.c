@@ -181,64 +181,285 @@ void kernel_itoa(char * buf, int num, int base) {
     }
 }
 
+/**
+ * @brief 64位数除以32位数，商写回num，返回余数
+ * 内核没有链接libgcc，不能直接对64位数做除法。先除高32位，余数与低32位组成的数再用divl除，
+ * 此时余数小于除数，商不会溢出
+ */
+static uint32_t div_u64 (uint64_t * num, uint32_t base) {
+    uint32_t high = (uint32_t)(*num >> 32);
+    uint32_t low = (uint32_t)*num;
+    uint32_t rem = 0;
+
+    if (high >= base) {
+        rem = high % base;
+        high = high / base;
+    } else {
+        rem = high;
+        high = 0;
+    }
+
+    __asm__ __volatile__("divl %[base]" : "+a"(low), "+d"(rem) : [base]"rm"(base));
+    *num = ((uint64_t)high << 32) | low;
+    return rem;
+}
+
 /**
  * @brief 格式化字符串到缓存中
  */
-void kernel_sprintf(char * buffer, const char * fmt, ...) {
+int kernel_sprintf(char * buffer, const char * fmt, ...) {
     va_list args;
 
     va_start(args, fmt);
-    kernel_vsprintf(buffer, fmt, args);
+    int len = kernel_vsprintf(buffer, fmt, args);
     va_end(args);
+    return len;
+}
+
+int kernel_snprintf(char * buffer, int size, const char * fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int len = kernel_vsnprintf(buffer, size, fmt, args);
+    va_end(args);
+    return len;
+}
+
+/**
+ * 格式化字符串，不限制长度
+ */
+int kernel_vsprintf(char * buffer, const char * fmt, va_list args) {
+    return kernel_vsnprintf(buffer, 0x7FFFFFFF, fmt, args);
 }
 
 /**
- * 格式化字符串
+ * @brief 格式化字符串，最多写入size-1个字符，总是以'\0'结尾
+ * 返回完整输出所需的长度（不含'\0'），大于等于size时说明输出被截断
+ * 格式为%[-0][宽度][.精度][l|ll]转换符，宽度和精度可用*从参数中取
+ * 转换符支持d i u x X o p c s %，精度只对s有效，ll表示64位整数
  */
-void kernel_vsprintf(char * buffer, const char * fmt, va_list args) {
-    enum {NORMAL, READ_FMT} state = NORMAL;
+int kernel_vsnprintf(char * buffer, int size, const char * fmt, va_list args) {
+    static const char * lower_digits = "0123456789abcdef";
+    static const char * upper_digits = "0123456789ABCDEF";
+    int count = 0;          // 已输出（或应输出）的字符数
+    int max = (size > 0) ? size - 1 : 0;
     char ch;
-    char * curr = buffer;
+
+// 写入一个字符，超出缓存的部分只计数
+#define PUT_CHAR(c)     do { if (count < max) buffer[count] = (c); count++; } while (0)
+
     while ((ch = *fmt++)) {
-        switch (state) {
-            // 普通字符
-            case NORMAL:
-                if (ch == '%') {
-                    state = READ_FMT;
-                } else {
-                    *curr++ = ch;
-                }
+        if (ch != '%') {
+            PUT_CHAR(ch);
+            continue;
+        }
+
+        // 标志
+        int left = 0, zero = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') {
+                left = 1;
+            } else if (*fmt == '0') {
+                zero = 1;
+            } else {
                 break;
-            // 格式化控制字符，只支持部分
-            case READ_FMT:
-                if (ch == 'd') {
-                    int num = va_arg(args, int);
-                    kernel_itoa(curr, num, 10);
-                    curr += kernel_strlen(curr);
-                } else if (ch == 'x') {
-                    int num = va_arg(args, int);
-                    kernel_itoa(curr, num, 16);
-                    curr += kernel_strlen(curr);
-                } else if (ch == 'c') {
-                    char c = va_arg(args, int);
-                    *curr++ = c;
-                } else if (ch == 's') {
-                    const char * str = va_arg(args, char *);
-                    int len = kernel_strlen(str);
-                    while (len--) {
-                        *curr++ = *str++;
-                    }
+            }
+        }
+
+        // 宽度
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                left = 1;
+                width = -width;
+            }
+            fmt++;
+        } else {
+            while ((*fmt >= '0') && (*fmt <= '9')) {
+                width = width * 10 + (*fmt++ - '0');
+            }
+        }
+
+        // 精度
+        int precision = -1;
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
+                precision = va_arg(args, int);
+                fmt++;
+            } else {
+                while ((*fmt >= '0') && (*fmt <= '9')) {
+                    precision = precision * 10 + (*fmt++ - '0');
                 }
-                state = NORMAL;
+            }
+        }
+
+        // 长度，long与int同为32位，只需区分ll
+        int is_64 = 0;
+        if (*fmt == 'l') {
+            fmt++;
+            if (*fmt == 'l') {
+                is_64 = 1;
+                fmt++;
+            }
+        }
+
+        ch = *fmt++;
+        if (ch == '\0') {
+            break;
+        }
+
+        // 字符和字符串
+        const char * str = (const char *)0;
+        int str_len = 0;
+        char c;
+        if (ch == 'c') {
+            c = (char)va_arg(args, int);
+            str = &c;
+            str_len = 1;
+        } else if (ch == 's') {
+            str = va_arg(args, const char *);
+            if (str == (const char *)0) {
+                str = "(null)";
+            }
+            while (((precision < 0) || (str_len < precision)) && str[str_len]) {
+                str_len++;
+            }
+        } else if (ch == '%') {
+            PUT_CHAR('%');
+            continue;
+        }
+
+        if (str) {
+            int pad = width - str_len;
+            while (!left && (pad-- > 0)) {
+                PUT_CHAR(' ');
+            }
+            for (int i = 0; i < str_len; i++) {
+                PUT_CHAR(str[i]);
+            }
+            while (left && (pad-- > 0)) {
+                PUT_CHAR(' ');
+            }
+            continue;
+        }
+
+        // 整数：取出数值和进制
+        uint32_t base;
+        const char * digits = lower_digits;
+        int is_signed = 0;
+        switch (ch) {
+            case 'd':
+            case 'i':
+                base = 10;
+                is_signed = 1;
+                break;
+            case 'u':
+                base = 10;
+                break;
+            case 'X':
+                digits = upper_digits;
+                base = 16;
+                break;
+            case 'x':
+                base = 16;
                 break;
+            case 'o':
+                base = 8;
+                break;
+            case 'p':
+                base = 16;
+                is_64 = 0;
+                PUT_CHAR('0');
+                PUT_CHAR('x');
+                width -= 2;
+                break;
+            default:
+                // 不支持的转换符，原样输出
+                PUT_CHAR('%');
+                PUT_CHAR(ch);
+                continue;
+        }
+
+        uint64_t num;
+        int negative = 0;
+        if (is_64) {
+            num = va_arg(args, uint64_t);
+            if (is_signed && ((long long)num < 0)) {
+                negative = 1;
+                num = -num;
+            }
+        } else if (is_signed) {
+            int value = va_arg(args, int);
+            negative = value < 0;
+            num = negative ? -(uint32_t)value : (uint32_t)value;
+        } else {
+            num = va_arg(args, uint32_t);
+        }
+
+        // 数字逆序放入临时缓存，64位八进制最多22位
+        char tmp[24];
+        int len = 0;
+        if ((uint32_t)(num >> 32) == 0) {
+            // 大多数情况下只需32位运算。常数除数可被编译成乘法和移位，比divl快得多
+            uint32_t n = (uint32_t)num;
+            if (base == 10) {
+                do {
+                    tmp[len++] = '0' + n % 10;
+                    n /= 10;
+                } while (n);
+            } else {
+                uint32_t shift = (base == 16) ? 4 : 3;
+                do {
+                    tmp[len++] = digits[n & (base - 1)];
+                    n >>= shift;
+                } while (n);
+            }
+        } else {
+            do {
+                tmp[len++] = digits[div_u64(&num, base)];
+            } while (num);
+        }
+
+        int pad = width - len - negative;
+        if (!left && !zero) {
+            while (pad-- > 0) {
+                PUT_CHAR(' ');
+            }
+        }
+        if (negative) {
+            PUT_CHAR('-');
+        }
+        if (!left && zero) {
+            while (pad-- > 0) {
+                PUT_CHAR('0');
+            }
+        }
+        while (len) {
+            PUT_CHAR(tmp[--len]);
+        }
+        while (left && (pad-- > 0)) {
+            PUT_CHAR(' ');
         }
     }
+
+#undef PUT_CHAR
+
+    if (size > 0) {
+        buffer[(count < max) ? count : max] = '\0';
+    }
+    return count;
 }
 
 void panic (const char * file, int line, const char * func, const char * cond) {
     log_printf("assert failed! %s", cond);
     log_printf("file: %s\nline %d\nfunc: %s\n", file, line, func);
 
+    // 日志任务可能已无法运行，直接输出
+    log_flush();
+
     for (;;) {
         hlt();
     }
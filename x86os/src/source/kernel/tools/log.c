@@ -5,75 +5,316 @@
 #include "tools/log.h"
 #include "cpu/irq.h"
 #include "os_cfg.h"
-#include "ipc/mutex.h"
+#include "ipc/sem.h"
 #include "dev/console.h"
 #include "dev/dev.h"
+#include "dev/time.h"
+#include "core/task.h"
+#include "core/memory.h"
 
-// 目标用串口，参考资料：https://wiki.osdev.org/Serial_Ports
-#define LOG_USE_COM         0
-#define COM1_PORT           0x3F8       // RS232端口0初始化
+// 日志同时输出到串口/dev/ttyS0，由发送中断取走，不占用CPU。qemu中可用-serial file:保存
+#define LOG_USE_COM         1
 
-static mutex_t mutex;
-static int log_dev_id;
+// 日志先追加到内存中的环形缓存，再由日志任务异步输出到控制台，dmesg可读取整个缓存
+// 写入只在关中断的很短时间内复制数据，不会睡眠，中断中也可以使用
+#define LOG_BUF_PAGES       4               // 缓存的页数，在log_init中分配
+#define LOG_EARLY_SIZE      1024            // 分配之前使用的临时缓存，只存放内存初始化过程中的少量日志
+#define LOG_WRAP            0xFFFF          // 回绕标记：缓存末尾放不下时，从头开始
 
 /**
- * @brief 初始化日志输出
+ * 日志记录的头部，正文紧随其后，整条记录按4字节对齐
+ */
+typedef struct _log_record_t {
+    uint32_t seq;                   // 序号，连续递增
+    uint32_t tick;                  // 产生时的时钟节拍
+    uint16_t len;                   // 正文长度，为LOG_WRAP时表示回绕
+    uint8_t level;                  // 日志级别
+    uint8_t reserved;
+} log_record_t;
+
+/**
+ * 读取位置，各读者分别维护
+ */
+typedef struct _log_cursor_t {
+    uint32_t seq;                   // 下一条要读的序号
+    int off;                        // 该记录在缓存中的位置
+} log_cursor_t;
+
+// 内核数据位于低端内存，空间有限，缓存从页中分配。之前的日志先存入临时缓存，写满后丢弃，分配后复制过去
+static uint8_t log_early_buf[LOG_EARLY_SIZE] __attribute__((aligned(4)));
+static uint8_t * log_buf = log_early_buf;
+static int log_buf_size = LOG_EARLY_SIZE;
+static int log_early = 1;               // 是否还在使用临时缓存
+static uint32_t first_seq, next_seq;    // 缓存中最老的记录、下一条记录的序号
+static int first_off, next_off;         // 最老的记录、下一条记录的位置
+
+static sem_t log_sem;                   // 有新日志时通知日志任务
+static task_t log_task;                 // 将日志输出到控制台的任务
+static log_cursor_t console_cursor;     // 控制台输出到的位置
+static int log_dev_id = -1;             // 打开控制台前为-1
+static int log_com_id = -1;             // 没有串口时为-1
+
+
+
+// static inline int log_record_size (int len);
+// static inline log_record_t * log_record_at (int off);
+// static inline int log_valid_off (int off);
+// static void log_drop_range (int start, int end);
+// static void log_append (int level, const char * str, int len);
+// static int log_read_next (log_cursor_t * cursor, log_record_t * rec, char * text, int size);
+// static void log_print_pending (void);
+
+
+
+/**
+ * @brief 记录占用的字节数
+ */
+static inline int log_record_size (int len) {
+    return (sizeof(log_record_t) + len + 3) & ~3;
+}
+
+static inline log_record_t * log_record_at (int off) {
+    return (log_record_t *)(log_buf + off);
+}
+
+/**
+ * @brief 跳过回绕：末尾放不下记录头或者是回绕标记时，记录位于缓存开头
+ * 只能用于已写入记录的位置
+ */
+static inline int log_valid_off (int off) {
+    if ((off + sizeof(log_record_t) > log_buf_size) || (log_record_at(off)->len == LOG_WRAP)) {
+        return 0;
+    }
+    return off;
+}
+
+/**
+ * @brief 丢弃位于[start, end)中的最老的记录，以便写入新记录
+ */
+static void log_drop_range (int start, int end) {
+    while ((first_seq != next_seq) && (first_off >= start) && (first_off < end)) {
+        first_off += log_record_size(log_record_at(first_off)->len);
+        if (++first_seq != next_seq) {
+            first_off = log_valid_off(first_off);
+        }
+    }
+}
+
+/**
+ * @brief 追加一条日志，空间不足时覆盖最老的记录
+ */
+static void log_append (int level, const char * str, int len) {
+    int size = log_record_size(len);
+
+    irq_state_t state = irq_enter_protection();
+    int off = next_off;
+    if (log_early && (off + size > log_buf_size)) {
+        // 临时缓存不回绕，以便分配后直接复制
+        irq_leave_protection(state);
+        return;
+    }
+
+    if (off + size > log_buf_size) {
+        // 末尾放不下，末尾的记录作废，能放下记录头时写入回绕标记
+        log_drop_range(off, log_buf_size);
+        if (off + sizeof(log_record_t) <= log_buf_size) {
+            log_record_at(off)->len = LOG_WRAP;
+        }
+        off = 0;
+    }
+    log_drop_range(off, off + size);
+
+    log_record_t * rec = log_record_at(off);
+    rec->seq = next_seq;
+    rec->tick = time_get_tick();
+    rec->len = len;
+    rec->level = level;
+    kernel_memcpy(rec + 1, (void *)str, len);
+
+    if (first_seq == next_seq) {
+        first_off = off;
+    }
+    next_seq++;
+    next_off = off + size;
+    irq_leave_protection(state);
+
+    // 通知日志任务输出
+    sem_notify(&log_sem);
+}
+
+/**
+ * @brief 读取下一条日志，正文超过size时截断，返回正文长度，没有新日志时返回-1
+ * 读得太慢时，未读的记录可能已被覆盖，此时从最老的记录开始
+ */
+static int log_read_next (log_cursor_t * cursor, log_record_t * rec, char * text, int size) {
+    irq_state_t state = irq_enter_protection();
+    if ((int)(cursor->seq - first_seq) < 0) {
+        cursor->seq = first_seq;
+        cursor->off = first_off;
+    }
+
+    if (cursor->seq == next_seq) {
+        irq_leave_protection(state);
+        return -1;
+    }
+
+    int off = log_valid_off(cursor->off);
+    *rec = *log_record_at(off);
+    int len = (rec->len < size) ? rec->len : size;
+    kernel_memcpy(text, log_record_at(off) + 1, len);
+
+    cursor->seq++;
+    cursor->off = off + log_record_size(rec->len);
+    irq_leave_protection(state);
+    return len;
+}
+
+/**
+ * @brief 将尚未输出的日志输出到控制台和串口
+ */
+static void log_print_pending (void) {
+    log_record_t rec;
+    char text[LOG_TEXT_SIZE];
+    int len;
+
+    if (log_dev_id < 0) {
+        return;
+    }
+
+    while ((len = log_read_next(&console_cursor, &rec, text, sizeof(text))) >= 0) {
+        if (rec.level > LOG_CONSOLE_LEVEL) {
+            continue;
+        }
+
+        char c = '\n';
+        dev_write(log_dev_id, 0, "log:", 4);
+        dev_write(log_dev_id, 0, text, len);
+        dev_write(log_dev_id, 0, &c, 1);
+
+        // 串口只是放入发送缓存，\n由tty展开成\r\n
+        if (log_com_id >= 0) {
+            dev_write(log_com_id, 0, "log:", 4);
+            dev_write(log_com_id, 0, text, len);
+            dev_write(log_com_id, 0, &c, 1);
+        }
+    }
+}
+
+/**
+ * @brief 日志任务：有新日志时输出到控制台
+ */
+static void log_task_entry (void) {
+    for (;;) {
+        // 先输出启动过程中已有的日志
+        log_print_pending();
+        sem_wait(&log_sem);
+    }
+}
+
+/**
+ * @brief 初始化日志输出，需在内存管理初始化之后调用
  */
 void log_init (void) {
-    mutex_init(&mutex);
+    sem_init(&log_sem, 0);
+
+    // 临时缓存中的日志从头开始存放，没有回绕，原样复制过去后位置都不变
+    // 分配失败时继续使用临时缓存，此后正常回绕
+    uint8_t * buf = (uint8_t *)memory_alloc_pages(LOG_BUF_PAGES);
+    irq_state_t state = irq_enter_protection();
+    if (buf) {
+        kernel_memcpy(buf, log_early_buf, next_off);
+        log_buf = buf;
+        log_buf_size = LOG_BUF_PAGES * MEM_PAGE_SIZE;
+    }
+    log_early = 0;
+    irq_leave_protection(state);
 
     log_dev_id = dev_open(DEV_TTY, 0, 0);
 
 #if LOG_USE_COM
-    outb(COM1_PORT + 1, 0x00);    // Disable all interrupts
-    outb(COM1_PORT + 3, 0x80);    // Enable DLAB (set baud rate divisor)
-    outb(COM1_PORT + 0, 0x03);    // Set divisor to 3 (lo byte) 38400 baud
-    outb(COM1_PORT + 1, 0x00);    //                  (hi byte)
-    outb(COM1_PORT + 3, 0x03);    // 8 bits, no parity, one stop bit
-    outb(COM1_PORT + 2, 0xC7);    // Enable FIFO, clear them, with 14-byte threshold
-  
-    // If serial is not faulty set it in normal operation mode
-    // (not-loopback with IRQs enabled and OUT#1 and OUT#2 bits enabled)
-    outb(COM1_PORT + 4, 0x0F);
+    log_com_id = dev_open(DEV_SERIAL, 0, 0);
 #endif
 }
 
 /**
- * @brief 日志打印
+ * @brief 创建日志任务，运行于内核模式。需在任务管理器初始化后调用
+ * 之前产生的日志保存在缓存中，任务运行后再输出
  */
-void log_printf(const char * fmt, ...) {
-    char str_buf[128];
+void log_task_init (void) {
+    int err = task_init(&log_task, "klog", TASK_FLAG_SYSTEM, (uint32_t)log_task_entry, 0);
+    ASSERT(err == 0);
+    task_start(&log_task);
+}
+
+/**
+ * @brief 立即输出所有未输出的日志，用于panic等无法再等日志任务的场合
+ */
+void log_flush (void) {
+    log_print_pending();
+}
+
+/**
+ * @brief 按指定级别打印日志
+ */
+void log_vprintf (int level, const char * fmt, va_list args) {
+    char str_buf[LOG_TEXT_SIZE];
+
+    // 过长的日志被截断
+    int len = kernel_vsnprintf(str_buf, sizeof(str_buf), fmt, args);
+    if (len >= (int)sizeof(str_buf)) {
+        len = sizeof(str_buf) - 1;
+    }
+    log_append(level, str_buf, len);
+}
+
+void log_level_printf (int level, const char * fmt, ...) {
     va_list args;
 
-    kernel_memset(str_buf, '\0', sizeof(str_buf));
+    va_start(args, fmt);
+    log_vprintf(level, fmt, args);
+    va_end(args);
+}
+
+/**
+ * @brief 日志打印，级别为LOG_INFO
+ */
+void log_printf(const char * fmt, ...) {
+    va_list args;
 
     va_start(args, fmt);
-    kernel_vsprintf(str_buf, fmt, args);
+    log_vprintf(LOG_INFO, fmt, args);
     va_end(args);
+}
 
-    // 显示，如果发送速度太慢，会造成这里关中断太长时间
-    // 所以，这里这样做不是好办法
-    mutex_lock(&mutex);
-    
-#if LOG_USE_COM
-    const char * p = str_buf;    
-    while (*p != '\0') {
-        while ((inb(COM1_PORT + 5) & (1 << 6)) == 0);
-        outb(COM1_PORT, *p++);
+/**
+ * @brief 读取日志缓存中的所有记录，每条一行，格式为"<级别>[秒.毫秒] 正文"
+ * 返回写入的字节数，缓存放不下时只返回能放下的完整行
+ */
+int sys_dmesg (char * buf, int size) {
+    if ((buf == (char *)0) || (size <= 0)) {
+        return -1;
     }
 
-    outb(COM1_PORT, '\r');
-    outb(COM1_PORT, '\n');
-#else
-    //console_write(0, str_buf, kernel_strlen(str_buf));
-    dev_write(log_dev_id, 0, "log:", 4);
-    dev_write(log_dev_id, 0, str_buf, kernel_strlen(str_buf));
+    log_cursor_t cursor = {.seq = first_seq - 1, .off = 0};   // 落后于最老的记录，从头读
+    log_record_t rec;
+    char text[LOG_TEXT_SIZE];
+    int total = 0;
+    int len;
 
-    char c = '\n';
-    //console_write(0, &c, 1);
-    dev_write(log_dev_id, 0, &c, 1);
+    while ((len = log_read_next(&cursor, &rec, text, sizeof(text))) >= 0) {
+        // 行首："<6>[   12.340] "
+        char head[32];
+        uint32_t ms = rec.tick * OS_TICK_MS;
+        int head_len = kernel_snprintf(head, sizeof(head), "<%d>[%5u.%03u] ", rec.level, ms / 1000, ms % 1000);
 
-#endif
-    mutex_unlock(&mutex);
-}
+        if (total + head_len + len + 1 > size) {
+            break;
+        }
+        kernel_memcpy(buf + total, head, head_len);
+        kernel_memcpy(buf + total + head_len, text, len);
+        total += head_len + len;
+        buf[total++] = '\n';
+    }
 
+    return total;
+}
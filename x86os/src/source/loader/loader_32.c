@@ -4,6 +4,7 @@
 
 #include "loader.h"
 #include "comm/elf.h"
+#include "comm/tar.h"
 
 /**
 * 使用LBA48位模式读取磁盘
@@ -113,6 +114,40 @@ void enable_page_mode (void) {
     write_cr0(read_cr0() | CR0_PG);
 }
 
+/**
+ * @brief 从磁盘上加载initrd镜像
+ * 逐个读入文件头及其数据，遇到无效头(结束处的全0块)时停止，因此只读入实际的内容。
+ * 磁盘上没有镜像时大小为0，内核不再挂载
+ */
+static void load_initrd (void) {
+    uint8_t * buf = (uint8_t *)SYS_INITRD_LOAD_ADDR;
+    int sector = SYS_INITRD_SECTOR;
+    uint32_t size = 0;
+
+    while (size + TAR_BLOCK_SIZE <= SYS_INITRD_MAX_SIZE) {
+        tar_header_t * hdr = (tar_header_t *)(buf + size);
+        read_disk(sector, 1, (uint8_t *)hdr);
+        if (!tar_header_valid(hdr)) {
+            break;
+        }
+
+        // 数据按块补齐，超出上限的文件及其后的全部丢弃
+        int data_sectors = (tar_octal(hdr->size, sizeof(hdr->size)) + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
+        if (size + (1 + data_sectors) * TAR_BLOCK_SIZE > SYS_INITRD_MAX_SIZE) {
+            break;
+        }
+
+        if (data_sectors) {
+            read_disk(sector + 1, data_sectors, buf + size + TAR_BLOCK_SIZE);
+        }
+        sector += 1 + data_sectors;
+        size += (1 + data_sectors) * TAR_BLOCK_SIZE;
+    }
+
+    boot_info.initrd_start = size ? SYS_INITRD_LOAD_ADDR : 0;
+    boot_info.initrd_size = size;
+}
+
 /**
  * 从磁盘上加载内核
  */
@@ -128,6 +163,9 @@ void load_kernel(void) {
 		die(-1);
 	}
 
+	// 在开启分页之前读入，此时使用的都是物理地址
+	load_initrd();
+
 	// 开启分页机制
 	enable_page_mode();
 
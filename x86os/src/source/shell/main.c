@@ -153,9 +153,15 @@ static int do_less (int argc, char ** argv) {
             fputs(buf, stdout);
         }
     } else {
-        // 不使用缓存，这样能直接立即读取到输入而不用等回车
+        // 非规范模式且不使用缓存，这样能直接立即读取到输入而不用等回车
+        struct termios old_tio, tio;
+        tcgetattr(0, &old_tio);
+        tio = old_tio;
+        tio.c_lflag &= ~(ICANON | ECHO);
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(0, TCSANOW, &tio);
         setvbuf(stdin, NULL, _IONBF, 0);
-        ioctl(0, TTY_CMD_ECHO, 0, 0);
         while (1) {
             char * b = fgets(buf, 255, file);
             if (b == NULL ) {
@@ -173,7 +179,7 @@ static int do_less (int argc, char ** argv) {
     less_quit:
     // 恢复为行缓存
         setvbuf(stdin, NULL,_IOLBF, BUFSIZ);
-        ioctl(0, TTY_CMD_ECHO, 1, 0);
+        tcsetattr(0, TCSANOW, &old_tio);
     }
     free(buf);
     fclose(file);
@@ -185,8 +191,8 @@ static int do_less (int argc, char ** argv) {
  * @brief 列出目录内容
  */
 static int do_ls (int argc, char ** argv) {
-    // 打开目录
-	DIR * p_dir = opendir("temp");  // "temp"是随便填入的值，后面并不会用到，课程只支持对磁盘顶层目录/home的遍历
+    // 打开目录，未指定时为当前目录
+	DIR * p_dir = opendir(argc > 1 ? argv[1] : ".");
 	if (p_dir == NULL) {
 		printf("open dir failed\n");
 		return -1;
@@ -216,29 +222,34 @@ static int do_cp (int argc, char ** argv) {
         return -1;
     }
 
-    FILE * from, * to;
-    from = fopen(argv[1], "rb");
-    to = fopen(argv[2], "wb");
-    if (!from || !to) {
+    int err = 0;
+    int from = open(argv[1], O_RDONLY);
+    int to = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC);
+    if ((from < 0) || (to < 0)) {
         puts("open file failed.");
+        err = -1;
         goto cp_failed;
     }
 
-    char * buf = (char *)malloc(255);
-    int size = 0;
-    while ((size = fread(buf, 1, 255, from)) > 0) {
-        fwrite(buf, 1, size, to);
+    // 数据在内核中直接复制，不必经用户缓存逐块读写。写入失败(如磁盘已满)时目标文件不完整
+    int cnt;
+    while ((cnt = sendfile(to, from, (off_t *)0, 0x7FFFFFFF)) > 0) {}
+    if (cnt < 0) {
+        puts("copy file failed.");
+        err = -1;
     }
-    free(buf);
 
 cp_failed:
-    if (from) {
-        fclose(from);
+    if (from >= 0) {
+        close(from);
     }
-    if (to) {
-        fclose(to);
+
+    // 关闭时才回写暂存的数据，同样可能失败
+    if ((to >= 0) && (close(to) < 0) && (err == 0)) {
+        puts("write file failed.");
+        err = -1;
     }
-    return 0;
+    return err;
 }
 
 /**
@@ -259,6 +270,101 @@ static int do_remove (int argc, char ** argv) {
     return 0;
 }
 
+/**
+ * @brief 切换当前目录
+ */
+static int do_cd (int argc, char ** argv) {
+    const char * path = argc > 1 ? argv[1] : "/";
+
+    int err = chdir(path);
+    if (err < 0) {
+        fprintf(stderr, "cd failed: %s\n", path);
+        return err;
+    }
+    return 0;
+}
+
+/**
+ * @brief 显示当前目录
+ */
+static int do_pwd (int argc, char ** argv) {
+    char cwd[128];
+
+    if (getcwd(cwd, sizeof(cwd)) == (char *)0) {
+        fprintf(stderr, "pwd failed\n");
+        return -1;
+    }
+    puts(cwd);
+    return 0;
+}
+
+/**
+ * @brief 创建目录命令
+ */
+static int do_mkdir (int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "no dir");
+        return -1;
+    }
+
+    int err = mkdir(argv[1], 0);
+    if (err < 0) {
+        fprintf(stderr, "mkdir failed: %s", argv[1]);
+        return err;
+    }
+    return 0;
+}
+
+/**
+ * @brief 删除空目录命令
+ */
+static int do_rmdir (int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "no dir");
+        return -1;
+    }
+
+    int err = rmdir(argv[1]);
+    if (err < 0) {
+        fprintf(stderr, "rmdir failed: %s", argv[1]);
+        return err;
+    }
+    return 0;
+}
+
+/**
+ * @brief 将所有文件的修改回写到磁盘
+ */
+static int do_sync (int argc, char ** argv) {
+    sync();
+    return 0;
+}
+
+/**
+ * @brief 显示内核日志缓存中的所有日志
+ */
+static int do_dmesg (int argc, char ** argv) {
+    // 内核日志缓存为16KB，加上每行的级别和时间戳，32KB足够
+    int size = 32 * 1024;
+    char * buf = (char *)malloc(size);
+    if (buf == (char *)0) {
+        fprintf(stderr, "no memory\n");
+        return -1;
+    }
+
+    int len = dmesg(buf, size);
+    if (len < 0) {
+        fprintf(stderr, "read kernel log failed\n");
+        free(buf);
+        return -1;
+    }
+
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    free(buf);
+    return 0;
+}
+
 // 命令列表
 static const cli_cmd_t cmd_list[] = {
     {
@@ -296,6 +402,36 @@ static const cli_cmd_t cmd_list[] = {
         .useage = "rm file -- remove file",
         .do_func = do_remove,
     },
+    {
+        .name = "cd",
+        .useage = "cd [dir] -- change current directory",
+        .do_func = do_cd,
+    },
+    {
+        .name = "pwd",
+        .useage = "pwd -- print current directory",
+        .do_func = do_pwd,
+    },
+    {
+        .name = "mkdir",
+        .useage = "mkdir dir -- create directory",
+        .do_func = do_mkdir,
+    },
+    {
+        .name = "rmdir",
+        .useage = "rmdir dir -- remove empty directory",
+        .do_func = do_rmdir,
+    },
+    {
+        .name = "sync",
+        .useage = "sync -- write cached file data to disk",
+        .do_func = do_sync,
+    },
+    {
+        .name = "dmesg",
+        .useage = "dmesg -- print the kernel log buffer",
+        .do_func = do_dmesg,
+    },
     {
         .name = "quit",
         .useage = "quit from shell",
@@ -345,23 +481,27 @@ static void run_builtin (const cli_cmd_t * cmd, int argc, char ** argv) {
 
 /**
  * 遍历搜索目录，看看文件是否存在，存在返回文件所在路径
+ * 先在当前目录中查找，找不到再依次到/bin和根文件系统的顶层目录中查找
  */
 static const char * find_exec_path (const char * file_name) {
     static char path[255];
+    static const char * fmt_list[] = {"%s", "%s.elf", "/bin/%s", "/bin/%s.elf", "/%s", "/%s.elf"};
 
-    int fd = open(file_name, 0);
-    if (fd < 0) {
-        sprintf(path, "%s.elf", file_name);
-        fd = open(path, 0);
-        if (fd < 0) {
-            return (const char * )0;
+    for (int i = 0; i < sizeof(fmt_list) / sizeof(fmt_list[0]); i++) {
+        // 带有路径的名称不再到顶层目录中查找
+        if ((i >= 2) && strchr(file_name, '/')) {
+            break;
+        }
+
+        sprintf(path, fmt_list[i], file_name);
+        int fd = open(path, 0);
+        if (fd >= 0) {
+            close(fd);
+            return path;
         }
-        close(fd);
-        return path;
-    } else {
-        close(fd);
-        return file_name;
     }
+
+    return (const char * )0;
 }
 
 /**
@@ -389,7 +529,9 @@ static void run_exec_file (const char * path, int argc, char ** argv) {
 
 // shell 进程入口
 int main (int argc, char **argv) {
-	open(argv[0], O_RDWR);
+	if (open(argv[0], O_RDWR) < 0) {
+        return -1;
+    }
     dup(0);     // 标准输出
     dup(0);     // 标准错误输出
 
@@ -255,25 +255,35 @@ static void begin_game (void) {
 	fflush(stdout);
 }
 
+/**
+ * @brief 设置为非规范模式且不回显，按VMIN和VTIME决定读取何时返回
+ */
+static void set_input_mode (const struct termios * old, int vmin, int vtime) {
+	struct termios tio = *old;
+	tio.c_lflag &= ~(ICANON | ECHO);
+	tio.c_cc[VMIN] = vmin;
+	tio.c_cc[VTIME] = vtime;
+	tcsetattr(0, TCSANOW, &tio);
+}
+
 int main (int argc, char ** argv) {
 	row_max = 25;
 	col_max = 80;
 
-	ioctl(0, TTY_CMD_ECHO, 0, 0);
+	struct termios old_tio;
+	tcgetattr(0, &old_tio);
 
+	// 按键立即读取，每次读取至少一个字符
+	set_input_mode(&old_tio, 1, 0);
 	show_welcome();
     begin_game();
 
-    int count;
-	int cnt = 0;
+	// 最多等待0.5秒，期间没有按键则自动往前移，不用再忙等
+	struct pollfd pfd = {.fd = 0, .events = POLLIN};
 	do {
-		// 检查是否有键盘输入
-		ioctl(0, TTY_CMD_IN_COUNT, (int)&count, 0);
-		if (count) {
-			int ch = getchar();
-			move_forward(ch);
-		} else if (++cnt % 50 == 0) {
-			// 每隔一段时间自动往前移
+		if (poll(&pfd, 1, 500) > 0) {
+			move_forward(getchar());
+		} else {
 			move_forward(snake.dir);
 		}
 
@@ -285,13 +295,10 @@ int main (int argc, char ** argv) {
 			getchar();
 			break;
 		}
-
-		msleep(10);
 	}while (1);
 
-	// 这里是有危险的，如果进程异常退出，将导致回显失败
-	ioctl(0, TTY_CMD_ECHO, 1, 0);
+	// 这里是有危险的，如果进程异常退出，将导致终端设置无法恢复
+	tcsetattr(0, TCSANOW, &old_tio);
 	clear_map();
     return 0;
 }
-